@@ -22,15 +22,26 @@ SOURCES += main.cpp\
     src/common/tcpcomm.cpp \
     src/common/udpcomm.cpp \
     ipcap/src/protocol/doip.cpp \
+    ipcap/src/protocol/fragment.cpp \
     ipcap/src/protocol/ip.cpp \
+    ipcap/src/protocol/tcp.cpp \
     ipcap/src/protocol/uds.cpp \
+    ipcap/src/arena.cpp \
+    ipcap/src/checksum.cpp \
     ipcap/src/config.cpp \
+    ipcap/src/filter.cpp \
+    ipcap/src/dispatch.cpp \
+    ipcap/src/flow.cpp \
     ipcap/src/ipcap.cpp \
     ipcap/src/packet.cpp \
+    ipcap/src/pcapng.cpp \
+    ipcap/src/stats.cpp \
     src/doip/doiphelper.cpp \
     src/sqlite.cpp \
+    src/sqlitewriter.cpp \
     src/packeinfo.cpp \
     src/doip/doipgenericheaderhandler.cpp \
+    ui/conversationwindow.cpp \
     ui/doipsettingwindow.cpp \
     ui/mainwindow.cpp \
     ui/devicewindow.cpp \
@@ -43,6 +54,7 @@ HEADERS  += include/common/basecomm.h \
     include/common/tcpcomm.h \
     include/common/udpcomm.h \
     include/common/thread_pool.hpp \
+    include/common/ring_buffer.hpp \
     include/doip/doiphelper.h \
     include/doip/doipserverconfig.h \
     include/npcap1.13/include/pcap/bluetooth.h \
@@ -65,16 +77,28 @@ HEADERS  += include/common/basecomm.h \
     include/npcap1.13/include/pcap-namedb.h \
     include/npcap1.13/include/pcap.h \
     ipcap/include/protocol/doip.h \
+    ipcap/include/protocol/fragment.h \
     ipcap/include/protocol/ip.h \
+    ipcap/include/protocol/tcp.h \
     ipcap/include/protocol/uds.h \
+    ipcap/include/arena.h \
+    ipcap/include/checksum.h \
     ipcap/include/config.h \
     ipcap/include/def.h \
+    ipcap/include/filter.h \
+    ipcap/include/dispatch.h \
+    ipcap/include/flow.h \
     ipcap/include/ipcap.h \
     ipcap/include/packet.h \
+    ipcap/include/pcapng.h \
+    ipcap/include/stats.h \
     include/sqlite.h \
+    include/sqlitewriter.h \
     include/packeinfo.h \
+    include/packetrecord.h \
     include/doip/doipclientconfig.h \
     include/doip/doipgenericheaderhandler.h \
+    ui/conversationwindow.h \
     ui/doipsettingwindow.h \
     ui/mainwindow.h \
     ui/devicewindow.h \
@@ -0,0 +1,104 @@
+﻿/**
+ * @file    ring_buffer.hpp
+ * @ingroup opensource
+ * @brief   Bounded lock-free ring buffer with following features:
+ *          - Single producer / single consumer, no mutex on either side.
+ *          - Slots are allocated once at construction and reused, capacity is rounded up to a power of two.
+ *          - push fails instead of growing when the ring is full, so the caller can account for drops.
+ * @author  leiwei
+ * @date    2024.03.20
+ * Copyright (c) ctrlfrmb 2023-2033
+ */
+
+#pragma once
+
+#ifndef OPEN_SOURCE_RING_BUFFER_HPP
+#define OPEN_SOURCE_RING_BUFFER_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+#define RING_BUFFER_CACHE_LINE 64
+
+namespace opensource {
+namespace ctrlfrmb {
+
+template<typename T>
+class SpscRingBuffer {
+private:
+    std::vector<T> slots_;          // Pre-allocated slots
+    size_t mask_;                   // capacity - 1
+
+    // Padding keeps the two indexes on separate cache lines without relying on over-aligned new
+    char pad0_[RING_BUFFER_CACHE_LINE];
+    std::atomic<size_t> head_{0};   // Next slot to read, written by the consumer only
+    char pad1_[RING_BUFFER_CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_{0};   // Next slot to write, written by the producer only
+    char pad2_[RING_BUFFER_CACHE_LINE - sizeof(std::atomic<size_t>)];
+
+    static size_t roundCapacity(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        return size;
+    }
+
+public:
+    explicit SpscRingBuffer(size_t capacity) : slots_(roundCapacity(capacity)), mask_(slots_.size() - 1) {}
+    ~SpscRingBuffer() = default;
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Returns the number of slots
+    size_t capacity() const {
+        return slots_.size();
+    }
+
+    // Returns the number of queued elements, exact when called from the producer or the consumer
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return 0 == size();
+    }
+
+    // Moves an element into the ring, returns false when the ring is full (producer only)
+    bool push(T&& t) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_)
+            return false;
+
+        slots_[tail & mask_] = std::move(t);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Moves the oldest element out of the ring, returns false when the ring is empty (consumer only)
+    bool pop(T& t) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+
+        t = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns the oldest element without removing it, nullptr when the ring is empty (consumer only)
+    T* front() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &slots_[head & mask_];
+    }
+};
+
+}
+}
+
+#endif // !OPEN_SOURCE_RING_BUFFER_HPP
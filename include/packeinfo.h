@@ -4,9 +4,34 @@
 
 #include <QAbstractTableModel>
 #include <QVector>
-#include <QMutex>
+#include <QCache>
+#include <functional>
 #include "def.h"
+#include "packetrecord.h"
+#include "common/ring_buffer.hpp"
 
+// 数据库模式下每次读取的行数和缓存的块数，内存只与缓存块数有关
+#define PACKET_MODEL_BLOCK_ROWS 1000
+#define PACKET_MODEL_CACHE_BLOCKS 64
+// 缓存格式化文本的行数，覆盖可见行和滚动时附近的行
+#define PACKET_MODEL_CACHE_CELLS 4096
+// Information 列默认转换的最大字符数，由界面按列宽更新
+#define PACKET_MODEL_INFORMATION_LENGTH 512
+// 暂存区最多缓存的批次数，界面跟不上时只丢弃显示，不影响抓包和保存
+#define PACKET_MODEL_STAGE_BATCHES 4096
+
+// 从 afterId 之后读取 rows 个数据包
+using PacketFetcher = std::function<std::vector<PacketRecord>(qulonglong afterId, int rows)>;
+
+// 一行中需要格式化的文本列，按数据包编号缓存
+struct PacketCells {
+    QString timestamp;
+    QString srcIP;
+    QString destIP;
+    QString information;    // 已按列宽截断的错误描述和负载
+};
+
+// 模型只在界面线程中访问，抓包线程通过 stagePackets 投递数据包
 class PacketInfoModel : public QAbstractTableModel
 {
     Q_OBJECT
@@ -20,19 +45,64 @@ public:
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
-    void loadPackect(const std::vector<figkey::PacketInfo>& packets);
-    void addPacket(const figkey::PacketInfo& packet);
+    void loadPackect(const std::vector<PacketRecord>& packets);
+
+    // 数据库模式：行数为整个文件的行数，滚动时按块读取；afterIds 为各块的续读位置
+    void loadDataBase(const std::vector<qulonglong>& afterIds, int rows, PacketFetcher fetcher);
+    void addPacket(const PacketRecord& packet);
+
+    // 一批数据包只发出一次移除和一次插入信号，超出容量时覆盖最早的行
+    void addPackets(const std::vector<PacketRecord>& packets);
+
+    // 抓包回调线程调用，无锁放入暂存区，不触发模型信号；暂存区满时返回 false
+    bool stagePackets(std::vector<PacketRecord>&& packets);
+
+    // 界面线程每次刷新调用一次，把暂存的数据包一次插入表格，返回插入的数据包数，
+    // trimmed 返回超过表格行数、没有插入的数据包数
+    size_t commitStaged(size_t& trimmed);
     void clearPacket();
-    figkey::PacketInfo getPacketByIndex(int index);
+    PacketRecord getPacketByIndex(int index);
 
-    const QVector<figkey::PacketInfo>& getAllPacket() const;
+    // 数据库模式下返回前 displayRows 个数据包
+    QVector<PacketRecord> getAllPacket() const;
+
+    // Information 列可见的字符数，超出部分不转换为十六进制
+    void setInformationLength(int length);
 
 private:
-    QString getProtocolName(uint8_t protocolType) const;
+    const QString& getProtocolName(uint8_t protocolType) const;
+
+    // 行的格式化文本，不在缓存中时格式化一次
+    const PacketCells& getCells(const PacketRecord& packet) const;
+
+    // 数据库模式下按行号取数据包，块不在缓存中时重新读取
+    const PacketRecord* getBlockPacket(int row) const;
+
+    // 退出数据库模式
+    void clearDataBase();
+
+    // 逻辑行号映射到环形缓冲区中的数据包
+    const PacketRecord& at(int row) const;
+
+    // 抓包时的数据包保存在固定容量的环形缓冲区中，m_head 为第 0 行的位置；
+    // 每行持有自己的负载，显示的行数与 PacketArena 的大小无关
+    std::vector<PacketRecord> m_data;
+    int m_head{ 0 };
+    int m_size{ 0 };
+
+    // 单生产者（抓包回调线程）单消费者（界面线程）的暂存区
+    opensource::ctrlfrmb::SpscRingBuffer<std::vector<PacketRecord>> m_staged;
+
+    // 数据库模式
+    bool m_isDataBase{ false };
+    int m_dbRows{ 0 };
+    std::vector<qulonglong> m_blockAfterIds;
+    PacketFetcher m_fetcher;
+    mutable QCache<int, QVector<PacketRecord>> m_blocks;
 
-    QVector<figkey::PacketInfo> m_data;
-    mutable QMutex m_mutex;  // 增加一个互斥体成员变量
-    uint16_t m_rows;
+    mutable QCache<qulonglong, PacketCells> m_cells;
+    int m_informationLength{ PACKET_MODEL_INFORMATION_LENGTH };
+    int m_rows;
 };
 
 #endif // PACKET_INFO_MODEL_H
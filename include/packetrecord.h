@@ -0,0 +1,29 @@
+﻿// PacketRecord.h
+#ifndef PACKET_RECORD_H
+#define PACKET_RECORD_H
+
+#include <QByteArray>
+#include <string>
+#include "def.h"
+#include "packet.h"
+
+// 界面和数据库使用的数据包：负载在消费线程释放 arena 之前拷贝一次，或从数据库读取，
+// 之后不再引用 PacketArena；QByteArray 隐式共享，数据库队列和表格共用同一份负载
+struct PacketRecord {
+    figkey::PacketInfo info;
+    QByteArray payload;
+};
+
+// 负载的十六进制字符串
+inline std::string formatRecordPayload(const PacketRecord& record) {
+    return figkey::parsePayloadToHexString(reinterpret_cast<const uint8_t*>(record.payload.constData()),
+                                           static_cast<size_t>(record.payload.size()));
+}
+
+// 信息列，maxLength 不为 0 时只转换该长度以内的负载
+inline std::string formatRecordData(const PacketRecord& record, size_t maxLength = 0) {
+    return figkey::formatPacketData(record.info, reinterpret_cast<const uint8_t*>(record.payload.constData()),
+                                    static_cast<size_t>(record.payload.size()), maxLength);
+}
+
+#endif // PACKET_RECORD_H
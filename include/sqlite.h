@@ -4,9 +4,17 @@
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlQuery>
 #include <QFile>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
 #include "def.h"
+#include "sqlitewriter.h"
 
 #define FKCAP_SQLITE_CONNECT_NAME "figkey_connection"
+#define FKCAP_SQLITE_SCAN_CONNECT_NAME "figkey_scan_connection"
+// 数据库格式版本，保存在 PRAGMA user_version 中；0 为地址和负载保存为文本的旧格式
+#define FKCAP_SQLITE_SCHEMA_VERSION 2
 
 class SqliteCom : public QObject
 {
@@ -19,21 +27,47 @@ public:
     bool loadFile();
     bool openFile();
 
-    // 存储抓包数据到数据库
-    bool storePacket(const figkey::PacketInfo &packet);
+    // 数据包放入写入线程的队列，达到 SqlBatchSize 或等待超过 TimeSqlTransaction 时批量写入
+    bool storePacket(const PacketRecord& record);
 
-    std::vector<figkey::PacketInfo> getPacket(int start, int rows);
+    // 读取 id 大于 afterId 的 rows 个数据包，下一页传入本页最后一个数据包的 index
+    std::vector<PacketRecord> getPacket(qulonglong afterId, int rows);
 
-    std::vector<figkey::PacketInfo> getPacketByFilter(int start, int rows);
+    // 按 filter 读取，filter 须与统计块位置时使用的条件相同，否则行号与块对不上
+    std::vector<PacketRecord> getPacketByFilter(const figkey::FilterInfo& filter, qulonglong afterId, int rows);
 
+    // 在后台线程中按 filter 统计行数和各块的续读位置，完成后发出 packetBlocksReady，
+    // 再次调用时放弃尚未完成的扫描
+    void scanPacketBlocks(const figkey::FilterInfo& filter, int blockRows);
+
+    // 取得最近一次扫描的结果，afterIds 为每 blockRows 行一块时各块的续读位置，filter 为扫描使用的条件；
+    // 扫描尚未完成或已被放弃时返回 false
+    bool takePacketBlocks(int& rows, std::vector<qulonglong>& afterIds, figkey::FilterInfo& filter);
+
+    // 当前打开的是 loadFile 选择查看的文件，而不是抓包的临时数据库
+    bool isLoaded() const { return isFileLoaded; }
+
+    // 过滤条件不限制任何列
+    static bool isFilterEmpty(const figkey::FilterInfo& filter);
+
+    // 通知写入线程立即写入队列中的数据包
     void writeFile();
 
-    void saveFile();
+    // 删除时间戳早于 timestamp 的数据包，滚动保存时数据库只保留滚动文件覆盖的范围
+    void removePacketBefore(uint64_t timestamp);
+
+    // 保存数据库，选择 pcapng 格式时保存抓包时写入的 pcapng 文件，
+    // 滚动模式下保存索引中的全部文件，按保存的文件名编号并生成新的索引
+    void saveFile(const QString& pcapngFileName = QString());
 
     void closeFile();
 
     void checkFile();
 
+signals:
+    // 后台扫描完成，在界面线程中由 takePacketBlocks 取得结果
+    void packetBlocksReady();
+
 private:
 
     void moveFile();
@@ -41,12 +75,43 @@ private:
     // 创建数据库表格
     bool createTableIfNotExists();
 
+    // 数据库中的数据包表是否为旧格式
+    bool isLegacyTable();
+
+    // 把旧格式的数据包表转换为二进制格式，invalidPayloads 返回负载无法解析、保存为空的数据包数
+    bool convertLegacyTable(int& invalidPayloads);
+
     void closeDataBase();
 
+    // 放弃并等待后台扫描结束
+    void stopScan();
+
+    // 扫描线程使用自己的连接，先建过滤条件需要的索引，再只扫描主键
+    void runScan(QString fileName, figkey::FilterInfo filter, int blockRows);
+
     QFile dbFile;
 
+    // 界面线程的连接只用于建表和查询
     QSqlDatabase db;
     QSqlQuery query;
+
+    // 最近一次过滤查询的语句，条件不变时复用
+    QString filterString;
+    QSqlQuery filterQuery;
+
+    // 抓包时的数据包由写入线程的连接写入
+    SqliteWriter writer;
+
+    bool isFileLoaded{ false };
+
+    // 后台扫描的结果，scanMutex 保护
+    std::thread scanThread;
+    std::atomic<bool> isScanCancelled{ false };
+    std::mutex scanMutex;
+    bool isScanReady{ false };
+    int scanRows{ 0 };
+    std::vector<qulonglong> scanAfterIds;
+    figkey::FilterInfo scanFilter;
 };
 
 #endif // SQLITE_COMMON_H
@@ -0,0 +1,88 @@
+﻿#ifndef SQLITE_WRITER_H
+#define SQLITE_WRITER_H
+
+#include <QString>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <vector>
+#include <QByteArray>
+#include "def.h"
+#include "packetrecord.h"
+
+#define FKCAP_SQLITE_WRITER_CONNECT_NAME "figkey_writer_connection"
+// 多行 INSERT 每条语句的行数，13 列 x 50 行不超过 SQLite 默认的 999 个参数
+#define FKCAP_SQLITE_INSERT_ROWS 50
+// 待写入队列的最大字节数（负载加记录本身），磁盘跟不上时丢弃新数据包而不阻塞调用者
+#define FKCAP_SQLITE_QUEUE_BYTES (256ULL*1024*1024)
+
+// 数据库写入线程：持有自己的连接，抓包和界面线程只把数据包放入队列
+class SqliteWriter
+{
+public:
+    SqliteWriter() = default;
+    ~SqliteWriter();
+
+    SqliteWriter(const SqliteWriter&) = delete;
+    SqliteWriter& operator=(const SqliteWriter&) = delete;
+
+    // 在写入线程中打开 fileName，等待连接打开完成后返回
+    bool start(const QString& fileName);
+
+    // 写入队列中剩余的数据包后关闭连接
+    void stop();
+
+    bool isRunning() const { return isRunningFlag.load(); }
+
+    // 放入待写入队列，达到 SqlBatchSize 时唤醒写入线程，不等待磁盘
+    bool storePacket(const PacketRecord& record);
+
+    // 唤醒写入线程立即写入队列中的数据包
+    void flush();
+
+    // 由写入线程删除时间戳早于 timestamp 的数据包
+    void removePacketBefore(uint64_t timestamp);
+
+    // 预编译的 INSERT 语句，rows 为每条语句插入的行数
+    static bool prepareInsert(QSqlDatabase& db, QSqlQuery& insert, int rows);
+
+    // 从该网卡的 PacketArena 存储区拷贝负载，arena 中的数据已被覆盖时返回 false
+    static bool readPayload(const figkey::PacketInfo& packet, QByteArray& payload);
+
+    // 按 INSERT 语句的列顺序绑定一个数据包，地址和负载以二进制绑定，返回下一个参数位置
+    static int bindPacket(QSqlQuery& insert, int pos, const figkey::PacketInfo& packet, const QByteArray& payload);
+
+    // 创建过滤条件用到的列的索引，抓包时不维护，在第一次按该条件过滤查询时创建，已存在的索引直接跳过
+    static bool createIndexes(QSqlDatabase& db, const figkey::FilterInfo& filter);
+
+private:
+    void run(QString fileName, std::promise<bool> opened);
+
+    bool openDataBase(QSqlDatabase& db, const QString& fileName);
+
+    // 每 SqlBatchSize 个数据包一个事务，用复用的预编译语句写入
+    void writePackets(QSqlDatabase& db, const std::vector<PacketRecord>& packets);
+
+    void removePackets(QSqlDatabase& db);
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<PacketRecord> queue;
+    uint64_t queueBytes{ 0 };       // queue 中数据包占用的字节数
+    bool isStopping{ false };
+    bool isFlushRequested{ false };
+    std::atomic<bool> isRunningFlag{ false };
+
+    std::atomic<uint64_t> removeBefore{ 0 };
+    uint64_t removedBefore{ 0 };
+
+    QSqlQuery batchInsert;          // 多行 INSERT
+    QSqlQuery rowInsert;            // 单行 INSERT，写入不足一条多行语句的剩余数据包
+};
+
+#endif // SQLITE_WRITER_H
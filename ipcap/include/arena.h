@@ -0,0 +1,78 @@
+﻿/**
+ * @file    arena.h
+ * @ingroup figkey
+ * @brief   Fixed size byte arena holding captured frames referenced by PacketInfo
+ * @author  leiwei
+ * @date    2024.03.22
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_ARENA_HPP
+#define FIGKEY_PCAP_ARENA_HPP
+
+#include <atomic>
+#include <vector>
+#include "def.h"
+
+namespace figkey {
+
+    // 每个抓包网卡一个环形存储区，偏移量在存储区内单调递增；
+    // 只有该网卡的抓包线程写入，消费线程按投递顺序释放，未释放的数据不会被覆盖
+    class PacketArena {
+    public:
+        // Delete copy constructor and assignment operator to ensure uniqueness of the packet arena
+        PacketArena(const PacketArena&) = delete;
+        PacketArena(PacketArena&&) = delete;
+        PacketArena& operator=(const PacketArena&) = delete;
+        PacketArena& operator=(PacketArena&&) = delete;
+
+        // Retrieve an instance of the packet arena(singleton pattern)
+        static PacketArena& Instance() {
+            static PacketArena obj;
+            return obj;
+        }
+
+        // 按网卡数划分存储区并清空，在抓包线程启动之前调用
+        void clear(size_t sources);
+
+        // 写入 source 的存储区，剩余空间不足时返回 false，只由该网卡的抓包线程调用
+        bool append(uint8_t source, const uint8_t* data, uint32_t length, uint64_t& offset);
+
+        // end 之前的数据已处理完，空间可以被后续数据复用
+        void release(uint8_t source, uint64_t end);
+
+        // 偏移量处的数据仍然有效时拷贝到 out
+        bool read(uint8_t source, uint64_t offset, uint32_t length, uint8_t* out) const;
+
+        bool read(uint8_t source, uint64_t offset, uint32_t length, std::vector<uint8_t>& out) const;
+
+        bool isValid(uint8_t source, uint64_t offset, uint32_t length) const;
+
+        // 每个存储区的字节数
+        size_t getCapacity() const;
+
+    private:
+        struct Region {
+            uint8_t* data{ nullptr };
+            std::atomic<uint64_t> head{ 0 };
+            std::atomic<uint64_t> tail{ 0 };
+        };
+
+        std::vector<uint8_t> buffer;
+        uint64_t regionSize;
+        uint64_t mask;
+        size_t regionCount;
+        Region regions[CAPTURE_INTERFACE_MAX];
+
+        // Packet arena constructor
+        PacketArena();
+
+        // Packet arena destructor
+        ~PacketArena();
+    };
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_ARENA_HPP
@@ -0,0 +1,32 @@
+﻿/**
+ * @file    checksum.h
+ * @ingroup figkey
+ * @brief   Internet one's complement checksum for IPv4, TCP and UDP
+ * @author  leiwei
+ * @date    2024.04.10
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_CHECKSUM_HPP
+#define FIGKEY_PCAP_CHECKSUM_HPP
+
+#include <cstddef>
+#include "def.h"
+
+namespace figkey {
+
+    // 按本机字节序累加 data 中的 16 位字，返回未折叠的累加值；
+    // 分多段累加时只有最后一段的长度可以为奇数
+    uint64_t checksumAdd(const uint8_t* data, size_t length, uint64_t sum = 0);
+
+    // 折叠为 16 位的反码和，与报文中校验和字段按内存读取的值直接比较，不需要字节序转换
+    uint16_t checksumFold(uint64_t sum);
+
+    // TCP/UDP 伪首部的累加值，length 为传输层头加负载的长度
+    uint64_t checksumPseudoHeader(const PacketInfo& info, uint8_t protocol, uint32_t length);
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_CHECKSUM_HPP
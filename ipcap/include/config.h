@@ -13,7 +13,12 @@
 #define FIGKEY_PCAP_CONFIG_HPP
 
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
 #include "def.h"
+#include "filter.h"
 
 namespace figkey {
 
@@ -22,8 +27,17 @@ namespace figkey {
     private:
         CaptureConfigInfo configInfo;
 
+        // 抓包线程通过原子指针无锁读取当前过滤器，修改时发布新对象，
+        // 旧对象保留到抓包线程退出后再回收，读取中的引用不会失效
+        std::atomic<const PacketFilter*> activeFilter;
+        std::vector<std::unique_ptr<PacketFilter>> filters;
+        std::mutex filterMutex;
+
         // Capture config constructor
-        CaptureConfig()=default;
+        CaptureConfig();
+
+        // 调用前需持有 filterMutex
+        void replaceFilter(std::unique_ptr<PacketFilter> filter);
 
         // Capture config destructor
         ~CaptureConfig()=default;
@@ -47,7 +61,23 @@ namespace figkey {
 
         void setNetwork(const NetworkInfo& network);
 
+        // 同时抓包的多个网卡，第一个作为主网卡
+        void setNetworks(const std::vector<NetworkInfo>& networks);
+
+        void setPcapngFile(const std::string& path);
+
+        // 保存过滤条件，抓包线程使用的过滤器在 BPF 安装后由 publishFilter 发布
         void setFilter(const FilterInfo& filter);
+
+        // 返回当前发布的过滤器，每个数据包读取一次
+        const PacketFilter& getPacketFilter() const;
+
+        // 把当前过滤条件编译为二进制比较后发布，所有网卡的 BPF 安装完成后调用一次；
+        // isKernelFiltered 为 true 时 kernelSince 之后捕获的数据包只比较 BPF 无法表达的条件
+        void publishFilter(bool isKernelFiltered, uint64_t kernelSince);
+
+        // 没有抓包线程读取时释放已替换的过滤器
+        void reclaimFilters();
     };
 
 }  // namespace figkey
@@ -18,11 +18,32 @@
 
 #define ETHERNET_MTU_MAX 1500
 #define CAPTURE_SNAP_LENGTH (ETHERNET_MTU_MAX*10)  //MTU
+#define CAPTURE_SNAP_LENGTH_MIN 128
+#define CAPTURE_SNAP_LENGTH_MAX 262144
+#define CAPTURE_BUFFER_SIZE 16      //MB
+#define CAPTURE_TIMEOUT 1000        //ms
+#define CAPTURE_INTERFACE_MAX 8
 #define CAPTURE_PROMISC 1
 #define ETHERNET_IPV4_HEADER_MIN (14+20)
 #define ETHERNET_IPV6_HEADER_MIN (14+40)
 #define ETHERNET_IP_TCP_HEADER_MIN (14+20+20)
 #define ETHERNET_IP_UDP_HEADER_MIN (14+20+8)
+#define PACKET_IP_ADDRESS_LENGTH 16
+#define PACKET_MAC_ADDRESS_LENGTH 6
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+#define TCP_FLAG_ACK 0x10
+#define TCP_REASSEMBLY_SHARDS 16                    // 重组表分片数，不同连接的抓包线程互不阻塞
+#define TCP_REASSEMBLY_FLOW_MAX 4096                // 同时重组的最大连接数
+#define TCP_REASSEMBLY_PENDING_MAX (256 * 1024)     // 每个方向缓存的乱序数据上限，字节
+#define TCP_REASSEMBLY_IDLE_TIMEOUT 60              //s 连接空闲超过该时间后释放
+#define TCP_REASSEMBLY_MEMORY_MAX (64 * 1024 * 1024)    // 所有连接的乱序数据和未完成的 DoIP 消息合计上限，字节
+#define DOIP_STREAM_MESSAGE_MAX (128 * 1024)        // 跨分段缓存的最大 DoIP 消息，更大的消息只跳过不解析
+#define TCP_ANALYSIS_DEFAULT_RTT 3000000            //ns 未测得往返时间时区分乱序和重传的时间阈值
+#define FRAGMENT_DATAGRAM_MAX 256                   // 同时重组的 IPv4 数据报上限
+#define FRAGMENT_MEMORY_MAX (4 * 1024 * 1024)       // 重组缓存的负载和暂存分片的上限，字节
+#define FRAGMENT_TIMEOUT 30                         //s 数据报未收齐的最长等待时间
 
 #define CONFIG_ROOT_NODE_NAME "ipcap"
 #define CONFIG_CAPTURE_PROTOCOL_NODE "CaptureProtocol"
@@ -34,7 +55,24 @@
 #define CONFIG_DOIP_CLIENT_RECEIVE "DoIPClientReceive"
 #define CONFIG_TIME_UPDATE_UI "TimeUpdateUI"
 #define CONFIG_TIME_SQL_TRANSACTION "TimeSqlTransaction"
+#define CONFIG_SQL_BATCH_SIZE "SqlBatchSize"
 #define CONFIG_FILTER_PROTOCOL_NODE "FilterProtocol"
+#define CONFIG_BATCH_SIZE "BatchSize"
+#define CONFIG_BATCH_TIMEOUT "BatchTimeout"
+#define CONFIG_RING_SIZE "RingSize"
+#define CONFIG_ARENA_SIZE "ArenaSize"
+#define CONFIG_CAPTURE_PROFILE "CaptureProfile"
+#define CONFIG_CAPTURE_BUFFER_SIZE "CaptureBufferSize"
+#define CONFIG_CAPTURE_IMMEDIATE_MODE "CaptureImmediateMode"
+#define CONFIG_CAPTURE_TIMEOUT "CaptureTimeout"
+#define CONFIG_CAPTURE_SNAP_LENGTH "CaptureSnapLength"
+#define CONFIG_MERGE_LATENCY "MergeLatency"
+#define CONFIG_PCAPNG_EXPORT "PcapngExport"
+#define CONFIG_ROLLING_FILES "RollingFiles"
+#define CONFIG_ROLLING_FILE_SIZE "RollingFileSize"
+#define CONFIG_ROLLING_FILE_DURATION "RollingFileDuration"
+#define CONFIG_VALIDATE_HEADERS "ValidateHeaders"
+#define CONFIG_CHECKSUM_OFFLOAD "ChecksumOffload"
 #define PACKET_LOGGER_ERROR "error"
 #define PACKET_LOGGER_WARN "warn"
 
@@ -87,6 +125,13 @@ namespace figkey {
         // ... 其他错误
     };
 
+    // 抓包参数预设，具体参数仍可在配置文件中单独覆盖
+    enum CAPTURE_PROFILE : uint8_t {
+        CAPTURE_PROFILE_DEFAULT,
+        CAPTURE_PROFILE_LATENCY,              // 立即模式，逐包上送，用于测量请求响应时延
+        CAPTURE_PROFILE_THROUGHPUT            // 大缓冲区，驱动批量上送，用于突发流量
+    };
+
     // Structure for storing ip address information
     struct IpAddressInfo {
         std::string ip;
@@ -122,10 +167,29 @@ namespace figkey {
         uint16_t sendRows{20};
         uint16_t receiveRows{10000};
         uint16_t timeUpdateUI{1000};        //ms
-        uint16_t timeSqlTransaction{100};
+        uint16_t timeSqlTransaction{100};   //ms 数据包等待写入数据库的最长时间
+        uint16_t sqlBatchSize{500};         // 每个数据库事务写入的最大包数
         uint16_t doipClientSend{5};
         uint16_t doipClientReceive{20};
-        NetworkInfo network;
+        uint16_t batchSize{64};             // 批量投递的最大包数
+        uint16_t batchTimeout{50};          //ms 批量投递的最长等待时间
+        uint32_t ringSize{65536};           // 抓包线程与消费线程之间环形缓冲区的槽位数
+        uint16_t arenaSize{64};             //MB 捕获数据存储区大小
+        uint8_t  captureProfile{CAPTURE_PROFILE_DEFAULT}; // 抓包参数预设
+        uint16_t captureBufferSize{CAPTURE_BUFFER_SIZE};  //MB 驱动缓冲区大小
+        bool     captureImmediateMode{false};             // 数据包到达后立即上送，不等待缓冲区或超时
+        uint16_t captureTimeout{CAPTURE_TIMEOUT};         //ms 驱动批量上送的超时时间
+        uint32_t captureSnapLength{CAPTURE_SNAP_LENGTH};  // 单包最大捕获长度
+        uint16_t mergeLatency{20};          //ms 多网卡按时间合并时等待其他网卡数据的最长时间
+        bool     pcapngExport{true};        // 抓包时同时写入 pcapng 文件
+        std::string pcapngFile;             // pcapng 临时文件路径，由界面设置
+        uint16_t rollingFiles{0};           // pcapng 滚动保存的文件数，0 为单个文件
+        uint32_t rollingFileSize{100};      //MB 滚动文件大小上限
+        uint32_t rollingFileDuration{3600}; //s 滚动文件时间跨度上限
+        bool     validateHeaders{false};    // 校验 IP/TCP/UDP 头和校验和，错误只标记不丢弃
+        bool     checksumOffload{true};     // 校验和为 0 或只含伪首部时视为网卡卸载，不报错
+        NetworkInfo network;                // 主网卡，网络助手等功能使用
+        std::vector<NetworkInfo> networks;  // 同时抓包的网卡，下标即 PacketInfo::interfaceId
         FilterInfo filter;
         std::string captureFilter{ "udp or tcp" };
     };
@@ -221,20 +285,27 @@ namespace figkey {
         DiagnosticNegativeAck = 0x8003
     };
 
+    // 定长数据包记录，不持有堆内存，字符串只在界面显示或导出时生成
     struct PacketInfo
     {
         uint64_t index{0};                  // 索引
-        std::string timestamp;              // 时间戳
-        uint8_t err;                        // 错误码
-        std::string srcIP;                  // 源IP
-        std::string destIP;                 // 目标IP
-        std::string srcMAC;                 // 源MAC
-        std::string destMAC;                // 目标MAC
-        uint16_t srcPort;                   // 源端口
-        uint16_t destPort;                  // 目标端口
-        uint8_t protocolType;               // 协议类型，使用枚举类表示
-        uint16_t payloadLength;             // 负载长度
-        std::string data;                   // 信息
+        uint64_t timestamp{0};              // 时间戳，纳秒
+        uint64_t dataOffset{0};             // 捕获数据在该网卡 PacketArena 存储区中的偏移
+        uint32_t dataLength{0};             // 捕获数据长度
+        uint32_t flowId{0};                 // 所属连接编号，0 为未跟踪
+        uint16_t payloadOffset{0};          // 负载相对捕获数据的偏移
+        uint16_t transportOffset{0};        // TCP/UDP 头相对捕获数据的偏移
+        uint16_t payloadLength{0};          // 负载长度
+        uint16_t srcPort{0};                // 源端口
+        uint16_t destPort{0};               // 目标端口
+        uint8_t err{0};                     // 错误码
+        uint8_t ipVersion{0};               // IP 版本 4 或 6
+        uint8_t protocolType{0};            // 协议类型，使用枚举类表示
+        uint8_t interfaceId{0};             // 抓包网卡编号
+        uint8_t srcIP[PACKET_IP_ADDRESS_LENGTH]{};      // 源IP，IPv4 只使用前 4 字节
+        uint8_t destIP[PACKET_IP_ADDRESS_LENGTH]{};     // 目标IP
+        uint8_t srcMAC[PACKET_MAC_ADDRESS_LENGTH]{};    // 源MAC
+        uint8_t destMAC[PACKET_MAC_ADDRESS_LENGTH]{};   // 目标MAC
     };
 
 }  // namespace figkey
@@ -0,0 +1,95 @@
+﻿/**
+ * @file    dispatch.h
+ * @ingroup figkey
+ * @brief   Batch delivery of parsed packets from the capture thread to the consumer
+ * @author  leiwei
+ * @date    2024.03.18
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_DISPATCH_HPP
+#define FIGKEY_PCAP_DISPATCH_HPP
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <functional>
+#include "def.h"
+#include "common/ring_buffer.hpp"
+
+namespace figkey {
+    // 批量回调函数类型
+    using PacketBatchCallback = std::function<void(std::vector<PacketInfo>)>;
+
+    // Packet dispatch class, every capture thread pushes packets into its own bounded ring,
+    // a dedicated consumer thread merges the rings by timestamp and hands whole batches to the callback
+    class PacketDispatcher {
+    public:
+        // Delete copy constructor and assignment operator to ensure uniqueness of the packet dispatcher
+        PacketDispatcher(const PacketDispatcher&) = delete;
+        PacketDispatcher(PacketDispatcher&&) = delete;
+        PacketDispatcher& operator=(const PacketDispatcher&) = delete;
+        PacketDispatcher& operator=(PacketDispatcher&&) = delete;
+
+        // Retrieve an instance of the packet dispatcher(singleton pattern)
+        static PacketDispatcher& Instance() {
+            static PacketDispatcher obj;
+            return obj;
+        }
+
+        // 设置批量回调函数，为空时关闭批量投递，需在 start 之前设置
+        void setCallback(PacketBatchCallback callback);
+
+        bool isEnabled() const;
+
+        // 每个抓包网卡创建一个环形缓冲区并启动消费线程，
+        // isBlocking 为 true 时缓冲区满由 push 等待，用于可以限速的离线文件
+        void start(size_t sources = 1, bool isBlocking = false);
+
+        // 投递缓冲区中剩余的数据后停止消费线程
+        void stop();
+
+        // 仅由 info.interfaceId 对应的抓包线程调用，data 为 info.dataLength 字节的原始帧，
+        // 先写入该网卡的 arena 存储区，arena 或缓冲区满时丢弃并计数或等待
+        void push(PacketInfo&& info, const uint8_t* data);
+
+        // 缓冲区满被丢弃的包数
+        uint64_t getDropped() const;
+
+        // 缓冲区最高水位
+        size_t getHighWater() const;
+
+        size_t getCapacity() const;
+
+    private:
+        PacketBatchCallback batchCallBack;
+        // 每个网卡一个单生产者环形缓冲区，抓包线程之间不共享锁
+        std::vector<std::unique_ptr<opensource::ctrlfrmb::SpscRingBuffer<PacketInfo>>> rings;
+        size_t sourceCount;
+        bool isBlocking;
+        std::thread consumer;
+        std::atomic<bool> isRunning;
+        std::atomic<uint64_t> dropped;
+        std::atomic<size_t> highWater;
+
+        // Packet dispatch constructor
+        PacketDispatcher();
+
+        // Packet dispatch destructor
+        ~PacketDispatcher();
+
+        void consume();
+
+        // 回调返回后批次中的负载已拷贝，释放它们在 arena 中占用的空间
+        void deliver(std::vector<PacketInfo>&& batch);
+
+        // 多网卡时按时间戳 k 路合并，其他网卡空闲超过 mergeLatency 时不再等待
+        void consumeMerged();
+    };
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_DISPATCH_HPP
@@ -0,0 +1,73 @@
+﻿/**
+ * @file    filter.h
+ * @ingroup figkey
+ * @brief   User filter compiled into binary header field comparisons
+ * @author  leiwei
+ * @date    2024.03.25
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_FILTER_HPP
+#define FIGKEY_PCAP_FILTER_HPP
+
+#include <string>
+#include "def.h"
+
+namespace figkey {
+
+    // FilterInfo 在设置时编译一次，抓包线程只比较原始头部字段，不生成字符串
+    class PacketFilter {
+    public:
+        PacketFilter() = default;
+
+        explicit PacketFilter(const FilterInfo& filter);
+
+        // 比较 IP、MAC、端口和负载长度，地址和端口已下推到 BPF 时只比较负载长度；
+        // BPF 放行全部非第一个分片，isFragment 为 true 时端口总在用户态比较，分片的端口为所属数据报的端口
+        bool matchHeader(const PacketInfo& info, bool isFragment = false) const;
+
+        // 过滤条件中有端口，端口未知的分片需要等待第一个分片
+        bool hasPortFilter() const;
+
+        // BPF 过滤器安装成功后设置，since 及之后捕获的数据包不再在用户态重复比较地址和端口；
+        // 之前捕获的数据包可能由旧的 BPF 放行，仍比较全部条件
+        void setKernelFiltered(bool flag, uint64_t since = 0);
+
+        bool isKernelFiltered() const;
+
+        // 比较协议类型，DOIP 同时匹配 UDS
+        bool matchProtocol(uint8_t protocol) const;
+
+    private:
+        uint64_t kernelSince{ 0 };
+        bool kernelFiltered{ false };
+        bool hasIP{ false };
+        bool hasSrcIP{ false };
+        bool hasDestIP{ false };
+        bool hasSrcMAC{ false };
+        bool hasDestMAC{ false };
+        uint8_t protocolType{ PROTOCOL_TYPE_DEFAULT };
+        uint8_t ipVersion{ 0 };
+        uint8_t srcIPVersion{ 0 };
+        uint8_t destIPVersion{ 0 };
+        uint8_t ip[PACKET_IP_ADDRESS_LENGTH]{};
+        uint8_t srcIP[PACKET_IP_ADDRESS_LENGTH]{};
+        uint8_t destIP[PACKET_IP_ADDRESS_LENGTH]{};
+        uint8_t srcMAC[PACKET_MAC_ADDRESS_LENGTH]{};
+        uint8_t destMAC[PACKET_MAC_ADDRESS_LENGTH]{};
+        uint16_t port{ 0 };
+        uint16_t srcPort{ 0 };
+        uint16_t destPort{ 0 };
+        uint16_t minLen{ 0 };
+        uint16_t maxLen{ 0 };
+    };
+
+    // 根据 FilterInfo 生成 BPF 表达式，负载长度和 DOIP/UDS 协议无法用 BPF 表达，仍在用户态过滤；
+    // 设置端口时不带端口的 IPv4 后续分片也会通过，用于分片重组
+    std::string buildCaptureFilter(const FilterInfo& filter, const std::string& captureFilter);
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_FILTER_HPP
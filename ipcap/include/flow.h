@@ -0,0 +1,180 @@
+﻿/**
+ * @file    flow.h
+ * @ingroup figkey
+ * @brief   Connection key and flow table with per connection statistics
+ * @author  leiwei
+ * @date    2024.04.08
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_FLOW_HPP
+#define FIGKEY_PCAP_FLOW_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "def.h"
+
+#define FLOW_TABLE_SHARDS 16
+// 每个分片的槽位数，必须为 2 的幂
+#define FLOW_TABLE_SHARD_SLOTS 1024
+// 每个分片最多跟踪的连接数，保持装载率不超过 3/4
+#define FLOW_TABLE_SHARD_FLOWS (FLOW_TABLE_SHARD_SLOTS * 3 / 4)
+#define FLOW_TABLE_IDLE_TIMEOUT 120         //s 连接空闲超过该时间后从表中删除
+#define FLOW_TABLE_CLOSED_TIMEOUT 2         //s 两个方向都已发送 FIN 或收到 RST 后，等待末尾的确认和重传再删除
+#define FLOW_TABLE_CLOSED_FLOWS 4096        // 保留统计的已删除连接数
+
+namespace figkey {
+
+    // 两个端点按地址和端口排序，同一连接两个方向的数据包得到相同的键
+    struct FlowKey {
+        uint8_t ipVersion{0};
+        uint8_t protocol{0};
+        uint16_t portA{0};
+        uint16_t portB{0};
+        uint8_t ipA[PACKET_IP_ADDRESS_LENGTH]{};
+        uint8_t ipB[PACKET_IP_ADDRESS_LENGTH]{};
+
+        bool operator==(const FlowKey& other) const;
+    };
+
+    struct FlowKeyHash {
+        size_t operator()(const FlowKey& key) const;
+    };
+
+    // isReverse 为 true 表示数据包从 B 端发往 A 端
+    FlowKey makeFlowKey(const PacketInfo& info, bool& isReverse);
+
+    enum FLOW_STATE : uint8_t {
+        FLOW_STATE_ACTIVE,                  // UDP 或尚未判断的 TCP 连接
+        FLOW_STATE_SYN_SENT,
+        FLOW_STATE_SYN_RECEIVED,
+        FLOW_STATE_ESTABLISHED,             // 握手完成或抓包开始时连接已建立
+        FLOW_STATE_CLOSING,                 // 一个方向已发送 FIN
+        FLOW_STATE_CLOSED,                  // 两个方向都已发送 FIN
+        FLOW_STATE_RESET
+    };
+
+    // 一个连接的统计，下标 0 为 A 端发往 B 端，1 为 B 端发往 A 端
+    struct FlowInfo {
+        uint32_t id{0};                     // 连接编号，与 PacketInfo::flowId 对应
+        uint8_t state{FLOW_STATE_ACTIVE};
+        FlowKey key;
+        uint64_t packets[2]{};
+        uint64_t bytes[2]{};                // 线路长度
+        uint64_t firstTimestamp{0};         // 纳秒
+        uint64_t lastTimestamp{0};
+        uint64_t handshakeRtt{0};           // 纳秒，SYN 到握手完成的时间，未看到握手为 0
+        uint64_t smoothedRtt{0};            // 纳秒，数据段到确认的平滑往返时间
+    };
+
+    // 连接表，按连接键分片加锁，分片内为线性探测的开放寻址表，
+    // 探测时只扫描连续的哈希值数组，哈希值相同才比较完整的键；
+    // 关闭、复位和空闲的连接按包时间删除，删除时后移探测链上的连接，不使用删除标记
+    class FlowTable {
+    public:
+        // Delete copy constructor and assignment operator to ensure uniqueness of the flow table
+        FlowTable(const FlowTable&) = delete;
+        FlowTable(FlowTable&&) = delete;
+        FlowTable& operator=(const FlowTable&) = delete;
+        FlowTable& operator=(FlowTable&&) = delete;
+
+        // Retrieve an instance of the flow table(singleton pattern)
+        static FlowTable& Instance() {
+            static FlowTable obj;
+            return obj;
+        }
+
+        // 更新数据包所属连接的统计，length 为线路长度，返回连接编号，表满时返回 0；
+        // TCP 包检测到重传、乱序、丢失分段、重复确认、窗口满或零窗口时设置 info.err
+        uint32_t update(const FlowKey& key, bool isReverse, const uint8_t* packet, PacketInfo& info, uint32_t length);
+
+        // 开始新的抓包时清空
+        void clear();
+
+        // 按连接编号排序的快照，包括最近 FLOW_TABLE_CLOSED_FLOWS 个已删除的连接
+        std::vector<FlowInfo> getFlows() const;
+
+        // 表满未跟踪的数据包数
+        uint64_t getUntracked() const { return untracked.load(std::memory_order_relaxed); }
+
+        // CSV 格式的连接统计
+        std::string dump() const;
+
+        bool dumpFile(const std::string& path) const;
+
+        static const char* getStateName(uint8_t state);
+
+    private:
+        // 一个方向的序号和确认跟踪，定长，不随数据包分配内存
+        struct TcpTracker {
+            uint64_t advanceTimestamp{0};   // nextSeq 最近一次前进的时间
+            uint64_t sampleTimestamp{0};    // 同时只测量一个数据段的往返时间，0 表示没有
+            uint32_t sampleSeq{0};          // 测量数据段的结束序号
+            uint32_t nextSeq{0};            // 已看到的最大结束序号
+            uint32_t lastAck{0};
+            uint32_t window{0};             // 按窗口扩大因子换算后的接收窗口
+            uint8_t windowShift{0};
+            bool hasWindowScale{false};     // SYN 中带有窗口扩大选项
+            bool isSynced{false};
+            bool hasAck{false};
+        };
+
+        struct FlowEntry {
+            FlowInfo info;
+            uint64_t synTimestamp{0};
+            TcpTracker trackers[2];
+            uint8_t finMask{0};
+        };
+
+        struct Shard {
+            mutable std::mutex mutex;
+            std::vector<uint32_t> hashes;   // 0 表示空槽位
+            std::vector<FlowEntry> entries;
+            size_t size{0};
+            uint64_t lastSweep{0};
+        };
+
+        std::array<Shard, FLOW_TABLE_SHARDS> shards;
+        std::atomic<uint32_t> nextId{1};
+        std::atomic<uint64_t> untracked{0};
+
+        // 已删除连接的统计，在分片锁内加锁
+        mutable std::mutex closedMutex;
+        std::deque<FlowInfo> closedFlows;
+
+        // Flow table constructor
+        FlowTable();
+
+        // Flow table destructor
+        ~FlowTable();
+
+        // 调用前需持有分片锁，返回键所在的槽位，不存在时返回探测链末尾的空槽位
+        size_t findSlot(const Shard& shard, const FlowKey& key, size_t hash) const;
+
+        // 调用前需持有分片锁，删除超时的连接
+        void sweep(Shard& shard, uint64_t now);
+
+        // 调用前需持有分片锁，删除槽位中的连接并把探测链上后面的连接前移
+        void erase(Shard& shard, size_t slot);
+
+        // 已关闭或复位的连接在删除前又收到不带 ACK 的 SYN，按新连接重新跟踪
+        static bool isNewConnection(const FlowEntry& entry, const uint8_t* packet, const PacketInfo& info);
+
+        // 维护 TCP 状态，检测异常并采样往返时间
+        void updateTcp(FlowEntry& entry, int direction, const uint8_t* packet, PacketInfo& info);
+
+        // 更新发送方向的序号和确认，返回检测到的 PACKET_ERROR
+        uint8_t trackTcp(FlowEntry& entry, int direction, uint32_t seq, uint32_t ack, uint8_t flags,
+                         uint32_t window, uint32_t segmentLength, uint64_t timestamp);
+    };
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_FLOW_HPP
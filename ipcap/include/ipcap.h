@@ -15,6 +15,10 @@
 #include "pcap.h"
 #include "def.h"
 #include <atomic>
+#include <string>
+#include <thread>
+#include <memory>
+#include <chrono>
 
 namespace figkey {
 
@@ -40,12 +44,42 @@ public:
 
     bool run();
 
+    // 读取 pcap/pcapng 文件，经过与实时抓包相同的解析、过滤和投递流程，
+    // isRealTime 为 true 时按原始包间隔回放，否则以最快速度读取
+    bool runOffline(const std::string& path, bool isRealTime);
+
+    // 离线文件已经全部读取
+    bool isFinished() const;
+
     void stopCapture();
 
+    // 读取 pcap_stats 驱动计数并写入 CaptureStatistics
+    bool sampleStatistics();
+
+    // 过滤条件修改后重新安装 BPF 过滤器
+    bool updateFilter();
+
     void exit();
 
 private:
-    pcap_t* handle;
+    // 单个网卡的抓包句柄，每个网卡在独立线程中运行 pcap_loop
+    struct CaptureInterface {
+        NpcapCom* owner{ nullptr };
+        pcap_t* handle{ nullptr };
+        uint8_t id{ 0 };                                // 写入 PacketInfo::interfaceId
+        std::string name;                               // 网卡名或文件路径
+        std::string description;
+        uint32_t snapLength{ CAPTURE_SNAP_LENGTH };     // 最大捕获长度，打开设备时从配置读取
+        bool isOffline{ false };                        // 数据来源为文件
+        bool isRealTime{ false };                       // 文件按原始包间隔回放
+        uint64_t firstTimestamp{ 0 };                   // 回放的第一个包的捕获时间
+        std::chrono::steady_clock::time_point replayStart;
+        std::atomic<bool> isStopped{ false };
+        std::atomic<bool> isFinished{ false };
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<CaptureInterface>> captures;
     std::atomic<bool> isRunning;
 
     NpcapCom();
@@ -56,11 +90,22 @@ private:
 
     bool pcapOpen();
 
+    bool pcapOpen(CaptureInterface& capture, const std::string& networkName);
+
+    void pcapClose();
+
+    bool pcapSetFilter(pcap_t* handle, const std::string& expression, uint32_t netmask);
+
     bool pcapFilter(uint32_t netmask = PCAP_NETMASK_UNKNOWN);
 
     static void pcapHandler(u_char* user, const struct pcap_pkthdr* pkthdr, const u_char* packet);
 
-    void startCapture();
+    // 离线文件暂停时等待，实时回放时等待到包的原始时间间隔，停止时返回 false
+    bool waitOffline(CaptureInterface& capture, const struct pcap_pkthdr* pkthdr);
+
+    void startCapture(CaptureInterface* capture);
+
+    void startThreads(bool isBlocking);
 };
 
 }  // namespace figkey
@@ -18,15 +18,54 @@
 
 namespace figkey {
 
-    std::string parsePacketTimestamp(const struct timeval& ts);
+    // 捕获时间转换为纳秒
+    uint64_t parsePacketTimestamp(const struct timeval& ts);
+
+    std::string formatPacketTimestamp(uint64_t timestamp);
 
     std::string parsePayloadToHexString(const std::vector<uint8_t>& data);
 
+    std::string parsePayloadToHexString(const uint8_t* data, size_t length);
+
+    bool parseHexStringToPayload(const std::string& hex, std::vector<uint8_t>& data);
+
+    // 直接解码到调用者的缓冲区，data 至少 length / 2 字节，size 返回解码的字节数
+    bool parseHexStringToPayload(const char* hex, size_t length, uint8_t* data, size_t& size);
+
+    std::string formatIpAddress(const uint8_t* ip, uint8_t version);
+
+    bool parseIpAddress(const std::string& text, uint8_t* ip, uint8_t& version);
+
+    std::string formatMacAddress(const uint8_t* mac);
+
+    bool parseMacAddress(const std::string& text, uint8_t* mac);
+
+    const char* getPacketErrorName(uint8_t err);
+
+    // 从 PacketArena 中读取负载，数据已被覆盖时返回 false
+    bool getPacketPayload(const PacketInfo& info, std::vector<uint8_t>& payload);
+
+    // 界面显示的信息列，错误描述加负载的十六进制字符串；payload 为已拷贝的 length 字节负载，
+    // 少于 payloadLength 时按负载已过期显示；maxLength 不为 0 时只转换该长度以内的负载
+    std::string formatPacketData(const PacketInfo& info, const uint8_t* payload, size_t length, size_t maxLength = 0);
+
+    // 解析以太网/IP/TCP/UDP 头，成功时 payloadOffset 为负载在 packet 中的偏移，失败时为 0
     PacketInfo parseIpPacket(const unsigned char* packet, const uint32_t& size);
 
-    uint8_t checkIpHeader(const ip_header* ipHeader, const size_t& packetSize);
+    // 解析完整捕获的 IPv4 分片，只解析以太网头和 IP 头，payloadOffset 和 transportOffset 均为分片负载的偏移，
+    // 协议为 IP 头中的 TCP/UDP，第一个分片带有端口
+    PacketInfo parseIpFragment(const unsigned char* packet, const uint32_t& size);
+
+    // 校验 IPv4 头，packetSize 为 IP 头开始的捕获长度，isOffload 为 true 时校验和为 0 视为由网卡计算而不校验
+    uint8_t checkIpHeader(const ip_header* ipHeader, const size_t& packetSize, bool isOffload = false);
+
+    // 校验 parseIpPacket 解析成功的 TCP/UDP 包，isOffload 为 true 时校验和为 0 或只含伪首部的包视为网卡卸载
+    uint8_t checkTcpHeader(const unsigned char* packet, const PacketInfo& info, bool isOffload = true);
+
+    uint8_t checkUdpHeader(const unsigned char* packet, const PacketInfo& info, bool isOffload = true);
 
-    uint8_t checkTcpHeader(const unsigned char* packet);
+    // 依次校验 IP 头和传输层头，返回第一个错误
+    uint8_t validatePacket(const unsigned char* packet, uint32_t size, const PacketInfo& info, bool isOffload);
 }  // namespace figkey
 
 #endif // !FIGKEY_PCAP_PACKET_HPP
@@ -0,0 +1,170 @@
+﻿/**
+ * @file    pcapng.h
+ * @ingroup figkey
+ * @brief   Streaming pcapng writer fed from the capture threads, optionally rolling over N bounded files
+ * @author  leiwei
+ * @date    2024.04.02
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_PCAPNG_HPP
+#define FIGKEY_PCAP_PCAPNG_HPP
+
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <condition_variable>
+#include "def.h"
+
+#define PCAPNG_BUFFER_SIZE (4*1024*1024)
+#define PCAPNG_BUFFER_COUNT 16
+#define PCAPNG_FLUSH_INTERVAL 1000          //ms 缓冲区未写满时交给写文件线程的最长等待时间
+
+namespace figkey {
+
+    // Interface description block 的内容，下标即 PacketInfo::interfaceId
+    struct PcapngInterfaceInfo {
+        std::string name;
+        std::string description;
+        uint32_t snapLength{CAPTURE_SNAP_LENGTH};
+    };
+
+    // 滚动文件索引中的一项，记录文件覆盖的时间范围
+    struct PcapngFileInfo {
+        std::string path;
+        uint64_t firstTimestamp{0};
+        uint64_t lastTimestamp{0};
+        uint64_t packets{0};
+    };
+
+    // 滚动模式参数，files 为 0 时写入单个文件
+    struct PcapngRollingInfo {
+        uint16_t files{0};                  // 保留的文件数
+        uint32_t fileSize{0};               //MB 单个文件大小上限，0 不限制
+        uint32_t fileDuration{0};           //s 单个文件时间跨度上限，0 不限制
+    };
+
+    // 数据包按块写入内存缓冲区，缓冲区写满或超过 PCAPNG_FLUSH_INTERVAL 后交给写文件线程顺序写入，
+    // 抓包线程只做内存拷贝，不等待磁盘，写文件线程落后时丢弃并计数
+    class PcapngWriter {
+    public:
+        // Delete copy constructor and assignment operator to ensure uniqueness of the pcapng writer
+        PcapngWriter(const PcapngWriter&) = delete;
+        PcapngWriter(PcapngWriter&&) = delete;
+        PcapngWriter& operator=(const PcapngWriter&) = delete;
+        PcapngWriter& operator=(PcapngWriter&&) = delete;
+
+        // Retrieve an instance of the pcapng writer(singleton pattern)
+        static PcapngWriter& Instance() {
+            static PcapngWriter obj;
+            return obj;
+        }
+
+        // 创建文件并写入 section header 和每个网卡的 interface description，
+        // 滚动模式下 path 为基础文件名，实际文件为 name_00001.pcapng，索引为 name_index.csv，
+        // isBlocking 用于读取离线文件，缓冲区队列满时等待写文件线程而不丢包
+        bool open(const std::string& path, const std::vector<PcapngInterfaceInfo>& interfaces,
+                  const PcapngRollingInfo& rolling = PcapngRollingInfo(), bool isBlocking = false);
+
+        bool isOpen() const;
+
+        // 写入一个 enhanced packet block，err 不为 0 时写入错误描述作为包注释，可由多个抓包线程调用
+        void write(uint8_t interfaceId, uint64_t timestamp, const uint8_t* data, uint32_t caplen, uint32_t len, uint8_t err);
+
+        // 写入缓冲区中剩余的数据并关闭文件
+        void close();
+
+        // 已写入的包数
+        uint64_t getPackets() const;
+
+        // 缓冲区队列满被丢弃的包数
+        uint64_t getDropped() const;
+
+        // 滚动模式下仍保留的最早的包的时间戳，还没有删除过文件时为 0
+        uint64_t getRetainedSince() const;
+
+    private:
+        // 写文件线程处理的缓冲区，记录其中数据包的时间范围，isFileEnd 时写完后切换文件
+        struct PcapngBuffer {
+            std::vector<uint8_t> data;
+            uint64_t firstTimestamp{0};
+            uint64_t lastTimestamp{0};
+            uint64_t packets{0};
+            bool isFileEnd{false};
+        };
+
+        std::FILE* file;
+        std::atomic<bool> isOpened;
+        std::atomic<uint64_t> packets;
+        std::atomic<uint64_t> dropped;
+        std::atomic<uint64_t> retainedSince;
+        size_t interfaceCount;
+        std::vector<uint8_t> header;                    // 每个文件开头的 section header 和 interface description
+
+        // 滚动文件，只由写文件线程访问
+        std::string basePath;
+        PcapngRollingInfo rolling;
+        uint32_t fileNumber;
+        PcapngFileInfo current;
+        std::deque<PcapngFileInfo> files;
+
+        std::mutex bufferMutex;
+        std::condition_variable bufferCondition;
+        PcapngBuffer buffer;                            // 当前写入的缓冲区
+        uint64_t fileBytes;                             // 当前文件已写入和待写入的字节数
+        uint64_t fileStart;                             // 当前文件第一个包的时间戳
+        std::chrono::steady_clock::time_point fileOpened;   // 当前文件写入第一个包的时刻，没有新包时按此切换文件
+        std::deque<PcapngBuffer> fullBuffers;           // 等待写文件的缓冲区
+        std::vector<std::vector<uint8_t>> freeBuffers;  // 已写入文件可以复用的缓冲区
+        bool isBlocking;
+        bool isStopping;
+        std::thread writer;
+        std::chrono::steady_clock::time_point indexWritten;    // 写文件线程上次更新索引的时刻
+
+        // Pcapng writer constructor
+        PcapngWriter();
+
+        // Pcapng writer destructor
+        ~PcapngWriter();
+
+        // 调用前需持有 bufferMutex，缓冲区写满或需要切换文件时交给写文件线程，
+        // 队列已满且不是 isBlocking 时返回 false，数据包不写入
+        bool reserve(std::unique_lock<std::mutex>& lock, size_t length, bool isFileEnd);
+
+        // 调用前需持有 bufferMutex，把当前缓冲区放入写文件队列并换上一个空缓冲区
+        void swapBuffer(size_t length, bool isFileEnd);
+
+        // 调用前需持有 bufferMutex，当前文件已超过滚动时间跨度
+        bool isFileExpired(uint64_t timestamp) const;
+
+        void writeFile();
+
+        // 打开下一个文件并写入文件头，滚动模式下删除超出数量的旧文件
+        bool openFile();
+
+        void closeFile();
+
+        // 写入已关闭的文件和正在写入的文件，打开新文件和定时写入时更新
+        void writeIndex() const;
+
+        // 滚动模式下距上次更新索引超过 PCAPNG_FLUSH_INTERVAL 时重写索引，只由写文件线程调用
+        void updateIndex();
+
+        // 删除上次滚动抓包留下的文件和索引，避免与本次的文件混在一起
+        void removeRollingFiles() const;
+
+        std::string getIndexPath() const;
+
+        std::string getFilePath(uint32_t number) const;
+    };
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_PCAPNG_HPP
@@ -13,6 +13,7 @@
 #define FIGKEY_PCAP_DOIP_HPP
 
 #include <iostream>
+#include <vector>
 #include "def.h"
 
 namespace figkey {
@@ -31,7 +32,7 @@ public:
         return obj;
     }
 
-    bool parse(uint8_t& protocol, const std::vector<uint8_t>& packet);
+    bool parse(uint8_t& protocol, const uint8_t* packet, size_t length);
 
 private:
     // DoIP packet parse constructor
@@ -41,6 +42,25 @@ private:
     ~DoIPPacketParse();
 };
 
+// TCP 字节流按 DoIP 报头切分消息：一条消息可跨越多个分段，一个分段也可包含多条消息
+class DoIPStreamFramer {
+public:
+    // 输入一个分段中按序号排好的数据，每条完整的消息交给 DoIPPacketParse 解析；
+    // 返回这段数据的协议类型：含 UDS 消息为 UDS，属于 DoIP 消息为 DOIP，无法识别为 TCP
+    uint8_t feed(const uint8_t* data, size_t length);
+
+    // 数据不连续时丢弃未完成的消息，从下一个分段开始重新查找报头
+    void reset();
+
+    // 缓存跨分段消息占用的字节数
+    size_t getBufferedBytes() const { return message.capacity(); }
+
+private:
+    std::vector<uint8_t> message;   // 跨分段消息已收到的字节，含报头
+    uint32_t messageLength{0};      // 跨分段消息的总长度
+    uint64_t skipLength{0};         // 超过 DOIP_STREAM_MESSAGE_MAX 的消息剩余字节，只跳过不解析
+};
+
 }  // namespace figkey
 
 #endif // !FIGKEY_PCAP_DOIP_HPP
@@ -0,0 +1,129 @@
+﻿/**
+ * @file    fragment.h
+ * @ingroup figkey
+ * @brief   IPv4 fragment reassembly with a bounded datagram table
+ * @author  leiwei
+ * @date    2024.04.11
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_FRAGMENT_HPP
+#define FIGKEY_PCAP_FRAGMENT_HPP
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "def.h"
+
+namespace figkey {
+
+    // 分片所属数据报的键：源地址、目的地址、标识和协议
+    struct FragmentKey {
+        uint32_t srcIP{0};
+        uint32_t destIP{0};
+        uint16_t id{0};
+        uint8_t protocol{0};
+
+        bool operator==(const FragmentKey& other) const {
+            return (srcIP == other.srcIP) && (destIP == other.destIP) && (id == other.id) && (protocol == other.protocol);
+        }
+    };
+
+    struct FragmentKeyHash {
+        size_t operator()(const FragmentKey& key) const {
+            uint64_t hash = (static_cast<uint64_t>(key.srcIP) << 32) ^ key.destIP;
+            hash ^= (static_cast<uint64_t>(key.id) << 8 | key.protocol) * 0x9E3779B97F4A7C15ULL;
+            return static_cast<size_t>(hash ^ (hash >> 29));
+        }
+    };
+
+    // 第一个分片到达前暂存的分片原始帧
+    struct FragmentFrame {
+        uint64_t timestamp{0};              // 纳秒
+        uint32_t len{0};                    // 原始帧长度
+        uint8_t interfaceId{0};
+        std::vector<uint8_t> data;          // 捕获的数据
+    };
+
+    // 一个分片的处理结果
+    struct FragmentResult {
+        bool isHeld{false};                 // 端口未知，分片已暂存，调用者暂不处理
+        bool hasPorts{false};               // 已收到第一个分片，srcPort 和 destPort 为数据报的端口
+        uint16_t srcPort{0};
+        uint16_t destPort{0};
+        std::vector<uint8_t> datagram;      // 数据报收齐后为重组后的以太网帧，否则为空
+        std::vector<FragmentFrame> released;    // 端口确定后取出的此前暂存的分片，按到达顺序
+    };
+
+    // IPv4 分片重组类
+    class FragmentReassembler {
+    public:
+        // Delete copy constructor and assignment operator to ensure uniqueness of the fragment reassembler
+        FragmentReassembler(const FragmentReassembler&) = delete;
+        FragmentReassembler(FragmentReassembler&&) = delete;
+        FragmentReassembler& operator=(const FragmentReassembler&) = delete;
+        FragmentReassembler& operator=(FragmentReassembler&&) = delete;
+
+        // Retrieve an instance of the fragment reassembler(singleton pattern)
+        static FragmentReassembler& Instance() {
+            static FragmentReassembler obj;
+            return obj;
+        }
+
+        // packet 为捕获的以太网帧，caplen 和 len 为捕获长度和原始长度，不是完整捕获的 IPv4 分片时返回 false；
+        // 是分片时返回 true，结果中带有第一个分片的端口，数据报收齐后带有重组后的以太网帧，分片本身由调用者照常保存；
+        // isHold 为 true 时端口未知的分片拷贝暂存，第一个分片到达后在 released 中交回，用于按端口过滤非第一个分片
+        bool process(const uint8_t* packet, uint32_t caplen, uint32_t len, uint64_t timestamp, uint8_t interfaceId,
+                     bool isHold, FragmentResult& result);
+
+        // 开始新的抓包时释放所有未完成的数据报
+        void clear();
+
+    private:
+        struct FragmentDatagram {
+            std::vector<uint8_t> header;    // 偏移为 0 的分片的以太网头和 IP 头
+            std::vector<uint8_t> payload;
+            std::vector<std::pair<uint32_t, uint32_t>> ranges;  // 已收到的 [起点, 终点)，按起点排序且互不重叠
+            uint32_t totalLength{0};        // IP 负载总长度，最后一个分片到达后确定
+            uint32_t received{0};
+            uint32_t fragments{0};
+            uint64_t firstTimestamp{0};     // 纳秒
+            bool hasPorts{false};           // 已收到第一个分片
+            uint16_t srcPort{0};
+            uint16_t destPort{0};
+            std::vector<FragmentFrame> held;    // 第一个分片到达前暂存的分片
+            size_t heldBytes{0};
+        };
+
+        typedef std::unordered_map<FragmentKey, FragmentDatagram, FragmentKeyHash> DatagramMap;
+
+        std::mutex mutex;
+        DatagramMap datagrams;
+        size_t memoryUsed{0};
+        uint64_t lastSweep{0};
+
+        // Fragment reassembler constructor
+        FragmentReassembler();
+
+        // Fragment reassembler destructor
+        ~FragmentReassembler();
+
+        // 丢弃未完成的数据报，其中的分片计入重组失败
+        DatagramMap::iterator discard(DatagramMap::iterator it);
+
+        // 释放超时的数据报
+        void sweep(uint64_t now);
+
+        // 丢弃除 current 以外第一个分片到达最早的数据报，没有其他数据报时返回 false
+        bool discardOldest(DatagramMap::iterator current);
+
+        // 复制 [offset, end) 中尚未收到的部分，重叠部分保留先到的数据
+        static void insert(FragmentDatagram& datagram, const uint8_t* data, uint32_t offset, uint32_t end);
+    };
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_FRAGMENT_HPP
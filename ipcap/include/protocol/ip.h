@@ -18,6 +18,8 @@
 #include <functional>
 
 namespace figkey {
+    struct FragmentResult;
+
     // 回调函数类型
     using PacketCallback = std::function<void(PacketInfo)>;
 
@@ -39,7 +41,8 @@ namespace figkey {
         // 设置回调函数
         void setCallback(PacketCallback callback);
 
-        bool parse(const struct pcap_pkthdr* pkthdr, const u_char* packet);
+        // interfaceId 为抓包网卡编号，多个抓包线程可同时调用
+        bool parse(const struct pcap_pkthdr* pkthdr, const u_char* packet, uint8_t interfaceId = 0);
 
     private:
         PacketCallback packetCallBack;
@@ -50,11 +53,15 @@ namespace figkey {
         // IP packet parse destructor
         ~IPPacketParse();
 
-        bool checkFilterInfo(const PacketInfo& packet, const FilterInfo& filter);
-
-        bool checkFilterProtocol(uint8_t protocl, const FilterInfo& filter);
+        // 解析一个以太网帧，fragment 为该帧作为 IPv4 分片的重组结果，不是分片时为 nullptr；
+        // isReleased 为 true 时为端口确定后交回的暂存分片，不使用重组结果中的数据报
+        bool parseFrame(const struct pcap_pkthdr* pkthdr, const u_char* packet, uint8_t interfaceId,
+                        const FragmentResult* fragment, bool isReleased);
 
-        bool checkPacket(const struct pcap_pkthdr* pkthdr, PacketInfo&& info, std::vector<uint8_t>&& payload);
+        // 保存和导出的是 packet 原始帧，info 的偏移指向 parsed；parsed 为重组后的数据报时用于识别协议和维护连接，
+        // parsedLength 为数据报长度，为 nullptr 时为未收齐的分片，不做传输层处理
+        bool checkPacket(const struct pcap_pkthdr* pkthdr, const u_char* packet, PacketInfo&& info,
+                         const u_char* parsed, uint32_t parsedLength);
     };
 
 }  // namespace figkey
@@ -0,0 +1,106 @@
+﻿/**
+ * @file    tcp.h
+ * @ingroup figkey
+ * @brief   Per connection TCP stream reassembly feeding the DoIP stream framer
+ * @author  leiwei
+ * @date    2024.04.08
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_TCP_HPP
+#define FIGKEY_PCAP_TCP_HPP
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "def.h"
+#include "flow.h"
+#include "protocol/doip.h"
+
+namespace figkey {
+
+    // TCP stream reassembly class
+    class TcpReassembler {
+    public:
+        // Delete copy constructor and assignment operator to ensure uniqueness of the TCP reassembler
+        TcpReassembler(const TcpReassembler&) = delete;
+        TcpReassembler(TcpReassembler&&) = delete;
+        TcpReassembler& operator=(const TcpReassembler&) = delete;
+        TcpReassembler& operator=(TcpReassembler&&) = delete;
+
+        // Retrieve an instance of the TCP reassembler(singleton pattern)
+        static TcpReassembler& Instance() {
+            static TcpReassembler obj;
+            return obj;
+        }
+
+        // packet 为捕获数据，info 为已解析的 TCP 包，key 和 isReverse 由 makeFlowKey 生成；
+        // 按序号把负载交给所属连接的 DoIP 分帧，返回分段的协议类型，多个抓包线程可同时调用
+        uint8_t process(const uint8_t* packet, const PacketInfo& info, const FlowKey& key, bool isReverse);
+
+        // 开始新的抓包时释放所有连接
+        void clear();
+
+    private:
+        // 连接一个方向的字节流
+        struct TcpStream {
+            bool isSynced{false};               // 已确定下一个期望的序号
+            bool isFinished{false};             // 已收到 FIN
+            uint32_t nextSeq{0};
+            uint8_t protocol{PROTOCOL_TYPE_TCP}; // 最近一段数据的协议类型，重传的分段沿用
+            std::map<uint32_t, std::vector<uint8_t>> pending;   // 序号超前的乱序分段
+            size_t pendingBytes{0};
+            DoIPStreamFramer framer;
+        };
+
+        struct TcpFlow {
+            TcpStream streams[2];               // 0: A 端发往 B 端，1: B 端发往 A 端
+            uint64_t lastSeen{0};               // 纳秒
+            size_t bytes{0};                    // 已计入 totalBytes 的缓存字节数
+        };
+
+        // 按连接键分片加锁，不同连接的抓包线程互不阻塞
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<FlowKey, TcpFlow, FlowKeyHash> flows;
+            uint64_t lastSweep{0};
+        };
+
+        std::array<Shard, TCP_REASSEMBLY_SHARDS> shards;
+        std::atomic<uint64_t> totalBytes;       // 所有连接缓存的字节数，不超过 TCP_REASSEMBLY_MEMORY_MAX
+
+        // TCP reassembler constructor
+        TcpReassembler();
+
+        // TCP reassembler destructor
+        ~TcpReassembler();
+
+        uint8_t deliver(TcpStream& stream, uint32_t seq, const uint8_t* data, uint32_t length);
+
+        // 按序号取出已经连续的乱序分段
+        void drainPending(TcpStream& stream);
+
+        void resetStream(TcpStream& stream);
+
+        // 释放空闲超时的连接
+        void sweep(Shard& shard, uint64_t now);
+
+        // 连接两个方向缓存的乱序分段和未完成的 DoIP 消息
+        static size_t getFlowBytes(const TcpFlow& flow);
+
+        // 调用前需持有分片的锁，释放连接并从 totalBytes 中扣除
+        std::unordered_map<FlowKey, TcpFlow, FlowKeyHash>::iterator eraseFlow(
+            Shard& shard, std::unordered_map<FlowKey, TcpFlow, FlowKeyHash>::iterator it);
+
+        // 调用前需持有分片的锁，按连接当前的缓存更新 totalBytes，超过上限时先释放本分片中最久未活动的其他连接，
+        // 仍然超过时放弃本连接缓存的数据
+        void updateBytes(Shard& shard, TcpFlow& flow);
+    };
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_TCP_HPP
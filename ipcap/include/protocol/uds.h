@@ -31,7 +31,7 @@ namespace figkey {
             return obj;
         }
 
-        bool parse(DoIPPayloadType type, const std::vector<uint8_t>& packet);
+        bool parse(DoIPPayloadType type, const uint8_t* packet, size_t length);
 
     private:
 
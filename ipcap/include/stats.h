@@ -0,0 +1,104 @@
+﻿/**
+ * @file    stats.h
+ * @ingroup figkey
+ * @brief   Capture statistics, driver counters from pcap_stats plus per stage pipeline counters
+ * @author  leiwei
+ * @date    2024.03.28
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_STATS_HPP
+#define FIGKEY_PCAP_STATS_HPP
+
+#include <atomic>
+#include <string>
+#include "def.h"
+
+#define STATISTICS_ERROR_CODE_MAX 64
+
+namespace figkey {
+
+    // 数据包经过的处理阶段，每个阶段单独计数，用于定位丢包位置
+    enum STATISTICS_COUNTER : uint8_t {
+        STATISTICS_CAPTURED,                  // pcapHandler 收到的包
+        STATISTICS_PAUSED,                    // 暂停期间丢弃
+        STATISTICS_SNAP_DROPPED,              // 超过捕获长度被丢弃
+        STATISTICS_SHORT_FRAME,               // 帧长度小于最小 IP 包
+        STATISTICS_FRAGMENTED,                // IPv4 分片，按原始帧保存，收齐后按重组的数据报识别
+        STATISTICS_FRAGMENT_DROPPED,          // 超时、缓存满或长度不一致，未能重组的分片
+        STATISTICS_PARSED,                    // 头部解析成功
+        STATISTICS_PARSE_FAILED,              // 头部解析失败，按错误码另行计数
+        STATISTICS_FILTERED,                  // 被用户过滤条件丢弃
+        STATISTICS_ENQUEUED,                  // 写入环形缓冲区或线程池
+        STATISTICS_RING_DROPPED,              // 环形缓冲区满被丢弃
+        STATISTICS_EXPORT_DROPPED,            // pcapng 写文件线程落后，缓冲区队列满未写入文件
+        STATISTICS_STORED,                    // 写入数据库
+        STATISTICS_STORE_FAILED,              // 写入数据库失败
+        STATISTICS_DISPLAYED,                 // 添加到界面表格
+        STATISTICS_DISPLAY_DROPPED,           // 暂存区满或一次刷新超过表格行数，未显示，不影响保存
+        STATISTICS_COUNTER_MAX
+    };
+
+    // 某一时刻的统计快照
+    struct CaptureStatisticsInfo {
+        uint64_t pcapReceived{0};             // ps_recv 驱动收到的包
+        uint64_t pcapDropped{0};              // ps_drop 驱动缓冲区满丢弃
+        uint64_t pcapIfDropped{0};            // ps_ifdrop 网卡丢弃
+        uint64_t counter[STATISTICS_COUNTER_MAX]{};
+        uint64_t parseError[STATISTICS_ERROR_CODE_MAX]{};
+    };
+
+    // 统计类，计数器为原子变量，抓包线程、消费线程和界面线程可同时更新
+    class CaptureStatistics {
+    public:
+        // Delete copy constructor and assignment operator to ensure uniqueness of the capture statistics
+        CaptureStatistics(const CaptureStatistics&) = delete;
+        CaptureStatistics(CaptureStatistics&&) = delete;
+        CaptureStatistics& operator=(const CaptureStatistics&) = delete;
+        CaptureStatistics& operator=(CaptureStatistics&&) = delete;
+
+        // Retrieve an instance of the capture statistics(singleton pattern)
+        static CaptureStatistics& Instance() {
+            static CaptureStatistics obj;
+            return obj;
+        }
+
+        void count(STATISTICS_COUNTER counter, uint64_t value = 1);
+
+        // 按 PACKET_ERROR 错误码计数
+        void countError(uint8_t err);
+
+        // 保存 pcap_stats 的采样值
+        void setPcapStatistics(uint32_t received, uint32_t dropped, uint32_t ifDropped);
+
+        // 开始新的抓包时清零
+        void reset();
+
+        CaptureStatisticsInfo getStatistics() const;
+
+        // JSON 格式的统计数据，供外部工具解析
+        std::string dump() const;
+
+        bool dumpFile(const std::string& path) const;
+
+        static const char* getCounterName(uint8_t counter);
+
+    private:
+        std::atomic<uint64_t> pcapReceived;
+        std::atomic<uint64_t> pcapDropped;
+        std::atomic<uint64_t> pcapIfDropped;
+        std::atomic<uint64_t> counters[STATISTICS_COUNTER_MAX];
+        std::atomic<uint64_t> errors[STATISTICS_ERROR_CODE_MAX];
+
+        // Capture statistics constructor
+        CaptureStatistics();
+
+        // Capture statistics destructor
+        ~CaptureStatistics();
+    };
+
+}  // namespace figkey
+
+#endif // !FIGKEY_PCAP_STATS_HPP
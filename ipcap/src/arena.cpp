@@ -0,0 +1,137 @@
+﻿// arena.cpp: 捕获数据存储区
+//
+
+#include <cstring>
+#include <algorithm>
+#include "arena.h"
+#include "config.h"
+
+// 单个存储区的上限，环形缓冲区槽位很多时不再按槽位数放大
+#define ARENA_REGION_MAX (1024ULL * 1024 * 1024)
+
+namespace figkey {
+
+    static uint64_t roundArenaCapacity(uint64_t capacity) {
+        uint64_t size = 1024 * 1024;
+        while (size < capacity)
+            size <<= 1;
+        return size;
+    }
+
+    PacketArena::PacketArena()
+        : regionSize(0), mask(0), regionCount(0)
+    {
+    }
+
+    PacketArena::~PacketArena()
+    {
+    }
+
+    void PacketArena::clear(size_t sources)
+    {
+        sources = std::max<size_t>(1, std::min<size_t>(sources, CAPTURE_INTERFACE_MAX));
+
+        // 每个存储区至少容纳环形缓冲区全部槽位的以太网帧，ArenaSize 为所有网卡合计的下限；
+        // 更大的帧（网卡分段卸载）在空间不足时由调用方丢弃或等待
+        const auto& cfg = CaptureConfig::Instance().getConfigInfo();
+        uint64_t frameLength = std::min<uint64_t>(cfg.captureSnapLength, ETHERNET_MTU_MAX + sizeof(ethernet_header));
+        uint64_t capacity = std::max<uint64_t>(static_cast<uint64_t>(cfg.arenaSize) * 1024 * 1024 / sources,
+                                               static_cast<uint64_t>(cfg.ringSize) * frameLength);
+        regionSize = roundArenaCapacity(std::min<uint64_t>(capacity, ARENA_REGION_MAX));
+        mask = regionSize - 1;
+        regionCount = sources;
+
+        if (buffer.size() != regionSize * regionCount)
+            std::vector<uint8_t>(regionSize * regionCount).swap(buffer);
+
+        for (size_t i = 0; i < CAPTURE_INTERFACE_MAX; ++i) {
+            regions[i].data = (i < regionCount) ? buffer.data() + i * regionSize : nullptr;
+            regions[i].head = 0;
+            regions[i].tail = 0;
+        }
+    }
+
+    bool PacketArena::append(uint8_t source, const uint8_t* data, uint32_t length, uint64_t& offset)
+    {
+        if ((source >= regionCount) || (length > regionSize))
+            return false;
+
+        // 单生产者：只有本网卡的抓包线程修改 head，消费线程只推进 tail
+        auto& region = regions[source];
+        uint64_t head = region.head.load(std::memory_order_relaxed);
+        if (head + length - region.tail.load(std::memory_order_acquire) > regionSize)
+            return false;
+
+        // 先公开写入区间再拷贝，读取已释放数据的线程在拷贝后可以发现数据已被覆盖；
+        // 消费线程通过环形缓冲区拿到偏移量，那时拷贝已经完成
+        region.head.store(head + length, std::memory_order_seq_cst);
+
+        uint64_t pos = head & mask;
+        uint64_t first = std::min<uint64_t>(length, regionSize - pos);
+        memcpy(region.data + pos, data, first);
+        if (first < length)
+            memcpy(region.data, data + first, length - first);
+
+        offset = head;
+        return true;
+    }
+
+    void PacketArena::release(uint8_t source, uint64_t end)
+    {
+        if (source >= regionCount)
+            return;
+
+        // 同一网卡的数据按写入顺序释放，丢弃的数据由之后释放的位置一并覆盖
+        auto& region = regions[source];
+        uint64_t tail = region.tail.load(std::memory_order_relaxed);
+        if (end > tail)
+            region.tail.store(end, std::memory_order_release);
+    }
+
+    bool PacketArena::isValid(uint8_t source, uint64_t offset, uint32_t length) const
+    {
+        if (source >= regionCount)
+            return false;
+
+        uint64_t end = regions[source].head.load(std::memory_order_acquire);
+        if (offset + length > end)
+            return false;
+
+        return (end - offset) <= regionSize;
+    }
+
+    bool PacketArena::read(uint8_t source, uint64_t offset, uint32_t length, uint8_t* out) const
+    {
+        if (!isValid(source, offset, length))
+            return false;
+
+        const uint8_t* data = regions[source].data;
+        uint64_t pos = offset & mask;
+        uint64_t first = std::min<uint64_t>(length, regionSize - pos);
+        memcpy(out, data + pos, first);
+        if (first < length)
+            memcpy(out + first, data, length - first);
+
+        // 已释放的数据拷贝期间可能被写入线程覆盖，拷贝后再次确认
+        return isValid(source, offset, length);
+    }
+
+    bool PacketArena::read(uint8_t source, uint64_t offset, uint32_t length, std::vector<uint8_t>& out) const
+    {
+        out.resize(length);
+        if (0 == length)
+            return true;
+
+        if (!read(source, offset, length, out.data())) {
+            out.clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    size_t PacketArena::getCapacity() const
+    {
+        return regionSize;
+    }
+}
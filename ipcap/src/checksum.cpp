@@ -0,0 +1,107 @@
+﻿// checksum.cpp: 反码校验和
+//
+
+#include <cstring>
+#include "checksum.h"
+
+// x64 和开启 SSE2 的 x86 一次累加 16 字节
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define FIGKEY_CHECKSUM_SSE2
+#endif
+
+namespace figkey {
+
+#ifdef FIGKEY_CHECKSUM_SSE2
+    // 每次迭代每个 32 位通道增加 2 个 16 位字，16384 次迭代最多 32768 x 0xFFFF，合并前通道不会溢出
+    static const size_t ChecksumBlockIterations{ 16384 };
+
+    static uint64_t checksumAddSse2(const uint8_t* data, size_t blocks)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        uint64_t sum{ 0 };
+        while (blocks > 0) {
+            size_t count = (blocks < ChecksumBlockIterations) ? blocks : ChecksumBlockIterations;
+            blocks -= count;
+
+            // 两个累加器交替使用，相邻的加法互不依赖
+            __m128i acc0 = zero;
+            __m128i acc1 = zero;
+            for (size_t i = 0; i < count; ++i, data += 32) {
+                __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+                __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+                acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v0, zero));
+                acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v0, zero));
+                acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v1, zero));
+                acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v1, zero));
+            }
+
+            uint32_t lanes[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 4), acc1);
+            for (auto lane : lanes)
+                sum += lane;
+        }
+
+        return sum;
+    }
+#endif
+
+    uint64_t checksumAdd(const uint8_t* data, size_t length, uint64_t sum)
+    {
+#ifdef FIGKEY_CHECKSUM_SSE2
+        if (length >= 32) {
+            size_t blocks = length / 32;
+            sum += checksumAddSse2(data, blocks);
+            data += blocks * 32;
+            length -= blocks * 32;
+        }
+#endif
+
+        // 32 位字的和按 2^16 取模后与 16 位字的和相同
+        while (length >= 4) {
+            uint32_t word;
+            memcpy(&word, data, sizeof(word));
+            sum += word;
+            data += 4;
+            length -= 4;
+        }
+
+        if (length >= 2) {
+            uint16_t word;
+            memcpy(&word, data, sizeof(word));
+            sum += word;
+            data += 2;
+            length -= 2;
+        }
+
+        // 末尾的奇数字节是网络字节序的高字节，按内存位置补零
+        if (length > 0) {
+            uint16_t word{ 0 };
+            memcpy(&word, data, 1);
+            sum += word;
+        }
+
+        return sum;
+    }
+
+    uint16_t checksumFold(uint64_t sum)
+    {
+        while (sum >> 16)
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        return static_cast<uint16_t>(sum);
+    }
+
+    uint64_t checksumPseudoHeader(const PacketInfo& info, uint8_t protocol, uint32_t length)
+    {
+        // IPv4 的 0/协议/16 位长度与 IPv6 的 32 位长度/0/下一个头累加结果相同
+        const uint8_t tail[8] = { static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+                                  static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length),
+                                  0, 0, 0, protocol };
+        size_t ipLength = (4 == info.ipVersion) ? 4 : PACKET_IP_ADDRESS_LENGTH;
+        uint64_t sum = checksumAdd(info.srcIP, ipLength);
+        sum = checksumAdd(info.destIP, ipLength, sum);
+        return checksumAdd(tail, sizeof(tail), sum);
+    }
+
+}  // namespace figkey
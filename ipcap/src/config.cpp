@@ -8,6 +8,11 @@
 #include "def.h"
 
 namespace figkey {
+    CaptureConfig::CaptureConfig() : activeFilter(nullptr) {
+        std::lock_guard<std::mutex> lock(filterMutex);
+        replaceFilter(std::unique_ptr<PacketFilter>(new PacketFilter()));
+    }
+
     static bool LoadConfigFile(const std::string& path, std::map<std::string, std::string>& filter) {
         std::string line;
         std::ifstream file(path);
@@ -50,6 +55,32 @@ namespace figkey {
         return true;
     }
 
+    static void ApplyCaptureProfile(CaptureConfigInfo& info) {
+        switch (info.captureProfile)
+        {
+        case CAPTURE_PROFILE_LATENCY:
+            // 逐包上送，小缓冲区减少排队时间
+            info.captureBufferSize = 4;
+            info.captureImmediateMode = true;
+            info.captureTimeout = 1;
+            info.captureSnapLength = CAPTURE_SNAP_LENGTH;
+            break;
+        case CAPTURE_PROFILE_THROUGHPUT:
+            // 大缓冲区吸收突发流量，驱动攒批后一次上送
+            info.captureBufferSize = 256;
+            info.captureImmediateMode = false;
+            info.captureTimeout = 100;
+            info.captureSnapLength = CAPTURE_SNAP_LENGTH;
+            break;
+        default:
+            info.captureBufferSize = CAPTURE_BUFFER_SIZE;
+            info.captureImmediateMode = false;
+            info.captureTimeout = CAPTURE_TIMEOUT;
+            info.captureSnapLength = CAPTURE_SNAP_LENGTH;
+            break;
+        }
+    }
+
     bool CaptureConfig::loadConfigFile(const std::string& path){
         std::map<std::string, std::string> config;
         if (!LoadConfigFile(path, config))
@@ -132,6 +163,160 @@ namespace figkey {
             std::cout << "store packet information time : " << configInfo.timeSqlTransaction << std::endl;
         }
 
+        auto sqlBatchSize = config.find(CONFIG_SQL_BATCH_SIZE);
+        if ((sqlBatchSize != config.end()) && !sqlBatchSize->second.empty())
+        {
+            configInfo.sqlBatchSize = std::stoi(sqlBatchSize->second);
+            if (configInfo.sqlBatchSize < 1 || configInfo.sqlBatchSize > 50000)
+                configInfo.sqlBatchSize = 500;
+            std::cout << "store packet batch size : " << configInfo.sqlBatchSize << std::endl;
+        }
+
+        auto batchSize = config.find(CONFIG_BATCH_SIZE);
+        if ((batchSize != config.end()) && !batchSize->second.empty())
+        {
+            configInfo.batchSize = std::stoi(batchSize->second);
+            if (configInfo.batchSize < 1 || configInfo.batchSize > 4096)
+                configInfo.batchSize = 64;
+            std::cout << "packet batch size : " << configInfo.batchSize << std::endl;
+        }
+
+        auto batchTimeout = config.find(CONFIG_BATCH_TIMEOUT);
+        if ((batchTimeout != config.end()) && !batchTimeout->second.empty())
+        {
+            configInfo.batchTimeout = std::stoi(batchTimeout->second);
+            if (configInfo.batchTimeout < 1 || configInfo.batchTimeout > 5000)
+                configInfo.batchTimeout = 50;
+            std::cout << "packet batch timeout : " << configInfo.batchTimeout << std::endl;
+        }
+
+        auto ringSize = config.find(CONFIG_RING_SIZE);
+        if ((ringSize != config.end()) && !ringSize->second.empty())
+        {
+            configInfo.ringSize = std::stoi(ringSize->second);
+            if (configInfo.ringSize < 1024 || configInfo.ringSize > 1048576)
+                configInfo.ringSize = 65536;
+            std::cout << "packet ring size : " << configInfo.ringSize << std::endl;
+        }
+
+        auto arenaSize = config.find(CONFIG_ARENA_SIZE);
+        if ((arenaSize != config.end()) && !arenaSize->second.empty())
+        {
+            configInfo.arenaSize = std::stoi(arenaSize->second);
+            if (configInfo.arenaSize < 8 || configInfo.arenaSize > 1024)
+                configInfo.arenaSize = 64;
+            std::cout << "packet arena size(MB) : " << configInfo.arenaSize << std::endl;
+        }
+
+        // 先应用预设，再用单独配置的参数覆盖
+        auto captureProfile = config.find(CONFIG_CAPTURE_PROFILE);
+        if ((captureProfile != config.end()) && !captureProfile->second.empty())
+        {
+            if (captureProfile->second == "latency")
+                configInfo.captureProfile = CAPTURE_PROFILE_LATENCY;
+            else if (captureProfile->second == "throughput")
+                configInfo.captureProfile = CAPTURE_PROFILE_THROUGHPUT;
+            else
+                configInfo.captureProfile = CAPTURE_PROFILE_DEFAULT;
+            std::cout << "capture profile : " << captureProfile->second << std::endl;
+        }
+        ApplyCaptureProfile(configInfo);
+
+        auto bufferSize = config.find(CONFIG_CAPTURE_BUFFER_SIZE);
+        if ((bufferSize != config.end()) && !bufferSize->second.empty())
+        {
+            configInfo.captureBufferSize = std::stoi(bufferSize->second);
+            if (configInfo.captureBufferSize < 1 || configInfo.captureBufferSize > 1024)
+                configInfo.captureBufferSize = CAPTURE_BUFFER_SIZE;
+            std::cout << "capture buffer size(MB) : " << configInfo.captureBufferSize << std::endl;
+        }
+
+        auto immediateMode = config.find(CONFIG_CAPTURE_IMMEDIATE_MODE);
+        if ((immediateMode != config.end()) && !immediateMode->second.empty())
+        {
+            configInfo.captureImmediateMode = (immediateMode->second == "true");
+            std::cout << "capture immediate mode : " << configInfo.captureImmediateMode << std::endl;
+        }
+
+        auto captureTimeout = config.find(CONFIG_CAPTURE_TIMEOUT);
+        if ((captureTimeout != config.end()) && !captureTimeout->second.empty())
+        {
+            configInfo.captureTimeout = std::stoi(captureTimeout->second);
+            if (configInfo.captureTimeout < 1 || configInfo.captureTimeout > 10000)
+                configInfo.captureTimeout = CAPTURE_TIMEOUT;
+            std::cout << "capture timeout : " << configInfo.captureTimeout << std::endl;
+        }
+
+        auto snapLength = config.find(CONFIG_CAPTURE_SNAP_LENGTH);
+        if ((snapLength != config.end()) && !snapLength->second.empty())
+        {
+            configInfo.captureSnapLength = std::stoi(snapLength->second);
+            if (configInfo.captureSnapLength < CAPTURE_SNAP_LENGTH_MIN || configInfo.captureSnapLength > CAPTURE_SNAP_LENGTH_MAX)
+                configInfo.captureSnapLength = CAPTURE_SNAP_LENGTH;
+            std::cout << "capture snap length : " << configInfo.captureSnapLength << std::endl;
+        }
+
+        auto mergeLatency = config.find(CONFIG_MERGE_LATENCY);
+        if ((mergeLatency != config.end()) && !mergeLatency->second.empty())
+        {
+            configInfo.mergeLatency = std::stoi(mergeLatency->second);
+            if (configInfo.mergeLatency < 1 || configInfo.mergeLatency > 1000)
+                configInfo.mergeLatency = 20;
+            std::cout << "multi interface merge latency : " << configInfo.mergeLatency << std::endl;
+        }
+
+        auto pcapngExport = config.find(CONFIG_PCAPNG_EXPORT);
+        if ((pcapngExport != config.end()) && !pcapngExport->second.empty())
+        {
+            configInfo.pcapngExport = (pcapngExport->second == "true");
+            std::cout << "pcapng export : " << configInfo.pcapngExport << std::endl;
+        }
+
+        auto rollingFiles = config.find(CONFIG_ROLLING_FILES);
+        if ((rollingFiles != config.end()) && !rollingFiles->second.empty())
+        {
+            configInfo.rollingFiles = std::stoi(rollingFiles->second);
+            if (configInfo.rollingFiles > 10000)
+                configInfo.rollingFiles = 0;
+            std::cout << "rolling files : " << configInfo.rollingFiles << std::endl;
+        }
+
+        auto rollingFileSize = config.find(CONFIG_ROLLING_FILE_SIZE);
+        if ((rollingFileSize != config.end()) && !rollingFileSize->second.empty())
+        {
+            configInfo.rollingFileSize = std::stoi(rollingFileSize->second);
+            if (configInfo.rollingFileSize > 4096)
+                configInfo.rollingFileSize = 100;
+            std::cout << "rolling file size(MB) : " << configInfo.rollingFileSize << std::endl;
+        }
+
+        auto rollingFileDuration = config.find(CONFIG_ROLLING_FILE_DURATION);
+        if ((rollingFileDuration != config.end()) && !rollingFileDuration->second.empty())
+        {
+            configInfo.rollingFileDuration = std::stoi(rollingFileDuration->second);
+            if (configInfo.rollingFileDuration > 86400)
+                configInfo.rollingFileDuration = 3600;
+            std::cout << "rolling file duration(s) : " << configInfo.rollingFileDuration << std::endl;
+        }
+
+        auto validateHeaders = config.find(CONFIG_VALIDATE_HEADERS);
+        if ((validateHeaders != config.end()) && !validateHeaders->second.empty())
+        {
+            configInfo.validateHeaders = (validateHeaders->second == "true");
+            std::cout << "validate headers : " << configInfo.validateHeaders << std::endl;
+        }
+
+        auto checksumOffload = config.find(CONFIG_CHECKSUM_OFFLOAD);
+        if ((checksumOffload != config.end()) && !checksumOffload->second.empty())
+        {
+            configInfo.checksumOffload = (checksumOffload->second == "true");
+            std::cout << "checksum offload : " << configInfo.checksumOffload << std::endl;
+        }
+
+        // 两个上限都为 0 时文件不会切换，关闭滚动模式
+        if ((0 == configInfo.rollingFileSize) && (0 == configInfo.rollingFileDuration))
+            configInfo.rollingFiles = 0;
+
         auto filterProtocol = config.find(CONFIG_FILTER_PROTOCOL_NODE);
         if ((filterProtocol != config.end()) && !filterProtocol->second.empty())
         {
@@ -140,6 +325,7 @@ namespace figkey {
                 configInfo.filter.protocolType = PROTOCOL_TYPE_DEFAULT;
             std::cout << "Protocol filtering configuration information : " << static_cast<int>(configInfo.filter.protocolType) << std::endl;
         }
+        setFilter(configInfo.filter);
 
         return true;
     }
@@ -150,10 +336,54 @@ namespace figkey {
 
     void  CaptureConfig::setNetwork(const NetworkInfo& network) {
         configInfo.network = network;
+        configInfo.networks.assign(1, network);
+    }
+
+    void CaptureConfig::setPcapngFile(const std::string& path) {
+        configInfo.pcapngFile = path;
+    }
+
+    void CaptureConfig::setNetworks(const std::vector<NetworkInfo>& networks) {
+        if (networks.empty())
+            return;
+
+        configInfo.network = networks.front();
+        configInfo.networks = networks;
+        if (configInfo.networks.size() > CAPTURE_INTERFACE_MAX)
+            configInfo.networks.resize(CAPTURE_INTERFACE_MAX);
+    }
+
+    void CaptureConfig::replaceFilter(std::unique_ptr<PacketFilter> filter) {
+        activeFilter.store(filter.get(), std::memory_order_release);
+        filters.emplace_back(std::move(filter));
     }
 
     void CaptureConfig::setFilter(const FilterInfo& filter) {
+        std::lock_guard<std::mutex> lock(filterMutex);
         configInfo.filter = filter;
     }
 
+    const PacketFilter& CaptureConfig::getPacketFilter() const {
+        return *activeFilter.load(std::memory_order_acquire);
+    }
+
+    void CaptureConfig::publishFilter(bool isKernelFiltered, uint64_t kernelSince) {
+        // 每次更换过滤条件只发布一个对象，已发布的对象不再修改
+        std::lock_guard<std::mutex> lock(filterMutex);
+        std::unique_ptr<PacketFilter> filter(new PacketFilter(configInfo.filter));
+        filter->setKernelFiltered(isKernelFiltered, kernelSince);
+        replaceFilter(std::move(filter));
+        std::cout << "Packet filter published, kernel filtered : " << isKernelFiltered << std::endl;
+    }
+
+    void CaptureConfig::reclaimFilters() {
+        std::lock_guard<std::mutex> lock(filterMutex);
+        if (filters.size() <= 1)
+            return;
+
+        std::unique_ptr<PacketFilter> current = std::move(filters.back());
+        filters.clear();
+        filters.emplace_back(std::move(current));
+    }
+
 }
@@ -0,0 +1,262 @@
+﻿// dispatch.cpp: 抓包线程到界面处理的批量投递
+//
+
+#include <iostream>
+#include <chrono>
+#include "dispatch.h"
+#include "arena.h"
+#include "config.h"
+#include "stats.h"
+
+namespace figkey {
+
+    PacketDispatcher::PacketDispatcher():batchCallBack(nullptr), sourceCount(0), isBlocking(false), isRunning(false), dropped(0), highWater(0)
+    {
+    }
+
+    PacketDispatcher::~PacketDispatcher()
+    {
+        stop();
+    }
+
+    void PacketDispatcher::setCallback(PacketBatchCallback callback)
+    {
+        batchCallBack = callback;
+    }
+
+    bool PacketDispatcher::isEnabled() const
+    {
+        return static_cast<bool>(batchCallBack) && isRunning;
+    }
+
+    void PacketDispatcher::start(size_t sources, bool blocking)
+    {
+        if (isRunning)
+            return;
+
+        if (sources < 1)
+            sources = 1;
+
+        const auto& cfg = CaptureConfig::Instance().getConfigInfo();
+        if (rings.size() < sources)
+            rings.resize(sources);
+        for (size_t i = 0; i < sources; ++i) {
+            auto& ring = rings[i];
+            if (!ring || ring->capacity() < cfg.ringSize)
+                ring.reset(new opensource::ctrlfrmb::SpscRingBuffer<PacketInfo>(cfg.ringSize));
+            PacketInfo stale;
+            while (ring->pop(stale)) {}
+        }
+        sourceCount = sources;
+        isBlocking = blocking;
+        dropped = 0;
+        highWater = 0;
+
+        isRunning = true;
+        if (sourceCount > 1)
+            consumer = std::thread(&PacketDispatcher::consumeMerged, this);
+        else
+            consumer = std::thread(&PacketDispatcher::consume, this);
+    }
+
+    void PacketDispatcher::stop()
+    {
+        if (!isRunning)
+            return;
+
+        isRunning = false;
+        if (consumer.joinable())
+            consumer.join();
+
+        std::cout << "packet ring capacity " << getCapacity() << ", high water " << highWater
+                  << ", dropped " << dropped << std::endl;
+    }
+
+    void PacketDispatcher::push(PacketInfo&& info, const uint8_t* data)
+    {
+        if (info.interfaceId >= sourceCount) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            CaptureStatistics::Instance().count(STATISTICS_RING_DROPPED);
+            return;
+        }
+
+        // arena 和环形缓冲区一起构成抓包线程到消费线程的缓冲，任意一个满都按缓冲区满处理；
+        // 阻塞模式下同样等待消费线程释放 arena 空间，不覆盖也不丢弃
+        PacketArena& arena = PacketArena::Instance();
+        bool isAppended = arena.append(info.interfaceId, data, info.dataLength, info.dataOffset);
+        while (!isAppended && isBlocking && isRunning && (info.dataLength <= arena.getCapacity())) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            isAppended = arena.append(info.interfaceId, data, info.dataLength, info.dataOffset);
+        }
+        if (!isAppended) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            CaptureStatistics::Instance().count(STATISTICS_RING_DROPPED);
+            return;
+        }
+
+        auto& ring = rings[info.interfaceId];
+        bool isPushed = ring->push(std::move(info));
+        // 阻塞模式下等待消费线程腾出空间，push 失败时不会移动 info，可以重试
+        while (!isPushed && isBlocking && isRunning) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            isPushed = ring->push(std::move(info));
+        }
+        if (!isPushed) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            CaptureStatistics::Instance().count(STATISTICS_RING_DROPPED);
+            return;
+        }
+        CaptureStatistics::Instance().count(STATISTICS_ENQUEUED);
+
+        auto size = ring->size();
+        if (size > highWater.load(std::memory_order_relaxed))
+            highWater.store(size, std::memory_order_relaxed);
+    }
+
+    void PacketDispatcher::deliver(std::vector<PacketInfo>&& batch)
+    {
+        // 同一网卡的数据包按写入 arena 的顺序出队，释放到每个网卡最后一个包的末尾
+        uint64_t ends[CAPTURE_INTERFACE_MAX]{};
+        for (const auto& info : batch) {
+            if (info.interfaceId < CAPTURE_INTERFACE_MAX)
+                ends[info.interfaceId] = info.dataOffset + info.dataLength;
+        }
+
+        if (batchCallBack)
+            batchCallBack(std::move(batch));
+
+        PacketArena& arena = PacketArena::Instance();
+        for (size_t i = 0; (i < sourceCount) && (i < CAPTURE_INTERFACE_MAX); ++i) {
+            if (ends[i] > 0)
+                arena.release(static_cast<uint8_t>(i), ends[i]);
+        }
+    }
+
+    uint64_t PacketDispatcher::getDropped() const
+    {
+        return dropped;
+    }
+
+    size_t PacketDispatcher::getHighWater() const
+    {
+        return highWater;
+    }
+
+    size_t PacketDispatcher::getCapacity() const
+    {
+        return rings.empty() ? 0 : rings.front()->capacity() * sourceCount;
+    }
+
+    void PacketDispatcher::consume()
+    {
+        auto& ring = rings.front();
+        const auto& cfg = CaptureConfig::Instance().getConfigInfo();
+        const auto timeout = std::chrono::milliseconds(cfg.batchTimeout);
+        std::vector<PacketInfo> batch;
+        auto batchStart = std::chrono::steady_clock::now();
+
+        // 停止后继续取完缓冲区中剩余的数据
+        bool running{ true };
+        while (running || !ring->empty()) {
+            running = isRunning;
+
+            PacketInfo info;
+            bool popped{ false };
+            while ((batch.size() < cfg.batchSize) && ring->pop(info)) {
+                if (batch.empty()) {
+                    batch.reserve(cfg.batchSize);
+                    batchStart = std::chrono::steady_clock::now();
+                }
+                batch.emplace_back(std::move(info));
+                popped = true;
+            }
+
+            bool isFull = (batch.size() >= cfg.batchSize);
+            bool isExpired = !batch.empty() && ((std::chrono::steady_clock::now() - batchStart) >= timeout);
+            if (isFull || isExpired || (!running && !batch.empty())) {
+                deliver(std::move(batch));
+                batch = std::vector<PacketInfo>();
+                continue;
+            }
+
+            // 缓冲区为空时短暂休眠，避免空转占用 CPU
+            if (!popped)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void PacketDispatcher::consumeMerged()
+    {
+        const auto& cfg = CaptureConfig::Instance().getConfigInfo();
+        const auto timeout = std::chrono::milliseconds(cfg.batchTimeout);
+        const auto latency = std::chrono::milliseconds(cfg.mergeLatency);
+        std::vector<PacketInfo> batch;
+        auto batchStart = std::chrono::steady_clock::now();
+
+        // 每个网卡取出一个待合并的包，没有队首的网卡记录开始空闲的时间
+        std::vector<PacketInfo> heads(sourceCount);
+        std::vector<bool> hasHead(sourceCount, false);
+        std::vector<std::chrono::steady_clock::time_point> idleSince(sourceCount, batchStart);
+
+        auto isEmpty = [&]() {
+            for (size_t i = 0; i < sourceCount; ++i) {
+                if (hasHead[i] || !rings[i]->empty())
+                    return false;
+            }
+            return true;
+        };
+
+        bool running{ true };
+        while (running || !isEmpty()) {
+            running = isRunning;
+            auto now = std::chrono::steady_clock::now();
+
+            // 单个网卡内时间戳有序，所有网卡都有队首时最小的一个可以安全输出；
+            // 否则只在没有队首的网卡都已空闲超过 mergeLatency 时输出，
+            // 等待按空闲网卡计算，忙碌网卡的后续队首不再重新等待
+            bool popped{ false };
+            while (batch.size() < cfg.batchSize) {
+                size_t next = sourceCount;
+                bool isIdle{ true };
+                for (size_t i = 0; i < sourceCount; ++i) {
+                    if (!hasHead[i]) {
+                        hasHead[i] = rings[i]->pop(heads[i]);
+                        if (!hasHead[i]) {
+                            isIdle = isIdle && ((now - idleSince[i]) >= latency);
+                            continue;
+                        }
+                    }
+                    if ((next == sourceCount) || (heads[i].timestamp < heads[next].timestamp))
+                        next = i;
+                }
+
+                if ((next == sourceCount) || (!isIdle && running))
+                    break;
+
+                if (batch.empty()) {
+                    batch.reserve(cfg.batchSize);
+                    batchStart = now;
+                }
+                batch.emplace_back(std::move(heads[next]));
+                popped = true;
+
+                // 补充该网卡的队首，取不到时从现在开始计算空闲时间
+                if (!rings[next]->pop(heads[next])) {
+                    hasHead[next] = false;
+                    idleSince[next] = now;
+                }
+            }
+
+            bool isFull = (batch.size() >= cfg.batchSize);
+            bool isExpired = !batch.empty() && ((std::chrono::steady_clock::now() - batchStart) >= timeout);
+            if (isFull || isExpired || (!running && !batch.empty())) {
+                deliver(std::move(batch));
+                batch = std::vector<PacketInfo>();
+                continue;
+            }
+
+            if (!popped)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
@@ -0,0 +1,199 @@
+﻿// filter.cpp: 用户过滤条件的编译与匹配
+//
+
+#include <cstring>
+#include "filter.h"
+#include "packet.h"
+
+namespace figkey {
+
+    // 地址无法解析时版本为 0，不会匹配任何数据包
+    static bool compileIpAddress(const std::string& text, uint8_t* ip, uint8_t& version) {
+        if (text.empty())
+            return false;
+
+        parseIpAddress(text, ip, version);
+        return true;
+    }
+
+    static bool compileMacAddress(const std::string& text, uint8_t* mac) {
+        if (text.empty())
+            return false;
+
+        // 无法解析时使用全 0 地址，与原来的字符串比较一样不会匹配
+        if (!parseMacAddress(text, mac))
+            memset(mac, 0, PACKET_MAC_ADDRESS_LENGTH);
+        return true;
+    }
+
+    static inline bool matchIpAddress(const uint8_t* filterIp, uint8_t filterVersion, const uint8_t* ip, uint8_t version) {
+        if (filterVersion != version)
+            return false;
+
+        return 0 == memcmp(filterIp, ip, (4 == version) ? 4 : PACKET_IP_ADDRESS_LENGTH);
+    }
+
+    PacketFilter::PacketFilter(const FilterInfo& filter)
+        : protocolType(filter.protocolType),
+          port(filter.port),
+          srcPort(filter.srcPort),
+          destPort(filter.destPort),
+          minLen(filter.minLen),
+          maxLen(filter.maxLen)
+    {
+        hasIP = compileIpAddress(filter.ip, ip, ipVersion);
+        if (!hasIP) {
+            hasSrcIP = compileIpAddress(filter.srcIP, srcIP, srcIPVersion);
+            hasDestIP = compileIpAddress(filter.destIP, destIP, destIPVersion);
+        }
+        hasSrcMAC = compileMacAddress(filter.srcMAC, srcMAC);
+        hasDestMAC = compileMacAddress(filter.destMAC, destMAC);
+        if (0 != port) {
+            srcPort = 0;
+            destPort = 0;
+        }
+    }
+
+    void PacketFilter::setKernelFiltered(bool flag, uint64_t since) {
+        kernelFiltered = flag;
+        kernelSince = since;
+    }
+
+    bool PacketFilter::isKernelFiltered() const {
+        return kernelFiltered;
+    }
+
+    bool PacketFilter::hasPortFilter() const {
+        return (0 != port) || (0 != srcPort) || (0 != destPort);
+    }
+
+    bool PacketFilter::matchHeader(const PacketInfo& info, bool isFragment) const {
+        bool kernelFiltered = this->kernelFiltered && (info.timestamp >= kernelSince);
+        if (kernelFiltered) {
+            // 地址和端口已由驱动过滤
+        }
+        else if (hasIP) {
+            if (!matchIpAddress(ip, ipVersion, info.srcIP, info.ipVersion)
+                && !matchIpAddress(ip, ipVersion, info.destIP, info.ipVersion)) return false;
+        }
+        else {
+            if (hasSrcIP && !matchIpAddress(srcIP, srcIPVersion, info.srcIP, info.ipVersion)) return false;
+            if (hasDestIP && !matchIpAddress(destIP, destIPVersion, info.destIP, info.ipVersion)) return false;
+        }
+        if (!kernelFiltered) {
+            if (hasSrcMAC && (0 != memcmp(srcMAC, info.srcMAC, PACKET_MAC_ADDRESS_LENGTH))) return false;
+            if (hasDestMAC && (0 != memcmp(destMAC, info.destMAC, PACKET_MAC_ADDRESS_LENGTH))) return false;
+        }
+        if (!kernelFiltered || isFragment) {
+            if (0 != port) {
+                if (port != info.srcPort && port != info.destPort) return false;
+            }
+            else {
+                if (srcPort != 0 && srcPort != info.srcPort) return false;
+                if (destPort != 0 && destPort != info.destPort) return false;
+            }
+        }
+
+        // 当滤波器的 minLen 不为零时做最小长度过滤
+        if (minLen != 0) {
+            if (info.payloadLength < minLen) return false;
+        }
+        // 当滤波器的 maxLen 不为零时做最大长度过滤
+        if (maxLen != 0) {
+            if (info.payloadLength > maxLen) return false;
+        }
+
+        return true;
+    }
+
+    bool PacketFilter::matchProtocol(uint8_t protocol) const {
+        if (PROTOCOL_TYPE_DEFAULT == protocolType)
+            return true;
+
+        if (protocol == protocolType)
+            return true;
+
+        if ((PROTOCOL_TYPE_DOIP == protocolType) && (protocol >= protocolType))
+            return true;
+        return false;
+    }
+
+    static void appendCondition(std::string& expression, const std::string& condition) {
+        expression += " and ";
+        expression += condition;
+    }
+
+    static std::string formatFilterIp(const std::string& text) {
+        uint8_t ip[PACKET_IP_ADDRESS_LENGTH];
+        uint8_t version{ 0 };
+        if (!parseIpAddress(text, ip, version))
+            return std::string();
+
+        return formatIpAddress(ip, version);
+    }
+
+    static std::string formatFilterMac(const std::string& text) {
+        uint8_t mac[PACKET_MAC_ADDRESS_LENGTH];
+        if (!parseMacAddress(text, mac))
+            return std::string();
+
+        return formatMacAddress(mac);
+    }
+
+    std::string buildCaptureFilter(const FilterInfo& filter, const std::string& captureFilter) {
+        std::string expression = "(" + captureFilter + ")";
+
+        // 地址先规范化，用户输入无法解析时返回空字符串，由调用方退回到用户态过滤
+        if (!filter.ip.empty()) {
+            auto ip = formatFilterIp(filter.ip);
+            if (ip.empty())
+                return std::string();
+            appendCondition(expression, "host " + ip);
+        }
+        else {
+            if (!filter.srcIP.empty()) {
+                auto ip = formatFilterIp(filter.srcIP);
+                if (ip.empty())
+                    return std::string();
+                appendCondition(expression, "src host " + ip);
+            }
+            if (!filter.destIP.empty()) {
+                auto ip = formatFilterIp(filter.destIP);
+                if (ip.empty())
+                    return std::string();
+                appendCondition(expression, "dst host " + ip);
+            }
+        }
+
+        if (!filter.srcMAC.empty()) {
+            auto mac = formatFilterMac(filter.srcMAC);
+            if (mac.empty())
+                return std::string();
+            appendCondition(expression, "ether src " + mac);
+        }
+        if (!filter.destMAC.empty()) {
+            auto mac = formatFilterMac(filter.destMAC);
+            if (mac.empty())
+                return std::string();
+            appendCondition(expression, "ether dst " + mac);
+        }
+
+        std::string port;
+        if (0 != filter.port) {
+            port = "port " + std::to_string(filter.port);
+        }
+        else {
+            if (0 != filter.srcPort)
+                port = "src port " + std::to_string(filter.srcPort);
+            if (0 != filter.destPort)
+                port += (port.empty() ? "" : " and ") + std::string("dst port ") + std::to_string(filter.destPort);
+        }
+
+        // 端口只在第一个分片中，其余分片也要交给分片重组，否则数据报永远收不齐；
+        // 放行的分片在用户态按第一个分片中的端口过滤后才保存
+        if (!port.empty())
+            appendCondition(expression, "((" + port + ") or (ip[6:2] & 0x1fff != 0))");
+
+        return expression;
+    }
+}
@@ -0,0 +1,471 @@
+﻿// flow.cpp: 连接键和连接表
+//
+
+#include <WinSock2.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "flow.h"
+#include "packet.h"
+
+namespace figkey {
+
+    bool FlowKey::operator==(const FlowKey& other) const
+    {
+        return (ipVersion == other.ipVersion) && (protocol == other.protocol)
+               && (portA == other.portA) && (portB == other.portB)
+               && (memcmp(ipA, other.ipA, PACKET_IP_ADDRESS_LENGTH) == 0)
+               && (memcmp(ipB, other.ipB, PACKET_IP_ADDRESS_LENGTH) == 0);
+    }
+
+    size_t FlowKeyHash::operator()(const FlowKey& key) const
+    {
+        // FNV-1a，键为定长结构，逐字节计算
+        uint64_t hash = 14695981039346656037ULL;
+        auto mix = [&hash](const uint8_t* data, size_t length) {
+            for (size_t i = 0; i < length; ++i) {
+                hash ^= data[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+
+        mix(&key.ipVersion, 1);
+        mix(&key.protocol, 1);
+        mix(reinterpret_cast<const uint8_t*>(&key.portA), sizeof(key.portA));
+        mix(reinterpret_cast<const uint8_t*>(&key.portB), sizeof(key.portB));
+        size_t ipLength = (4 == key.ipVersion) ? 4 : PACKET_IP_ADDRESS_LENGTH;
+        mix(key.ipA, ipLength);
+        mix(key.ipB, ipLength);
+
+        // FNV-1a 的低位只取决于输入字节的低位，分片和初始槽位都取低位，返回前把高位混合进来
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 33;
+        return static_cast<size_t>(hash);
+    }
+
+    FlowKey makeFlowKey(const PacketInfo& info, bool& isReverse)
+    {
+        int order = memcmp(info.srcIP, info.destIP, PACKET_IP_ADDRESS_LENGTH);
+        isReverse = (order > 0) || ((order == 0) && (info.srcPort > info.destPort));
+
+        FlowKey key;
+        key.ipVersion = info.ipVersion;
+        key.protocol = info.protocolType;
+        if (isReverse) {
+            memcpy(key.ipA, info.destIP, PACKET_IP_ADDRESS_LENGTH);
+            memcpy(key.ipB, info.srcIP, PACKET_IP_ADDRESS_LENGTH);
+            key.portA = info.destPort;
+            key.portB = info.srcPort;
+        }
+        else {
+            memcpy(key.ipA, info.srcIP, PACKET_IP_ADDRESS_LENGTH);
+            memcpy(key.ipB, info.destIP, PACKET_IP_ADDRESS_LENGTH);
+            key.portA = info.srcPort;
+            key.portB = info.destPort;
+        }
+        return key;
+    }
+
+    static const uint64_t FlowIdleTimeout{ static_cast<uint64_t>(FLOW_TABLE_IDLE_TIMEOUT) * 1000000000ULL };
+    static const uint64_t FlowClosedTimeout{ static_cast<uint64_t>(FLOW_TABLE_CLOSED_TIMEOUT) * 1000000000ULL };
+    static const uint64_t FlowSweepInterval{ 1000000000ULL };
+
+    // 序号按 2^32 回绕比较
+    static int32_t compareSeq(uint32_t a, uint32_t b)
+    {
+        return static_cast<int32_t>(a - b);
+    }
+
+    // 低位选分片，其余位选槽位；保存的哈希值只改了最低位，可以还原出初始槽位
+    static size_t getHomeSlot(size_t hash)
+    {
+        return (hash / FLOW_TABLE_SHARDS) & (FLOW_TABLE_SHARD_SLOTS - 1);
+    }
+
+    FlowTable::FlowTable()
+    {
+        for (auto& shard : shards) {
+            shard.hashes.assign(FLOW_TABLE_SHARD_SLOTS, 0);
+            shard.entries.resize(FLOW_TABLE_SHARD_SLOTS);
+        }
+    }
+
+    FlowTable::~FlowTable()
+    {
+    }
+
+    void FlowTable::clear()
+    {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            std::fill(shard.hashes.begin(), shard.hashes.end(), 0);
+            shard.size = 0;
+            shard.lastSweep = 0;
+        }
+        {
+            std::lock_guard<std::mutex> lock(closedMutex);
+            closedFlows.clear();
+        }
+        nextId.store(1);
+        untracked.store(0);
+    }
+
+    size_t FlowTable::findSlot(const Shard& shard, const FlowKey& key, size_t hash) const
+    {
+        // 哈希值置最低位避免与空槽位的 0 冲突
+        uint32_t tag = static_cast<uint32_t>(hash) | 1u;
+        size_t slot = getHomeSlot(hash);
+        while (0 != shard.hashes[slot]) {
+            if ((tag == shard.hashes[slot]) && (shard.entries[slot].info.key == key))
+                break;
+            slot = (slot + 1) & (FLOW_TABLE_SHARD_SLOTS - 1);
+        }
+        return slot;
+    }
+
+    void FlowTable::erase(Shard& shard, size_t slot)
+    {
+        {
+            std::lock_guard<std::mutex> lock(closedMutex);
+            closedFlows.push_back(shard.entries[slot].info);
+            if (closedFlows.size() > FLOW_TABLE_CLOSED_FLOWS)
+                closedFlows.pop_front();
+        }
+
+        // 后面的连接的初始槽位不在空位和它之间时前移填补空位，保证探测链不断开
+        const size_t mask = FLOW_TABLE_SHARD_SLOTS - 1;
+        size_t hole = slot;
+        size_t next = (hole + 1) & mask;
+        while (0 != shard.hashes[next]) {
+            size_t home = getHomeSlot(shard.hashes[next]);
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                shard.hashes[hole] = shard.hashes[next];
+                shard.entries[hole] = shard.entries[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+
+        shard.hashes[hole] = 0;
+        --shard.size;
+    }
+
+    void FlowTable::sweep(Shard& shard, uint64_t now)
+    {
+        shard.lastSweep = now;
+        size_t slot = 0;
+        while (slot < FLOW_TABLE_SHARD_SLOTS) {
+            if (0 != shard.hashes[slot]) {
+                const FlowInfo& info = shard.entries[slot].info;
+                bool isClosed = (FLOW_STATE_CLOSED == info.state) || (FLOW_STATE_RESET == info.state);
+                if (info.lastTimestamp + (isClosed ? FlowClosedTimeout : FlowIdleTimeout) < now) {
+                    // 后面的连接可能前移到当前槽位，重新检查
+                    erase(shard, slot);
+                    continue;
+                }
+            }
+            ++slot;
+        }
+    }
+
+    uint32_t FlowTable::update(const FlowKey& key, bool isReverse, const uint8_t* packet, PacketInfo& info, uint32_t length)
+    {
+        size_t hash = FlowKeyHash()(key);
+        Shard& shard = shards[hash % FLOW_TABLE_SHARDS];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (info.timestamp > shard.lastSweep + FlowSweepInterval)
+            sweep(shard, info.timestamp);
+
+        size_t slot = findSlot(shard, key, hash);
+        if ((0 != shard.hashes[slot]) && (PROTOCOL_TYPE_TCP == key.protocol) && isNewConnection(shard.entries[slot], packet, info)) {
+            // 端口复用的新连接不继承旧连接的序号跟踪，否则新的 SYN 和对端窗口会被误判为异常
+            erase(shard, slot);
+            slot = findSlot(shard, key, hash);
+        }
+
+        FlowEntry& entry = shard.entries[slot];
+        if (0 == shard.hashes[slot]) {
+            if (shard.size >= FLOW_TABLE_SHARD_FLOWS) {
+                untracked.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+
+            shard.hashes[slot] = static_cast<uint32_t>(hash) | 1u;
+            ++shard.size;
+            entry = FlowEntry();
+            entry.info.id = nextId.fetch_add(1, std::memory_order_relaxed);
+            entry.info.key = key;
+            entry.info.firstTimestamp = info.timestamp;
+        }
+
+        // 多网卡的数据包不保证按时间到达
+        int direction = isReverse ? 1 : 0;
+        entry.info.packets[direction]++;
+        entry.info.bytes[direction] += length;
+        entry.info.firstTimestamp = (std::min)(entry.info.firstTimestamp, info.timestamp);
+        entry.info.lastTimestamp = (std::max)(entry.info.lastTimestamp, info.timestamp);
+        if (PROTOCOL_TYPE_TCP == key.protocol)
+            updateTcp(entry, direction, packet, info);
+
+        return entry.info.id;
+    }
+
+    bool FlowTable::isNewConnection(const FlowEntry& entry, const uint8_t* packet, const PacketInfo& info)
+    {
+        if ((FLOW_STATE_CLOSED != entry.info.state) && (FLOW_STATE_RESET != entry.info.state))
+            return false;
+
+        const tcp_header* tcph = reinterpret_cast<const tcp_header*>(packet + info.transportOffset);
+        return (TCP_FLAG_SYN == (tcph->th_flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)));
+    }
+
+    // SYN 中的窗口扩大选项，选项范围为 TCP 固定头之后到负载之前
+    static void parseWindowScale(const uint8_t* packet, const PacketInfo& info, uint8_t& windowShift, bool& hasWindowScale)
+    {
+        windowShift = 0;
+        hasWindowScale = false;
+
+        const uint8_t* option = packet + info.transportOffset + sizeof(tcp_header);
+        const uint8_t* end = packet + info.payloadOffset;
+        while (option < end) {
+            if (0 == option[0])
+                break;
+            if (1 == option[0]) {
+                ++option;
+                continue;
+            }
+            if ((option + 1 >= end) || (option[1] < 2) || (option + option[1] > end))
+                break;
+            if ((3 == option[0]) && (3 == option[1])) {
+                windowShift = (std::min)(option[2], static_cast<uint8_t>(14));
+                hasWindowScale = true;
+            }
+            option += option[1];
+        }
+    }
+
+    void FlowTable::updateTcp(FlowEntry& entry, int direction, const uint8_t* packet, PacketInfo& info)
+    {
+        const tcp_header* tcph = reinterpret_cast<const tcp_header*>(packet + info.transportOffset);
+        uint32_t seq = ntohl(tcph->th_seq);
+        uint32_t ack = ntohl(tcph->th_ack);
+        uint32_t window = ntohs(tcph->th_win);
+        uint8_t flags = tcph->th_flags;
+        uint8_t& state = entry.info.state;
+
+        if (flags & TCP_FLAG_RST) {
+            state = FLOW_STATE_RESET;
+        }
+        else if (flags & TCP_FLAG_SYN) {
+            if (0 == (flags & TCP_FLAG_ACK)) {
+                state = FLOW_STATE_SYN_SENT;
+                entry.synTimestamp = info.timestamp;
+                entry.finMask = 0;
+            }
+            else if (FLOW_STATE_SYN_SENT == state) {
+                state = FLOW_STATE_SYN_RECEIVED;
+            }
+        }
+        else if (flags & TCP_FLAG_FIN) {
+            entry.finMask |= static_cast<uint8_t>(1 << direction);
+            state = (3 == entry.finMask) ? FLOW_STATE_CLOSED : FLOW_STATE_CLOSING;
+        }
+        else if (state < FLOW_STATE_ESTABLISHED) {
+            // 握手的最后一个 ACK，或抓包开始时已建立的连接
+            if ((FLOW_STATE_SYN_RECEIVED == state) && (info.timestamp > entry.synTimestamp))
+                entry.info.handshakeRtt = info.timestamp - entry.synTimestamp;
+            state = FLOW_STATE_ESTABLISHED;
+        }
+
+        TcpTracker& sender = entry.trackers[direction];
+        TcpTracker& receiver = entry.trackers[direction ^ 1];
+        if (flags & TCP_FLAG_SYN)
+            parseWindowScale(packet, info, sender.windowShift, sender.hasWindowScale);
+
+        // SYN 和 FIN 各占一个序号
+        uint32_t segmentLength = info.payloadLength;
+        if (flags & TCP_FLAG_SYN)
+            ++segmentLength;
+        if (flags & TCP_FLAG_FIN)
+            ++segmentLength;
+
+        // 只保留解析阶段的错误，TCP 异常不覆盖
+        uint8_t err = trackTcp(entry, direction, seq, ack, flags, window, segmentLength, info.timestamp);
+        if (PACKET_NO_ERROR == info.err)
+            info.err = err;
+
+        // 对端确认了正在测量的数据段
+        if ((flags & TCP_FLAG_ACK) && (0 != receiver.sampleTimestamp)
+            && (compareSeq(ack, receiver.sampleSeq) >= 0)) {
+            if (info.timestamp > receiver.sampleTimestamp) {
+                uint64_t sample = info.timestamp - receiver.sampleTimestamp;
+                uint64_t& srtt = entry.info.smoothedRtt;
+                srtt = (0 == srtt) ? sample : srtt - srtt / 8 + sample / 8;
+            }
+            receiver.sampleTimestamp = 0;
+        }
+
+        if (0 == segmentLength)
+            return;
+
+        uint32_t end = seq + segmentLength;
+        if ((PACKET_TCP_RETRANSMISSION == err) || (PACKET_TCP_OUT_OF_ORDER == err)) {
+            // 测量中的数据段可能被重传，确认时间不再可信，放弃本次测量
+            sender.sampleTimestamp = 0;
+        }
+        else if (0 == sender.sampleTimestamp) {
+            sender.sampleSeq = end;
+            sender.sampleTimestamp = info.timestamp;
+        }
+    }
+
+    uint8_t FlowTable::trackTcp(FlowEntry& entry, int direction, uint32_t seq, uint32_t ack, uint8_t flags,
+                                uint32_t window, uint32_t segmentLength, uint64_t timestamp)
+    {
+        TcpTracker& sender = entry.trackers[direction];
+        TcpTracker& receiver = entry.trackers[direction ^ 1];
+        uint8_t err{ PACKET_NO_ERROR };
+        uint32_t end = seq + segmentLength;
+        bool isControl = (0 != (flags & (TCP_FLAG_SYN | TCP_FLAG_FIN | TCP_FLAG_RST)));
+
+        // 新连接的 SYN 重新开始跟踪，重发的 SYN 按重传检测
+        if ((flags & TCP_FLAG_SYN) && !(sender.isSynced && (end == sender.nextSeq))) {
+            sender.isSynced = false;
+            sender.hasAck = false;
+            sender.sampleTimestamp = 0;
+        }
+
+        if (!sender.isSynced) {
+            // 抓包开始时已建立的连接从第一个分段开始跟踪
+            sender.isSynced = true;
+            sender.nextSeq = end;
+            sender.advanceTimestamp = timestamp;
+        }
+        else if (segmentLength > 0) {
+            int32_t offset = compareSeq(seq, sender.nextSeq);
+            bool isKeepAlive = !isControl && (segmentLength <= 1) && (seq + 1 == sender.nextSeq);
+            if (offset > 0) {
+                // 期望的分段没有被捕获
+                err = PACKET_TCP_LOST_SEGMENT;
+            }
+            else if ((offset < 0) && !isKeepAlive) {
+                // 在一个往返时间内补上缺口的分段为乱序，否则为重传
+                uint64_t rtt = entry.info.smoothedRtt;
+                if (0 == rtt)
+                    rtt = entry.info.handshakeRtt;
+                if (0 == rtt)
+                    rtt = TCP_ANALYSIS_DEFAULT_RTT;
+                bool isRecent = (timestamp >= sender.advanceTimestamp) && (timestamp - sender.advanceTimestamp < rtt);
+                err = isRecent ? PACKET_TCP_OUT_OF_ORDER : PACKET_TCP_RETRANSMISSION;
+            }
+
+            // 分段正好用完对端通告的接收窗口
+            if ((PACKET_NO_ERROR == err) && !isControl && receiver.hasAck && (receiver.window > 0)
+                && (end == receiver.lastAck + receiver.window))
+                err = PACKET_TCP_WINDOW_FULL;
+
+            if (compareSeq(end, sender.nextSeq) > 0) {
+                sender.nextSeq = end;
+                sender.advanceTimestamp = timestamp;
+            }
+        }
+
+        // 双方的 SYN 都带窗口扩大选项时才换算，SYN 中的窗口不换算
+        uint32_t scaledWindow = window;
+        if (!(flags & TCP_FLAG_SYN) && sender.hasWindowScale && receiver.hasWindowScale)
+            scaledWindow <<= sender.windowShift;
+
+        if ((PACKET_NO_ERROR == err) && (0 == window) && !isControl)
+            err = PACKET_TCP_ZERO_WINDOW;
+
+        if (flags & TCP_FLAG_ACK) {
+            // 不带数据、确认号和窗口都没有变化的 ACK
+            if ((PACKET_NO_ERROR == err) && sender.hasAck && (0 == segmentLength) && !isControl
+                && (seq == sender.nextSeq) && (ack == sender.lastAck) && (scaledWindow == sender.window))
+                err = PACKET_TCP_DUPLICATE_ACK;
+
+            sender.hasAck = true;
+            sender.lastAck = ack;
+            sender.window = scaledWindow;
+        }
+
+        return err;
+    }
+
+    std::vector<FlowInfo> FlowTable::getFlows() const
+    {
+        std::vector<FlowInfo> flows;
+        for (const auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (size_t i = 0; i < FLOW_TABLE_SHARD_SLOTS; ++i) {
+                if (0 != shard.hashes[i])
+                    flows.push_back(shard.entries[i].info);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(closedMutex);
+            flows.insert(flows.end(), closedFlows.begin(), closedFlows.end());
+        }
+
+        std::sort(flows.begin(), flows.end(), [](const FlowInfo& a, const FlowInfo& b) {
+            return a.id < b.id;
+        });
+        return flows;
+    }
+
+    const char* FlowTable::getStateName(uint8_t state)
+    {
+        switch (state) {
+        case FLOW_STATE_ACTIVE: return "Active";
+        case FLOW_STATE_SYN_SENT: return "SynSent";
+        case FLOW_STATE_SYN_RECEIVED: return "SynReceived";
+        case FLOW_STATE_ESTABLISHED: return "Established";
+        case FLOW_STATE_CLOSING: return "Closing";
+        case FLOW_STATE_CLOSED: return "Closed";
+        case FLOW_STATE_RESET: return "Reset";
+        default: break;
+        }
+
+        return "Unknown";
+    }
+
+    std::string FlowTable::dump() const
+    {
+        std::ostringstream out;
+        out << "Id,Protocol,Address A,Port A,Address B,Port B,Packets A->B,Bytes A->B,Packets B->A,Bytes B->A,"
+            << "Start,Duration(s),Handshake RTT(ms),RTT(ms),State\n";
+
+        out << std::fixed;
+        for (const auto& flow : getFlows()) {
+            const FlowKey& key = flow.key;
+            out << flow.id << ","
+                << ((PROTOCOL_TYPE_TCP == key.protocol) ? "TCP" : "UDP") << ","
+                << formatIpAddress(key.ipA, key.ipVersion) << "," << key.portA << ","
+                << formatIpAddress(key.ipB, key.ipVersion) << "," << key.portB << ","
+                << flow.packets[0] << "," << flow.bytes[0] << ","
+                << flow.packets[1] << "," << flow.bytes[1] << ","
+                << formatPacketTimestamp(flow.firstTimestamp) << ","
+                << std::setprecision(6) << (flow.lastTimestamp - flow.firstTimestamp) / 1e9 << ","
+                << std::setprecision(3) << flow.handshakeRtt / 1e6 << ","
+                << flow.smoothedRtt / 1e6 << ","
+                << getStateName(flow.state) << "\n";
+        }
+
+        return out.str();
+    }
+
+    bool FlowTable::dumpFile(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+
+        file << dump();
+        return file.good();
+    }
+
+}  // namespace figkey
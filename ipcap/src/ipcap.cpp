@@ -1,6 +1,7 @@
 ﻿// ipcap.cpp: 定义应用程序的入口点。
 //
 #include <iostream>
+#include <chrono>
 #ifdef _WIN32
 #ifdef _WIN32_WINNT
 #undef _WIN32_WINNT
@@ -12,11 +13,19 @@
 #include "ipcap.h"
 #include "common/thread_pool.hpp"
 #include "protocol/ip.h"
+#include "protocol/tcp.h"
+#include "protocol/fragment.h"
+#include "flow.h"
+#include "dispatch.h"
+#include "arena.h"
 #include "config.h"
+#include "stats.h"
+#include "packet.h"
+#include "pcapng.h"
 
 namespace figkey {
 
-    NpcapCom::NpcapCom() : handle(NULL) {
+    NpcapCom::NpcapCom() : isRunning(false) {
         init();
     }
 
@@ -45,22 +54,69 @@ namespace figkey {
     }
 
     void NpcapCom::pcapHandler(u_char* user, const struct pcap_pkthdr* pkthdr, const u_char* packet) {
-        NpcapCom* processor = reinterpret_cast<NpcapCom*>(user);
-        if (nullptr == processor) {
+        CaptureInterface* capture = reinterpret_cast<CaptureInterface*>(user);
+        if ((nullptr == capture) || (nullptr == capture->owner)) {
             std::cerr << "Fatal error: NpcapCom is null" << std::endl;
             return;
         }
+        NpcapCom* processor = capture->owner;
 
-        if (!processor->isRunning)
+        auto& stats = CaptureStatistics::Instance();
+        stats.count(STATISTICS_CAPTURED);
+        if (capture->isOffline) {
+            if (!processor->waitOffline(*capture, pkthdr))
+                return;
+        }
+        else if (!processor->isRunning) {
+            stats.count(STATISTICS_PAUSED);
             return;
+        }
 
-        if (pkthdr->caplen > CAPTURE_SNAP_LENGTH)  // 确保caplen小于等于捕获长度
+        if (pkthdr->caplen > capture->snapLength)  // 确保caplen小于等于捕获长度
         {
+            stats.count(STATISTICS_SNAP_DROPPED);
             std::cerr << "Fatal error: Capture length exceeds limit, capture length is "<< pkthdr->caplen << std::endl;
             return;
         }
 
-        IPPacketParse::Instance().parse(pkthdr, packet);
+        IPPacketParse::Instance().parse(pkthdr, packet, capture->id);
+    }
+
+    bool NpcapCom::waitOffline(CaptureInterface& capture, const struct pcap_pkthdr* pkthdr) {
+        // 文件数据不会丢失，暂停时阻塞读取线程，暂停的时间不计入回放间隔
+        if (!isRunning) {
+            auto pauseStart = std::chrono::steady_clock::now();
+            while (!isRunning && !capture.isStopped)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            capture.replayStart += std::chrono::steady_clock::now() - pauseStart;
+        }
+        if (capture.isStopped)
+            return false;
+
+        if (!capture.isRealTime)
+            return true;
+
+        uint64_t timestamp = parsePacketTimestamp(pkthdr->ts);
+        if (0 == capture.firstTimestamp) {
+            capture.firstTimestamp = timestamp;
+            capture.replayStart = std::chrono::steady_clock::now();
+            return true;
+        }
+        if (timestamp <= capture.firstTimestamp)
+            return true;
+
+        // 分段等待，回放中可以及时响应停止
+        auto target = capture.replayStart + std::chrono::nanoseconds(timestamp - capture.firstTimestamp);
+        for (;;) {
+            if (capture.isStopped)
+                return false;
+            auto now = std::chrono::steady_clock::now();
+            if (now >= target)
+                break;
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(target - now, std::chrono::milliseconds(100)));
+        }
+
+        return true;
     }
 
     std::vector<NetworkInfo> NpcapCom::getNetworkList() {
@@ -141,10 +197,35 @@ namespace figkey {
     }
 
     bool NpcapCom::pcapOpen() {
-        if (handle != NULL)
+        if (!captures.empty())
             return true;
 
-        const std::string& networkName = figkey::CaptureConfig::Instance().getConfigInfo().network.name;
+        const auto& info = figkey::CaptureConfig::Instance().getConfigInfo();
+        std::vector<NetworkInfo> networks = info.networks;
+        if (networks.empty())
+            networks.emplace_back(info.network);
+
+        for (size_t i = 0; i < networks.size(); ++i) {
+            std::unique_ptr<CaptureInterface> capture(new CaptureInterface());
+            capture->owner = this;
+            capture->id = static_cast<uint8_t>(i);
+            capture->name = networks[i].name;
+            capture->description = networks[i].description;
+            bool isOpen = pcapOpen(*capture, networks[i].name);
+            captures.emplace_back(std::move(capture));
+            if (!isOpen) {
+                pcapClose();
+                return false;
+            }
+            std::cout << "capture interface " << i << " : " << networks[i].name << std::endl;
+        }
+
+        return true;
+    }
+
+    bool NpcapCom::pcapOpen(CaptureInterface& capture, const std::string& networkName) {
+        const auto& info = figkey::CaptureConfig::Instance().getConfigInfo();
+        pcap_t*& handle = capture.handle;
         char errbuf[PCAP_ERRBUF_SIZE];
 #if 0
         handle = pcap_open_live(networkName.c_str(), 65536, PCAP_OPENFLAG_PROMISCUOUS, 1000, errbuf);
@@ -160,17 +241,29 @@ namespace figkey {
             return false;
         }
 
-        auto res = pcap_set_snaplen(handle, CAPTURE_SNAP_LENGTH);
+        capture.snapLength = info.captureSnapLength;
+        auto res = pcap_set_snaplen(handle, static_cast<int>(capture.snapLength));
         if (res < 0) {
             fprintf(stderr, "pcap_set_snaplen error: %s\n", pcap_statustostr(res));
             return false;
         }
+        res = pcap_set_buffer_size(handle, static_cast<int>(info.captureBufferSize) * 1024 * 1024);
+        if (res < 0) {
+            fprintf(stderr, "pcap_set_buffer_size error: %s\n", pcap_statustostr(res));
+            return false;
+        }
+        // 立即模式下数据包到达即上送，不受超时时间影响
+        res = pcap_set_immediate_mode(handle, info.captureImmediateMode ? 1 : 0);
+        if (res < 0) {
+            fprintf(stderr, "pcap_set_immediate_mode error: %s\n", pcap_statustostr(res));
+            return false;
+        }
         res = pcap_set_promisc(handle, CAPTURE_PROMISC); //设置优先级 1，过滤时需设置优先级为 1 保持一致
         if (res < 0) {
             fprintf(stderr, "pcap_set_promisc error: %s\n", pcap_statustostr(res));
             return false;
         }
-        res = pcap_set_timeout(handle, 1000);
+        res = pcap_set_timeout(handle, info.captureTimeout);
         if (res < 0) {
             fprintf(stderr, "pcap_set_timeout error: %s\n", pcap_statustostr(res));
             return false;
@@ -198,26 +291,111 @@ namespace figkey {
         return true;
     }
 
-    bool NpcapCom::pcapFilter(uint32_t netmask)
+    void NpcapCom::pcapClose()
+    {
+        for (auto& capture : captures) {
+            if (capture->handle) {
+                pcap_close(capture->handle);
+                capture->handle = NULL;
+            }
+        }
+        captures.clear();
+    }
+
+    bool NpcapCom::pcapSetFilter(pcap_t* handle, const std::string& expression, uint32_t netmask)
     {
-        // 设置过滤器（例如只捕获TCP数据包）
         struct bpf_program filter;
-        if (pcap_compile(handle, &filter, figkey::CaptureConfig::Instance().getConfigInfo().captureFilter.c_str(), CAPTURE_PROMISC, netmask) < 0) {
+        if (pcap_compile(handle, &filter, expression.c_str(), CAPTURE_PROMISC, netmask) < 0) {
             std::cerr << "Bad filter - " << pcap_geterr(handle) << std::endl;
             return false;
         }
         if (pcap_setfilter(handle, &filter) < 0) {
             std::cerr << "Error setting filter - " << pcap_geterr(handle) << std::endl;
+            pcap_freecode(&filter);
             return false;
         }
 
+        pcap_freecode(&filter);
         return true;
     }
 
-    void NpcapCom::startCapture() {
+    bool NpcapCom::pcapFilter(uint32_t netmask)
+    {
+        auto& config = figkey::CaptureConfig::Instance();
+        const auto& info = config.getConfigInfo();
+
+        // 抓包中更换过滤条件时，安装之前已进入驱动缓冲区的数据包由旧的 BPF 放行，
+        // 这些数据包的捕获时间早于安装时间，仍在用户态比较全部条件
+        uint64_t since{ 0 };
+        if (isRunning) {
+            since = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+        }
+
+        // 地址和端口条件下推到驱动，不匹配的数据包不再拷贝到用户态
+        // 过滤器在所有网卡共享，任一网卡安装失败都回退到用户态比较
+        auto expression = buildCaptureFilter(info.filter, info.captureFilter);
+        bool isKernelFiltered = !expression.empty();
+        for (auto& capture : captures) {
+            if (!isKernelFiltered)
+                break;
+            isKernelFiltered = pcapSetFilter(capture->handle, expression, netmask);
+        }
+        if (isKernelFiltered) {
+            std::cout << "Capture filter : " << expression << std::endl;
+            config.publishFilter(true, since);
+            return true;
+        }
+
+        // 生成的表达式无法使用时只安装基础过滤器，全部条件在用户态比较
+        bool isInstalled{ true };
+        for (auto& capture : captures) {
+            if (!pcapSetFilter(capture->handle, info.captureFilter, netmask))
+                isInstalled = false;
+        }
+        config.publishFilter(false, 0);
+        return isInstalled;
+    }
+
+    bool NpcapCom::sampleStatistics()
+    {
+        if (captures.empty())
+            return false;
+
+        // 多网卡时累加各网卡的驱动计数
+        uint32_t received{ 0 }, dropped{ 0 }, ifDropped{ 0 };
+        for (auto& capture : captures) {
+            // 离线文件没有驱动计数
+            if (capture->isOffline)
+                return false;
+
+            struct pcap_stat ps;
+            if (pcap_stats(capture->handle, &ps) < 0) {
+                std::cerr << "Error reading statistics - " << pcap_geterr(capture->handle) << std::endl;
+                return false;
+            }
+            received += ps.ps_recv;
+            dropped += ps.ps_drop;
+            ifDropped += ps.ps_ifdrop;
+        }
+
+        CaptureStatistics::Instance().setPcapStatistics(received, dropped, ifDropped);
+        return true;
+    }
+
+    bool NpcapCom::updateFilter()
+    {
+        if (captures.empty())
+            return false;
+
+        return pcapFilter();
+    }
+
+    void NpcapCom::startCapture(CaptureInterface* capture) {
+        pcap_t* handle = capture->handle;
 #if 0
-        static std::function<bool(const struct pcap_pkthdr*, const u_char*)> ipParse = std::bind(&IPPacketParse::parse, &IPPacketParse::Instance(),
-            std::placeholders::_1, std::placeholders::_2);
+        static std::function<bool(const struct pcap_pkthdr*, const u_char*, uint8_t)> ipParse = std::bind(&IPPacketParse::parse, &IPPacketParse::Instance(),
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
 
         //start the capture
         int res;
@@ -239,7 +417,7 @@ namespace figkey {
 
             // 获取线程池的实例
             opensource::ctrlfrmb::ThreadPool& pool = opensource::ctrlfrmb::ThreadPool::Instance();
-            pool.submit(ipParse, pkthdr, pkt_data);
+            pool.submit(ipParse, pkthdr, pkt_data, capture->id);
 
         }
 
@@ -248,36 +426,146 @@ namespace figkey {
         }
 #else
         // pcap_loop 可以一次捕获多包数据，在数据处理遇到瓶颈时 性能更佳
-        pcap_loop(handle, 0, &NpcapCom::pcapHandler, reinterpret_cast<u_char*>(this));
+        // 解析后的数据写入该网卡的环形缓冲区，由 PacketDispatcher 的消费线程合并后批量投递
+        pcap_loop(handle, 0, &NpcapCom::pcapHandler, reinterpret_cast<u_char*>(capture));
+        capture->isFinished = true;
 #endif
     }
 
+    void NpcapCom::startThreads(bool isBlocking)
+    {
+        // 抓包线程在解析后直接写入 pcapng，不经过界面和数据库
+        const auto& info = figkey::CaptureConfig::Instance().getConfigInfo();
+        if (info.pcapngExport && !info.pcapngFile.empty()) {
+            std::vector<PcapngInterfaceInfo> interfaces;
+            for (auto& capture : captures) {
+                PcapngInterfaceInfo ifInfo;
+                ifInfo.name = capture->name;
+                ifInfo.description = capture->description;
+                ifInfo.snapLength = capture->snapLength;
+                interfaces.emplace_back(ifInfo);
+            }
+            PcapngRollingInfo rolling;
+            rolling.files = info.rollingFiles;
+            rolling.fileSize = info.rollingFileSize;
+            rolling.fileDuration = info.rollingFileDuration;
+            PcapngWriter::Instance().open(info.pcapngFile, interfaces, rolling, isBlocking);
+        }
+
+        CaptureStatistics::Instance().reset();
+        figkey::TcpReassembler::Instance().clear();
+        figkey::FlowTable::Instance().clear();
+        figkey::FragmentReassembler::Instance().clear();
+        PacketArena::Instance().clear(captures.size());
+        isRunning = true;
+        PacketDispatcher::Instance().start(captures.size(), isBlocking);
+
+        // 每个网卡一个抓包线程，线程之间只通过各自的环形缓冲区交换数据
+        for (auto& capture : captures) {
+            if (!capture->thread.joinable())
+                capture->thread = std::thread(&NpcapCom::startCapture, this, capture.get());
+        }
+    }
+
     bool NpcapCom::run()
     {
         if (isRunning) {
             return isRunning;
         }
 
+        // 上一次的抓包线程已经全部退出，之前替换下来的过滤器不再被引用
+        if (captures.empty())
+            figkey::CaptureConfig::Instance().reclaimFilters();
+
         if (!pcapOpen())
             return isRunning;
 
         if (!pcapFilter())
             return isRunning;
 
-        isRunning = true;
+        startThreads(false);
+        return isRunning;
+    }
+
+    bool NpcapCom::runOffline(const std::string& path, bool isRealTime)
+    {
+        if (isRunning || !captures.empty()) {
+            std::cerr << "Capture is running, stop it before reading " << path << std::endl;
+            return false;
+        }
 
-        std::function<void()> fun_async = std::bind(&NpcapCom::startCapture, this);
-        opensource::ctrlfrmb::ThreadPool::Instance().submit(fun_async);
+        figkey::CaptureConfig::Instance().reclaimFilters();
+
+        char errbuf[PCAP_ERRBUF_SIZE];
+        pcap_t* handle = pcap_open_offline(path.c_str(), errbuf);
+        if (handle == NULL) {
+            std::cerr << "Couldn't open file " << path << ": " << errbuf << std::endl;
+            return false;
+        }
+
+        // 解析器只处理以太网帧
+        if (pcap_datalink(handle) != DLT_EN10MB) {
+            std::cerr << "Unsupported link type " << pcap_datalink(handle) << " in " << path << std::endl;
+            pcap_close(handle);
+            return false;
+        }
+
+        std::unique_ptr<CaptureInterface> capture(new CaptureInterface());
+        capture->owner = this;
+        capture->handle = handle;
+        capture->name = path;
+        capture->isOffline = true;
+        capture->isRealTime = isRealTime;
+        capture->snapLength = static_cast<uint32_t>(pcap_snapshot(handle));
+        if (capture->snapLength < CAPTURE_SNAP_LENGTH_MIN)
+            capture->snapLength = CAPTURE_SNAP_LENGTH_MAX;
+        captures.emplace_back(std::move(capture));
+
+        if (!pcapFilter()) {
+            pcapClose();
+            return false;
+        }
+
+        std::cout << "read capture file " << path << (isRealTime ? " in real time" : " at max speed") << std::endl;
+        // 文件读取速度可能超过界面和数据库的处理速度，缓冲区满时等待而不是丢弃
+        startThreads(true);
         return isRunning;
     }
 
+    bool NpcapCom::isFinished() const
+    {
+        if (captures.empty())
+            return false;
+
+        for (auto& capture : captures) {
+            if (!capture->isOffline || !capture->isFinished)
+                return false;
+        }
+        return true;
+    }
+
     void NpcapCom::stopCapture()
     {
         isRunning = false;
 
-        if (handle) {
-            pcap_close(handle);
-            handle = NULL;
+        if (!captures.empty()) {
+            // 关闭前取最后一次驱动计数
+            sampleStatistics();
+            for (auto& capture : captures) {
+                capture->isStopped = true;
+                pcap_breakloop(capture->handle);
+            }
+            for (auto& capture : captures) {
+                if (capture->thread.joinable())
+                    capture->thread.join();
+            }
+            pcapClose();
         }
+
+        // 抓包线程已经退出，不再有写入
+        PcapngWriter::Instance().close();
+        PacketDispatcher::Instance().stop();
+
+        std::cout << "capture statistics : " << CaptureStatistics::Instance().dump() << std::endl;
     }
 }
@@ -1,7 +1,7 @@
 ﻿// ipcap.cpp: 定义应用程序的入口点。
 //
-#include <iomanip>
-#include <sstream>
+#include <cstring>
+#include <cstdio>
 #include <atomic>
 #include <chrono>
 #ifdef _WIN32
@@ -16,68 +16,230 @@
 
 #include "def.h"
 #include "packet.h"
+#include "arena.h"
+#include "checksum.h"
 
 namespace figkey {
 
-    std::string parsePacketTimestamp(const struct timeval& ts) {
-        struct tm ltime;
-        char timestr[16];
-        time_t local_tv_sec;
-
+    uint64_t parsePacketTimestamp(const struct timeval& ts) {
         // 确保 tv_sec 是合理的时间戳
-        if (ts.tv_sec < 0) {
-            // 处理无效时间戳
-            // 此处可以记录错误或选择一个默认值
-            local_tv_sec = 0;
-        }
-        else {
-            local_tv_sec = ts.tv_sec;
-        }
+        if (ts.tv_sec < 0)
+            return 0;
+
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_usec) * 1000ULL;
+    }
+
+    std::string formatPacketTimestamp(uint64_t timestamp) {
+        struct tm ltime;
+        char timestr[32];
+        time_t local_tv_sec = static_cast<time_t>(timestamp / 1000000000ULL);
 
         // 使用 localtime_s 而不是 localtime
         errno_t err = localtime_s(&ltime, &local_tv_sec);
         if (err != 0) {
             // 处理 localtime_s 的错误
-            // 此处可以记录错误或选择一个默认值
-            return "00:00:00.000,";
+            return "00:00:00.000000";
         }
 
-        strftime(timestr, sizeof timestr, "%H:%M:%S", &ltime);
-        std::string str(timestr);
+        size_t len = strftime(timestr, sizeof timestr, "%H:%M:%S", &ltime);
+        // 构建时间戳字符串，精确到微秒
+        snprintf(timestr + len, sizeof(timestr) - len, ".%06u", static_cast<unsigned>((timestamp % 1000000000ULL) / 1000));
+        return std::string(timestr);
+    }
+
+    std::string parsePayloadToHexString(const uint8_t* data, size_t length) {
+        static const char digits[] = "0123456789abcdef";
+        if (0 == length)
+            return std::string();
 
-        // 构建时间戳字符串
-        str += ".";
-        str += std::to_string(ts.tv_usec);
+        // 每字节两位十六进制加一个空格分隔，去掉最后一个空格
+        std::string result(length * 3 - 1, ' ');
+        for (size_t i = 0; i < length; ++i) {
+            result[i * 3] = digits[data[i] >> 4];
+            result[i * 3 + 1] = digits[data[i] & 0x0F];
+        }
 
-        return str;
+        return result;
     }
 
     std::string parsePayloadToHexString(const std::vector<uint8_t>& data) {
-        std::stringstream ss;
-        ss << std::hex << std::setfill('0');
+        return parsePayloadToHexString(data.data(), data.size());
+    }
+
+    static int parseHexDigit(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
 
-        for (const auto& d : data)
-            ss << std::setw(2) << static_cast<unsigned>(d) << " ";
+    bool parseHexStringToPayload(const std::string& hex, std::vector<uint8_t>& data) {
+        size_t size{ 0 };
+        data.resize(hex.size() / 2);
+        bool isSuccess = parseHexStringToPayload(hex.data(), hex.size(), data.data(), size);
+        data.resize(isSuccess ? size : 0);
+        return isSuccess;
+    }
 
-        std::string result = ss.str();
-        // Remove the last space
-        if (!result.empty())
-            result.pop_back();
+    bool parseHexStringToPayload(const char* hex, size_t length, uint8_t* data, size_t& size) {
+        size = 0;
 
-        return result;
+        int high = -1;
+        for (size_t i = 0; i < length; ++i) {
+            char c = hex[i];
+            if (c == ' ' || c == ':' || c == '-') {
+                if (high >= 0)
+                    return false;
+                continue;
+            }
+
+            int value = parseHexDigit(c);
+            if (value < 0)
+                return false;
+
+            if (high < 0) {
+                high = value;
+            }
+            else {
+                data[size++] = static_cast<uint8_t>((high << 4) | value);
+                high = -1;
+            }
+        }
+
+        return high < 0;
+    }
+
+    std::string formatIpAddress(const uint8_t* ip, uint8_t version) {
+        char straddr[INET6_ADDRSTRLEN];
+        if (4 == version)
+            snprintf(straddr, sizeof straddr, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+        else if (6 == version)
+            inet_ntop(AF_INET6, (void*)ip, straddr, INET6_ADDRSTRLEN);
+        else
+            return std::string();
+
+        return std::string(straddr);
+    }
+
+    bool parseIpAddress(const std::string& text, uint8_t* ip, uint8_t& version) {
+        memset(ip, 0, PACKET_IP_ADDRESS_LENGTH);
+        if (inet_pton(AF_INET, text.c_str(), ip) == 1) {
+            version = 4;
+            return true;
+        }
+
+        if (inet_pton(AF_INET6, text.c_str(), ip) == 1) {
+            version = 6;
+            return true;
+        }
+
+        version = 0;
+        return false;
     }
 
-    static std::string convertMacToString(const uint8_t mac[6]){
-        char buf[17];
-        sprintf(buf, "%.2x:%.2x:%.2x:%.2x:%.2x:%.2x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    std::string formatMacAddress(const uint8_t* mac) {
+        char buf[18];
+        snprintf(buf, sizeof buf, "%.2x:%.2x:%.2x:%.2x:%.2x:%.2x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
         return std::string(buf);
     }
 
+    bool parseMacAddress(const std::string& text, uint8_t* mac) {
+        // 格式 xx:xx:xx:xx:xx:xx 或 xx-xx-xx-xx-xx-xx
+        if (text.size() != PACKET_MAC_ADDRESS_LENGTH * 3 - 1)
+            return false;
+
+        for (size_t i = 0; i < PACKET_MAC_ADDRESS_LENGTH; ++i) {
+            int high = parseHexDigit(text[i * 3]);
+            int low = parseHexDigit(text[i * 3 + 1]);
+            if (high < 0 || low < 0)
+                return false;
+            if ((i + 1 < PACKET_MAC_ADDRESS_LENGTH) && (text[i * 3 + 2] != ':') && (text[i * 3 + 2] != '-'))
+                return false;
+            mac[i] = static_cast<uint8_t>((high << 4) | low);
+        }
+
+        return true;
+    }
+
+    const char* getPacketErrorName(uint8_t err) {
+        switch (err) {
+        case PACKET_NO_ERROR: return "";
+        case PACKET_SYSTEM_ERROR: return "[SystemError]";
+        case PACKET_SNAP_LENGTH_ERROR: return "[SnapLengthError]";
+        case PACKET_ETHERNET_TYPE_UNKNOWN: return "[EthernetError]: Ethernet type unknown";
+        case PACKET_IPV4_HEADER_LOST_ERROR: return "[Ipv4HeadError]: IPv4 packet loss";
+        case PACKET_IPV6_HEADER_LOST_ERROR: return "[Ipv6HeadError]: IPv6 packet loss";
+        case PACKET_TCP_HEADER_LOST_ERROR: return "[TcpHeaderError]: the packet length is less than the tcp header minimum value";
+        case PACKET_TCP_HEADER_OFFSET_ERROR: return "[TcpHeaderError]: tcp header offset error";
+        case PACKET_UDP_HEADER_LOST_ERROR: return "[UdpHeaderError]: the packet length is less than the udp header minimum value";
+        case PACKET_TCP_PAYLOAD_LOST_ERROR: return "[TcpPayloadError]: tcp payload data loss";
+        case PACKET_UDP_PAYLOAD_LOST_ERROR: return "[UdpPayloadError]: udp payload data loss";
+        case PACKET_IP_VERSION_UNKNOWN: return "[IpHeaderError]: ip version unknown";
+        case PACKET_IP_HEADER_LENGTH_ERROR: return "[IpHeaderError]: header length error";
+        case PACKET_IP_TOTAL_LENGTH_ERROR: return "[IpHeaderError]: total length error";
+        case PACKET_IP_TTL_INVALID_OR_WARN: return "[IpHeaderWarn]: ttl is 0 or 1";
+        case PACKET_IP_INVALID_CHECKSUM: return "[IpHeaderError]: invalid checksum";
+        case PACKET_TCP_INVALID_SOURCE_PORT: return "[TcpHeaderError]: invalid source port";
+        case PACKET_TCP_INVALID_DESTINATION_PORT: return "[TcpHeaderError]: invalid destination port";
+        case PACKET_TCP_HEADER_LENGTH_ERROR: return "[TcpHeaderError]: header length error";
+        case PACKET_TCP_INVALID_CHECKSUM: return "[TcpHeaderError]: invalid checksum";
+        case PACKET_TCP_RETRANSMISSION: return "[TcpWarn]: retransmission";
+        case PACKET_TCP_OUT_OF_ORDER: return "[TcpWarn]: out of order";
+        case PACKET_TCP_LOST_SEGMENT: return "[TcpWarn]: previous segment lost";
+        case PACKET_TCP_DUPLICATE_ACK: return "[TcpWarn]: duplicate ack";
+        case PACKET_TCP_WINDOW_FULL: return "[TcpWarn]: window full";
+        case PACKET_TCP_ZERO_WINDOW: return "[TcpWarn]: zero window";
+        case PACKET_UDP_HEADER_LENGTH_ERROR: return "[UdpHeaderError]: header length error";
+        case PACKET_UDP_INVALID_CHECKSUM: return "[UdpHeaderError]: invalid checksum";
+        case PACKET_UDP_PORT_UNREACHABLE: return "[UdpError]: port unreachable";
+        default: break;
+        }
+
+        return "[UnknownError]";
+    }
+
+    bool getPacketPayload(const PacketInfo& info, std::vector<uint8_t>& payload) {
+        if (info.payloadOffset + info.payloadLength > info.dataLength) {
+            payload.clear();
+            return false;
+        }
+
+        return PacketArena::Instance().read(info.interfaceId, info.dataOffset + info.payloadOffset, info.payloadLength, payload);
+    }
+
+    std::string formatPacketData(const PacketInfo& info, const uint8_t* payload, size_t length, size_t maxLength) {
+        // 每字节显示 3 个字符，只转换显示长度以内的负载
+        bool isExpired = (length < info.payloadLength);
+        bool isTruncated = !isExpired && (maxLength > 0) && (length * 3 > maxLength);
+        if (isTruncated)
+            length = maxLength / 3 + 1;
+
+        std::string data;
+        if (PACKET_NO_ERROR != info.err) {
+            data = getPacketErrorName(info.err);
+            if (!isExpired && (length > 0))
+                data += ", ";
+        }
+
+        if (isExpired) {
+            data += "[Expired]: payload has been overwritten";
+        }
+        else {
+            data += parsePayloadToHexString(payload, length);
+            if (isTruncated)
+                data += " ...";
+        }
+
+        return data;
+    }
+
     static bool parseEthernet(const unsigned char* packet, const uint32_t& size, PacketInfo &info) {
         // 以太网帧头解析
         auto* eth = reinterpret_cast<const ethernet_header*>(packet);
         if (!eth) {
-            info.data = "[SystemError]: parse ethernet header failed";
             info.err = PACKET_SYSTEM_ERROR;
             return false;
         }
@@ -86,53 +248,39 @@ namespace figkey {
         uint16_t type = ntohs(eth->type);
         if (type == 0x0800) {
             if (size <= ETHERNET_IPV4_HEADER_MIN) {
-                char buf[256];
-                sprintf(buf, "[Ipv4HeadError]: IPv4 packet loss, the current packet length %u is less than the required minimum packet length %d", size, ETHERNET_IPV4_HEADER_MIN);
-                info.data = buf;
                 info.err = PACKET_IPV4_HEADER_LOST_ERROR;
                 return false;
             }
             // IPv4
-            info.protocolType = 4;
+            info.ipVersion = 4;
         } else if (type == 0x86DD) {
             if (size <= ETHERNET_IPV6_HEADER_MIN) {
-                char buf[256];
-                sprintf(buf, "[Ipv6HeadError]: IPv6 packet loss, the current packet length %u is less than the required minimum packet length %d", size, ETHERNET_IPV6_HEADER_MIN);
-                info.data = buf;
                 info.err = PACKET_IPV6_HEADER_LOST_ERROR;
                 return false;
             }
             // IPv6
-            info.protocolType = 6;
+            info.ipVersion = 6;
         } else {
             // 不是 IP 数据包或者我们暂时不处理的类型
-            info.data = "[EthernetError]: Ethernet type unknown";
             info.err = PACKET_ETHERNET_TYPE_UNKNOWN;
             return false;
         }
 
-        info.srcMAC = convertMacToString(eth->src_mac);
-        info.destMAC = convertMacToString(eth->dest_mac);
+        memcpy(info.srcMAC, eth->src_mac, PACKET_MAC_ADDRESS_LENGTH);
+        memcpy(info.destMAC, eth->dest_mac, PACKET_MAC_ADDRESS_LENGTH);
         return true;
     }
 
-    static std::string convertIpToString(uint32_t ip) {
-        struct in_addr ip_addr;
-        ip_addr.s_addr = ip;
-        return inet_ntoa(ip_addr);
-    }
-
     static size_t parseIPv4(const unsigned char* packet, PacketInfo &info) {
         // IP 头解析
         const ip_header* iph = reinterpret_cast<const ip_header*>(packet);
         if (!iph) {
-            info.data  = "[SystemError]: parse ipv4 header failed";
             info.err = PACKET_SYSTEM_ERROR;
             return 0;
         }
 
-        info.srcIP = convertIpToString(iph->iph_sourceip);
-        info.destIP = convertIpToString(iph->iph_destip);
+        memcpy(info.srcIP, &iph->iph_sourceip, 4);
+        memcpy(info.destIP, &iph->iph_destip, 4);
         info.protocolType = iph->iph_protocol;
         info.payloadLength = ntohs(iph->iph_len) - ((iph->ihl_and_version & 0xF) * 4);  // 注意网络到主机字节序的转换
         // 计算 IP 头部的长度
@@ -144,55 +292,36 @@ namespace figkey {
     static size_t parseIPv6(const unsigned char* packet, PacketInfo &info) {
         const ip6_header* iph = reinterpret_cast<const ip6_header*>(packet);
         if (!iph) {
-            info.data  = "[SystemError]: parse ipv6 header failed";
             info.err = PACKET_SYSTEM_ERROR;
             return 0;
         }
 
-        char straddr[INET6_ADDRSTRLEN];
-        inet_ntop(AF_INET6, (void *)iph->src_addr, straddr, INET6_ADDRSTRLEN);
-        info.srcIP = std::string(straddr);
-
-        inet_ntop(AF_INET6, (void *)iph->dst_addr, straddr, INET6_ADDRSTRLEN);
-        info.destIP = std::string(straddr);
+        memcpy(info.srcIP, iph->src_addr, PACKET_IP_ADDRESS_LENGTH);
+        memcpy(info.destIP, iph->dst_addr, PACKET_IP_ADDRESS_LENGTH);
 
         info.protocolType = iph->next_header;
-        info.payloadLength = iph->payload_len;
+        info.payloadLength = ntohs(iph->payload_len);
         size_t len = sizeof(ethernet_header)+sizeof(ip6_header); //固定40，扩展需令计算
         return len;
     }
 
-    static std::string parsePayloadToHexString(const unsigned char* data, size_t length) {
-        std::stringstream ss;
-        ss << std::hex << std::setfill('0');
-
-        for (size_t i = 0; i < length; ++i) {
-            ss << std::setw(2) << static_cast<unsigned>(data[i]) << " ";
-        }
-
-        return ss.str();
-    }
-
     static size_t parseTCP(const unsigned char* packet, const uint32_t& size, PacketInfo &info) {
         info.protocolType = PROTOCOL_TYPE_TCP;
         // TCP 头的长度 (可能包括选项)
         auto len = sizeof(tcp_header);
         if (size < len) {
-            info.data = "[TcpHeaderError]: the packet length is less than the tcp header minimum value " ;
             info.err = PACKET_TCP_HEADER_LOST_ERROR;
             return 0;
         }
 
         const tcp_header* tcph = reinterpret_cast<const tcp_header*>(packet);
         if (!tcph) {
-            info.data  = "[SystemError]: parse tcp header failed";
             info.err = PACKET_SYSTEM_ERROR;
             return 0;
         }
 
-        auto headerLen = ((tcph->data_offset_and_reserved >> 4) & 0xF) * 4; // 提取 th_off 的值
-        if (headerLen  == 0) {
-            info.data = "[TcpHeaderError]: data_offset_and_reserved is 0";
+        size_t headerLen = ((tcph->data_offset_and_reserved >> 4) & 0xF) * 4; // 提取 th_off 的值
+        if (headerLen < len || headerLen > size) {
             info.err = PACKET_TCP_HEADER_OFFSET_ERROR;
             return 0;
         }
@@ -200,25 +329,22 @@ namespace figkey {
         info.srcPort = ntohs(tcph->th_sport);
         info.destPort = ntohs(tcph->th_dport);
         info.payloadLength -= headerLen;
-        auto dataLen = size-len;
+        auto dataLen = size-headerLen;
         if (info.payloadLength > dataLen) {
-            info.data = "[TcpPayloadError]: tcp payload data loss, " ;
-            info.data += parsePayloadToHexString(packet+len, dataLen);
             info.err = PACKET_TCP_PAYLOAD_LOST_ERROR;
             return 0;
         }
-        return len;
+        return headerLen;
     }
 
     static size_t parseUDP(const unsigned char* packet, const uint32_t& size, PacketInfo &info) {
         info.protocolType = PROTOCOL_TYPE_UDP;
         auto len = sizeof(udp_header);
         if (size < len) {
-            info.data = "[UdpHeaderError]: the packet length is less than the udp header minimum value " ;
-            info.err = PACKET_TCP_HEADER_LOST_ERROR;
+            info.err = PACKET_UDP_HEADER_LOST_ERROR;
             return 0;
         }
-        struct udp_header* udph = (struct udp_header*)(packet);
+        const udp_header* udph = reinterpret_cast<const udp_header*>(packet);
         info.srcPort = ntohs(udph->uh_sport);
         info.destPort = ntohs(udph->uh_dport);
         // 这里可以根据需要将 UDP 报文的其他字段也解析出来
@@ -226,8 +352,6 @@ namespace figkey {
         info.payloadLength = ntohs(udph->uh_len)-len;
         auto dataLen = size-len;
         if (info.payloadLength > dataLen) {
-            info.data = "[UdpPayloadError]: udp payload data loss, " ;
-            info.data += parsePayloadToHexString(packet+len, dataLen);
             info.err = PACKET_UDP_PAYLOAD_LOST_ERROR;
             return 0;
         }
@@ -240,11 +364,7 @@ namespace figkey {
         info.err = PACKET_NO_ERROR;
 
         if (size < ETHERNET_IP_UDP_HEADER_MIN) {
-            if (size > 0)
-                info.data = "[SnapLengthError]: capture length less than udp header min length 42";
-            else
-                info.data = "[SnapLengthError]: capture length is 0";
-            info.err = PACKET_SYSTEM_ERROR;
+            info.err = PACKET_SNAP_LENGTH_ERROR;
             return info;
         }
 
@@ -252,13 +372,14 @@ namespace figkey {
             return info;
 
         size_t offset = sizeof(ethernet_header);
-        if (4 == info.protocolType)
+        if (4 == info.ipVersion)
             offset = parseIPv4(packet+offset,info);
         else
             offset = parseIPv6(packet+offset,info);
         if (0 == offset)
             return info;
 
+        info.transportOffset = static_cast<uint16_t>(offset);
         size_t headerLen{0};
         switch (info.protocolType) {
             case IPPROTO_TCP:
@@ -268,14 +389,60 @@ namespace figkey {
                 headerLen = parseUDP(packet+offset, size - offset, info);
                 break;
             default:
-                info.data = "[NoError]: current protocol is not tcp or udp";
+                // current protocol is not tcp or udp
+                info.protocolType = PROTOCOL_TYPE_DEFAULT;
                 return info;
         }
         if (0 == headerLen)
             return info;
 
         offset += headerLen;
-        info.index = offset; //temporary storage offset
+        info.payloadOffset = static_cast<uint16_t>(offset);
+        return info;
+    }
+
+    PacketInfo parseIpFragment(const unsigned char* packet, const uint32_t& size) {
+        PacketInfo info;
+        info.protocolType = PROTOCOL_TYPE_DEFAULT;
+        info.err = PACKET_NO_ERROR;
+
+        if (size < ETHERNET_IPV4_HEADER_MIN) {
+            info.err = PACKET_SNAP_LENGTH_ERROR;
+            return info;
+        }
+
+        if (!parseEthernet(packet, size, info) || (4 != info.ipVersion))
+            return info;
+
+        const ip_header* iph = reinterpret_cast<const ip_header*>(packet + sizeof(ethernet_header));
+        size_t offset = parseIPv4(packet + sizeof(ethernet_header), info);
+        if ((offset > size) || (ntohs(iph->iph_len) < offset - sizeof(ethernet_header))
+            || (info.payloadLength > size - offset)) {
+            info.err = PACKET_IP_TOTAL_LENGTH_ERROR;
+            return info;
+        }
+
+        switch (info.protocolType) {
+            case IPPROTO_TCP:
+                info.protocolType = PROTOCOL_TYPE_TCP;
+                break;
+            case IPPROTO_UDP:
+                info.protocolType = PROTOCOL_TYPE_UDP;
+                break;
+            default:
+                info.protocolType = PROTOCOL_TYPE_DEFAULT;
+                break;
+        }
+
+        // TCP 和 UDP 头的前 4 个字节都是源端口和目的端口
+        bool isFirst = (0 == (ntohs(iph->iph_offset) & 0x1FFF));
+        if (isFirst && (PROTOCOL_TYPE_DEFAULT != info.protocolType) && (info.payloadLength >= 4)) {
+            info.srcPort = ntohs(*reinterpret_cast<const uint16_t*>(packet + offset));
+            info.destPort = ntohs(*reinterpret_cast<const uint16_t*>(packet + offset + 2));
+        }
+
+        info.transportOffset = static_cast<uint16_t>(offset);
+        info.payloadOffset = static_cast<uint16_t>(offset);
         return info;
     }
 
@@ -335,26 +502,6 @@ namespace figkey {
         return true;
     }
 
-    static uint16_t computeIpChecksum(const ip_header* ipHeader) {
-        uint32_t sum = 0;
-        const uint16_t* ptr = reinterpret_cast<const uint16_t*>(ipHeader);
-
-        // 将头部的每个 16 位字相加
-        for (size_t i = 0; i < sizeof(ip_header) / 2; ++i) {
-            if (i != 5) { // 跳过原校验和字段
-                sum += ntohs(ptr[i]);
-            }
-        }
-
-        // 将进位加到最低位
-        while (sum >> 16) {
-            sum = (sum & 0xFFFF) + (sum >> 16);
-        }
-
-        // 取补码
-        return ~sum;
-    }
-
 //    static bool isIpAddressValid(uint32_t ip) {
 //        // 转换为主机字节序
 //        ip = ntohl(ip);
@@ -386,7 +533,7 @@ namespace figkey {
 //        return true;
 //    }
 
-    uint8_t checkIpHeader(const ip_header* ipHeader, const size_t& packetSize) {
+    uint8_t checkIpHeader(const ip_header* ipHeader, const size_t& packetSize, bool isOffload) {
         if (!checkIpVersion(ipHeader->ihl_and_version))
             return PACKET_IP_VERSION_UNKNOWN;
 
@@ -402,16 +549,15 @@ namespace figkey {
         /*校验和为 0 的情况
             某些协议不要求校验和：例如，当使用 IPv4 的某些协议（如 UDP）时，校验和可能是可选的。在这种情况下，校验和字段可能被设置为 0。
             特殊网络环境：在一些特殊的网络环境或配置中，校验和可能被设置为 0。例如，某些类型的虚拟化软件或特殊的网络配置可能不使用标准的校验和。
+            本机发出的包在开启校验和卸载时由网卡填写，捕获到的校验和为 0；未开启卸载时为 0 仍按错误处理。
         */ 
-        uint16_t headerChecksum = ntohs(ipHeader->iph_chksum); // 将网络字节序转换为主机字节序
-        if (headerChecksum == 0)
+        if (isOffload && (0 == ipHeader->iph_chksum))
             return PACKET_NO_ERROR;
 
-        auto checkSum = computeIpChecksum(ipHeader);
-        if (checkSum != headerChecksum) {
-            printf("compute ip checksum error: compute checksum:%d, header checksum:%d\n", checkSum, headerChecksum);
+        // 包含校验和字段在内的整个头部（含选项）的反码和为 0xFFFF
+        size_t headerLength = (ipHeader->ihl_and_version & 0x0F) * 4;
+        if (0xFFFF != checksumFold(checksumAdd(reinterpret_cast<const uint8_t*>(ipHeader), headerLength)))
             return PACKET_IP_INVALID_CHECKSUM;
-        }
 
         return PACKET_NO_ERROR;
     }
@@ -457,52 +603,23 @@ namespace figkey {
         return PACKET_NO_ERROR;
     }
 
-    static uint16_t computeChecksum(const uint16_t* buffer, int size) {
-        uint32_t sum = 0;
-        while (size > 1) {
-            sum += *buffer++;
-            size -= 2;
-        }
-        if (size > 0) {
-            sum += *reinterpret_cast<const uint8_t*>(buffer);
-        }
-        while (sum >> 16) {
-            sum = (sum & 0xFFFF) + (sum >> 16);
-        }
-        return ~sum;
+    // 网卡校验和卸载时，本机发送的报文在抓包时校验和字段为 0 或只含伪首部的累加值
+    static bool isChecksumOffloaded(uint16_t checksum, uint64_t pseudoSum) {
+        return (0 == checksum) || (checksumFold(pseudoSum) == checksum);
     }
 
-    // 构建 TCP 伪头部
-    struct pseudo_header {
-        uint32_t source_address;
-        uint32_t dest_address;
-        uint8_t placeholder;
-        uint8_t protocol;
-        uint16_t tcp_length;
-    } pseudoHdr;
-
-    static uint16_t calculateTcpChecksum(const ip_header* ipHeader, int ipHeaderLen, const tcp_header* tcpHeader) {
-
-        pseudoHdr.source_address = ipHeader->iph_sourceip;
-        pseudoHdr.dest_address = ipHeader->iph_destip;
-        pseudoHdr.placeholder = 0;
-        pseudoHdr.protocol = IPPROTO_TCP;
-        pseudoHdr.tcp_length = htons(ntohs(ipHeader->iph_len) - ipHeaderLen);
-
-        // 计算伪头部和 TCP 头部的校验和
-        int psize = sizeof(pseudo_header) + ntohs(pseudoHdr.tcp_length);
-        std::vector<uint8_t> buff(psize);
-        memcpy(buff.data(), &pseudoHdr, sizeof(pseudo_header));
-        memcpy(buff.data() + sizeof(pseudo_header), tcpHeader, ntohs(pseudoHdr.tcp_length));
+    // 伪首部、传输层头和负载的反码和为 0xFFFF 时校验和正确
+    static bool isTransportChecksumValid(const unsigned char* packet, const PacketInfo& info, uint8_t protocol,
+                                         uint32_t length, uint16_t checksum, bool isOffload) {
+        uint64_t sum = checksumPseudoHeader(info, protocol, length);
+        if (isOffload && isChecksumOffloaded(checksum, sum))
+            return true;
 
-        return computeChecksum(reinterpret_cast<const uint16_t*>(buff.data()), psize);
+        return 0xFFFF == checksumFold(checksumAdd(packet + info.transportOffset, length, sum));
     }
 
-    uint8_t checkTcpHeader(const unsigned char* packet) {
-        // 提取 IP 头和 TCP 头
-        const ip_header* ipHeader = reinterpret_cast<const ip_header*>(packet + sizeof(ethernet_header));
-        int ipHeaderLen = (ipHeader->ihl_and_version & 0x0F) * 4;
-        const tcp_header* tcpHeader = reinterpret_cast<const tcp_header*>(packet + sizeof(ethernet_header) + ipHeaderLen);
+    uint8_t checkTcpHeader(const unsigned char* packet, const PacketInfo& info, bool isOffload) {
+        const tcp_header* tcpHeader = reinterpret_cast<const tcp_header*>(packet + info.transportOffset);
 
         auto portCheckError = checkTcpPorts(tcpHeader);
         if (portCheckError != PACKET_NO_ERROR)
@@ -512,12 +629,46 @@ namespace figkey {
         if (headerLengthError != PACKET_NO_ERROR)
             return headerLengthError;
 
-        uint16_t headerChecksum = ntohs(tcpHeader->th_sum); // 将网络字节序转换为主机字节序
-        auto checkSum = calculateTcpChecksum(ipHeader, ipHeaderLen, tcpHeader);
-        if (checkSum != headerChecksum) {
-            printf("compute tcp checksum error: compute checksum:%d, header checksum:%d\n", checkSum, headerChecksum);
+        uint32_t length = info.payloadOffset - info.transportOffset + info.payloadLength;
+        if (!isTransportChecksumValid(packet, info, IPPROTO_TCP, length, tcpHeader->th_sum, isOffload))
             return PACKET_TCP_INVALID_CHECKSUM;
+
+        return PACKET_NO_ERROR;
+    }
+
+    uint8_t checkUdpHeader(const unsigned char* packet, const PacketInfo& info, bool isOffload) {
+        const udp_header* udpHeader = reinterpret_cast<const udp_header*>(packet + info.transportOffset);
+        uint16_t length = ntohs(udpHeader->uh_len);
+        if (length < sizeof(udp_header))
+            return PACKET_UDP_HEADER_LENGTH_ERROR;
+
+        // IPv4 的 UDP 校验和为 0 表示发送方没有计算
+        if ((4 == info.ipVersion) && (0 == udpHeader->uh_sum))
+            return PACKET_NO_ERROR;
+
+        if (!isTransportChecksumValid(packet, info, IPPROTO_UDP, length, udpHeader->uh_sum, isOffload))
+            return PACKET_UDP_INVALID_CHECKSUM;
+
+        return PACKET_NO_ERROR;
+    }
+
+    uint8_t validatePacket(const unsigned char* packet, uint32_t size, const PacketInfo& info, bool isOffload) {
+        if (4 == info.ipVersion) {
+            const ip_header* ipHeader = reinterpret_cast<const ip_header*>(packet + sizeof(ethernet_header));
+            uint8_t err = checkIpHeader(ipHeader, size - sizeof(ethernet_header), isOffload);
+            if (PACKET_NO_ERROR != err)
+                return err;
+        }
+
+        switch (info.protocolType) {
+        case PROTOCOL_TYPE_TCP:
+            return checkTcpHeader(packet, info, isOffload);
+        case PROTOCOL_TYPE_UDP:
+            return checkUdpHeader(packet, info, isOffload);
+        default:
+            break;
         }
+
         return PACKET_NO_ERROR;
     }
 #if 0
@@ -0,0 +1,448 @@
+﻿// pcapng.cpp: pcapng 文件写入
+//
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include "pcapng.h"
+#include "packet.h"
+#include "stats.h"
+
+namespace figkey {
+
+    const uint32_t PcapngSectionHeaderBlock{ 0x0A0D0D0A };
+    const uint32_t PcapngInterfaceDescriptionBlock{ 0x00000001 };
+    const uint32_t PcapngEnhancedPacketBlock{ 0x00000006 };
+    const uint32_t PcapngByteOrderMagic{ 0x1A2B3C4D };
+    const uint16_t PcapngLinkTypeEthernet{ 1 };
+    const uint16_t PcapngOptionEnd{ 0 };
+    const uint16_t PcapngOptionComment{ 1 };
+    const uint16_t PcapngOptionShbUserAppl{ 4 };
+    const uint16_t PcapngOptionIfName{ 2 };
+    const uint16_t PcapngOptionIfDescription{ 3 };
+    const uint16_t PcapngOptionIfTsresol{ 9 };
+    const uint8_t PcapngTimestampNanoseconds{ 9 };
+
+    static size_t padLength(size_t length) {
+        return (length + 3) & ~static_cast<size_t>(3);
+    }
+
+    // 块按本机字节序写入，读取方通过 section header 中的字节序标识判断
+    static void appendValue(std::vector<uint8_t>& out, const void* value, size_t length) {
+        const uint8_t* data = static_cast<const uint8_t*>(value);
+        out.insert(out.end(), data, data + length);
+    }
+
+    static void appendUint16(std::vector<uint8_t>& out, uint16_t value) {
+        appendValue(out, &value, sizeof(value));
+    }
+
+    static void appendUint32(std::vector<uint8_t>& out, uint32_t value) {
+        appendValue(out, &value, sizeof(value));
+    }
+
+    static void appendOption(std::vector<uint8_t>& out, uint16_t code, const void* value, size_t length) {
+        appendUint16(out, code);
+        appendUint16(out, static_cast<uint16_t>(length));
+        appendValue(out, value, length);
+        out.resize(out.size() + padLength(length) - length, 0);
+    }
+
+    // 块长度在首尾各写一次，body 不含类型和长度字段
+    static void appendBlock(std::vector<uint8_t>& out, uint32_t type, const std::vector<uint8_t>& body) {
+        uint32_t total = static_cast<uint32_t>(body.size() + 12);
+        appendUint32(out, type);
+        appendUint32(out, total);
+        out.insert(out.end(), body.begin(), body.end());
+        appendUint32(out, total);
+    }
+
+    // 拆分为不含扩展名的路径和扩展名
+    static void splitPath(const std::string& path, std::string& stem, std::string& extension) {
+        auto dot = path.find_last_of('.');
+        auto slash = path.find_last_of("/\\");
+        if ((dot != std::string::npos) && ((slash == std::string::npos) || (dot > slash))) {
+            stem = path.substr(0, dot);
+            extension = path.substr(dot);
+        }
+        else {
+            stem = path;
+            extension.clear();
+        }
+    }
+
+    PcapngWriter::PcapngWriter()
+        : file(nullptr), isOpened(false), packets(0), dropped(0), retainedSince(0), interfaceCount(0),
+          fileNumber(0), fileBytes(0), fileStart(0), isBlocking(false), isStopping(false)
+    {
+    }
+
+    PcapngWriter::~PcapngWriter()
+    {
+        close();
+    }
+
+    std::string PcapngWriter::getFilePath(uint32_t number) const
+    {
+        if (0 == rolling.files)
+            return basePath;
+
+        // figkey.pcapng -> figkey_00001.pcapng
+        std::string stem, extension;
+        splitPath(basePath, stem, extension);
+
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "_%05u", number);
+        return stem + suffix + extension;
+    }
+
+    bool PcapngWriter::openFile()
+    {
+        current = PcapngFileInfo();
+        current.path = getFilePath(++fileNumber);
+
+        file = std::fopen(current.path.c_str(), "wb");
+        if (nullptr == file) {
+            std::cerr << "Open pcapng file failed: " << current.path << std::endl;
+            return false;
+        }
+        // 由本类按大块缓冲，关闭 C 库的缓冲区避免重复拷贝
+        std::setvbuf(file, nullptr, _IONBF, 0);
+
+        if (std::fwrite(header.data(), 1, header.size(), file) != header.size()) {
+            std::cerr << "Write pcapng header failed: " << current.path << std::endl;
+            std::fclose(file);
+            file = nullptr;
+            return false;
+        }
+
+        if (rolling.files > 0)
+            writeIndex();
+        return true;
+    }
+
+    void PcapngWriter::closeFile()
+    {
+        if (nullptr == file)
+            return;
+
+        std::fclose(file);
+        file = nullptr;
+        if (0 == rolling.files)
+            return;
+
+        // 删除超出数量的最旧文件，保留数据的起始时间随之后移
+        files.emplace_back(current);
+        while (files.size() > rolling.files) {
+            std::remove(files.front().path.c_str());
+            files.pop_front();
+            retainedSince = files.front().firstTimestamp;
+        }
+        writeIndex();
+    }
+
+    std::string PcapngWriter::getIndexPath() const
+    {
+        std::string stem, extension;
+        splitPath(basePath, stem, extension);
+        return stem + "_index.csv";
+    }
+
+    void PcapngWriter::writeIndex() const
+    {
+        std::ofstream index(getIndexPath(), std::ios::out | std::ios::trunc);
+        if (!index.is_open())
+            return;
+
+        // 每行一个文件：路径、第一个包和最后一个包的时间戳（纳秒）、包数，最后一行为正在写入的文件
+        index << "file,firstTimestamp,lastTimestamp,packets" << std::endl;
+        for (const auto& info : files) {
+            index << info.path << "," << info.firstTimestamp << "," << info.lastTimestamp
+                  << "," << info.packets << std::endl;
+        }
+        if (file) {
+            index << current.path << "," << current.firstTimestamp << "," << current.lastTimestamp
+                  << "," << current.packets << std::endl;
+        }
+    }
+
+    void PcapngWriter::updateIndex()
+    {
+        if (0 == rolling.files)
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - indexWritten < std::chrono::milliseconds(PCAPNG_FLUSH_INTERVAL))
+            return;
+        indexWritten = now;
+        writeIndex();
+    }
+
+    void PcapngWriter::removeRollingFiles() const
+    {
+        // 索引中记录了上次保留的全部文件
+        std::ifstream index(getIndexPath());
+        std::string line;
+        if (index.is_open() && std::getline(index, line)) {
+            while (std::getline(index, line)) {
+                auto comma = line.find(',');
+                if ((comma != std::string::npos) && (comma > 0))
+                    std::remove(line.substr(0, comma).c_str());
+            }
+        }
+        index.close();
+        std::remove(getIndexPath().c_str());
+
+        // 没有索引时文件从 1 开始连续编号
+        for (uint32_t number = 1; 0 == std::remove(getFilePath(number).c_str()); ++number) {
+        }
+    }
+
+    bool PcapngWriter::open(const std::string& path, const std::vector<PcapngInterfaceInfo>& interfaces,
+                            const PcapngRollingInfo& rollingInfo, bool isBlockingMode)
+    {
+        close();
+
+        header.clear();
+        std::vector<uint8_t> body;
+        appendUint32(body, PcapngByteOrderMagic);
+        appendUint16(body, 1);
+        appendUint16(body, 0);
+        int64_t sectionLength{ -1 };
+        appendValue(body, &sectionLength, sizeof(sectionLength));
+        const char* application = "fkcap";
+        appendOption(body, PcapngOptionShbUserAppl, application, std::strlen(application));
+        appendOption(body, PcapngOptionEnd, nullptr, 0);
+        appendBlock(header, PcapngSectionHeaderBlock, body);
+
+        for (const auto& info : interfaces) {
+            body.clear();
+            appendUint16(body, PcapngLinkTypeEthernet);
+            appendUint16(body, 0);
+            appendUint32(body, info.snapLength);
+            if (!info.name.empty())
+                appendOption(body, PcapngOptionIfName, info.name.data(), info.name.size());
+            if (!info.description.empty())
+                appendOption(body, PcapngOptionIfDescription, info.description.data(), info.description.size());
+            // PacketInfo 的时间戳为纳秒
+            appendOption(body, PcapngOptionIfTsresol, &PcapngTimestampNanoseconds, sizeof(PcapngTimestampNanoseconds));
+            appendOption(body, PcapngOptionEnd, nullptr, 0);
+            appendBlock(header, PcapngInterfaceDescriptionBlock, body);
+        }
+
+        basePath = path;
+        rolling = rollingInfo;
+        fileNumber = 0;
+        files.clear();
+        retainedSince = 0;
+        if (rolling.files > 0)
+            removeRollingFiles();
+        indexWritten = std::chrono::steady_clock::now();
+        if (!openFile())
+            return false;
+
+        {
+            std::lock_guard<std::mutex> lock(bufferMutex);
+            buffer = PcapngBuffer();
+            buffer.data.reserve(PCAPNG_BUFFER_SIZE);
+            fileBytes = header.size();
+            fileStart = 0;
+            fullBuffers.clear();
+            isBlocking = isBlockingMode;
+            isStopping = false;
+        }
+        interfaceCount = interfaces.size();
+        packets = 0;
+        dropped = 0;
+        writer = std::thread(&PcapngWriter::writeFile, this);
+        isOpened = true;
+        return true;
+    }
+
+    bool PcapngWriter::isOpen() const
+    {
+        return isOpened;
+    }
+
+    bool PcapngWriter::reserve(std::unique_lock<std::mutex>& lock, size_t length, bool isFileEnd)
+    {
+        if (!isFileEnd && (buffer.data.size() + length <= buffer.data.capacity()))
+            return true;
+
+        // 写文件线程落后太多时限制内存占用，实时抓包不能阻塞抓包线程，丢弃并计数，读取离线文件时等待
+        if (fullBuffers.size() >= PCAPNG_BUFFER_COUNT) {
+            if (!isBlocking)
+                return false;
+            bufferCondition.wait(lock, [this]() { return (fullBuffers.size() < PCAPNG_BUFFER_COUNT) || isStopping; });
+        }
+
+        swapBuffer(length, isFileEnd);
+        return true;
+    }
+
+    void PcapngWriter::swapBuffer(size_t length, bool isFileEnd)
+    {
+        buffer.isFileEnd = isFileEnd;
+        fullBuffers.emplace_back(std::move(buffer));
+        buffer = PcapngBuffer();
+        if (!freeBuffers.empty()) {
+            buffer.data = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+        buffer.data.clear();
+        buffer.data.reserve(std::max<size_t>(PCAPNG_BUFFER_SIZE, length));
+        if (isFileEnd) {
+            fileBytes = header.size();
+            fileStart = 0;
+        }
+        bufferCondition.notify_all();
+    }
+
+    bool PcapngWriter::isFileExpired(uint64_t timestamp) const
+    {
+        if ((0 == rolling.files) || (0 == fileStart) || (0 == rolling.fileDuration))
+            return false;
+
+        if (timestamp >= fileStart + static_cast<uint64_t>(rolling.fileDuration) * 1000000000ULL)
+            return true;
+        // 实时抓包时没有新包到达也按实际经过的时间切换，读取离线文件只按包时间戳
+        return !isBlocking && (std::chrono::steady_clock::now() - fileOpened >= std::chrono::seconds(rolling.fileDuration));
+    }
+
+    void PcapngWriter::write(uint8_t interfaceId, uint64_t timestamp, const uint8_t* data, uint32_t caplen, uint32_t len, uint8_t err)
+    {
+        if (!isOpened || (interfaceId >= interfaceCount))
+            return;
+
+        const char* comment = (PACKET_NO_ERROR != err) ? getPacketErrorName(err) : nullptr;
+        size_t commentLength = comment ? std::strlen(comment) : 0;
+        size_t optionLength = comment ? (4 + padLength(commentLength) + 4) : 0;
+        uint32_t total = static_cast<uint32_t>(12 + 20 + padLength(caplen) + optionLength);
+
+        std::unique_lock<std::mutex> lock(bufferMutex);
+
+        // 滚动模式下当前文件超过大小或时间跨度时切换到下一个文件，至少写入一个包
+        bool isFileEnd = isFileExpired(timestamp);
+        if ((rolling.files > 0) && (fileStart > 0) && (rolling.fileSize > 0)
+            && (fileBytes + total > static_cast<uint64_t>(rolling.fileSize) * 1024 * 1024))
+            isFileEnd = true;
+        if (!reserve(lock, total, isFileEnd)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            CaptureStatistics::Instance().count(STATISTICS_EXPORT_DROPPED);
+            return;
+        }
+
+        auto& out = buffer.data;
+        appendUint32(out, PcapngEnhancedPacketBlock);
+        appendUint32(out, total);
+        appendUint32(out, interfaceId);
+        appendUint32(out, static_cast<uint32_t>(timestamp >> 32));
+        appendUint32(out, static_cast<uint32_t>(timestamp & 0xFFFFFFFF));
+        appendUint32(out, caplen);
+        appendUint32(out, len);
+        appendValue(out, data, caplen);
+        out.resize(out.size() + padLength(caplen) - caplen, 0);
+        if (comment) {
+            appendOption(out, PcapngOptionComment, comment, commentLength);
+            appendOption(out, PcapngOptionEnd, nullptr, 0);
+        }
+        appendUint32(out, total);
+
+        if (0 == buffer.packets)
+            buffer.firstTimestamp = timestamp;
+        buffer.lastTimestamp = timestamp;
+        ++buffer.packets;
+        if (0 == fileStart) {
+            fileStart = timestamp;
+            fileOpened = std::chrono::steady_clock::now();
+        }
+        fileBytes += total;
+        packets.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void PcapngWriter::writeFile()
+    {
+        std::unique_lock<std::mutex> lock(bufferMutex);
+        for (;;) {
+            bufferCondition.wait_for(lock, std::chrono::milliseconds(PCAPNG_FLUSH_INTERVAL),
+                                     [this]() { return !fullBuffers.empty() || isStopping; });
+            if (fullBuffers.empty()) {
+                if (isStopping)
+                    break;
+
+                // 超时仍未写满，把已有的数据写入文件，滚动模式下没有新包也按时间切换文件
+                bool isFileEnd = isFileExpired(0);
+                if (buffer.data.empty() && !isFileEnd) {
+                    lock.unlock();
+                    updateIndex();
+                    lock.lock();
+                    continue;
+                }
+                swapBuffer(0, isFileEnd);
+            }
+
+            PcapngBuffer next = std::move(fullBuffers.front());
+            fullBuffers.pop_front();
+            bufferCondition.notify_all();
+
+            // 写文件时不持有锁，抓包线程继续写入下一个缓冲区
+            lock.unlock();
+            if (file) {
+                if (std::fwrite(next.data.data(), 1, next.data.size(), file) != next.data.size())
+                    std::cerr << "Write pcapng file failed: " << current.path << std::endl;
+            }
+            if (next.packets > 0) {
+                if (0 == current.packets)
+                    current.firstTimestamp = next.firstTimestamp;
+                current.lastTimestamp = next.lastTimestamp;
+                current.packets += next.packets;
+            }
+            if (next.isFileEnd) {
+                closeFile();
+                openFile();
+            }
+            updateIndex();
+            lock.lock();
+
+            if (freeBuffers.size() < 2)
+                freeBuffers.emplace_back(std::move(next.data));
+        }
+    }
+
+    void PcapngWriter::close()
+    {
+        if (!isOpened)
+            return;
+
+        isOpened = false;
+        {
+            std::lock_guard<std::mutex> lock(bufferMutex);
+            if (!buffer.data.empty())
+                fullBuffers.emplace_back(std::move(buffer));
+            buffer = PcapngBuffer();
+            isStopping = true;
+        }
+        bufferCondition.notify_all();
+        if (writer.joinable())
+            writer.join();
+
+        closeFile();
+        std::cout << "pcapng packets : " << packets << ", dropped : " << dropped << std::endl;
+    }
+
+    uint64_t PcapngWriter::getPackets() const
+    {
+        return packets;
+    }
+
+    uint64_t PcapngWriter::getDropped() const
+    {
+        return dropped;
+    }
+
+    uint64_t PcapngWriter::getRetainedSince() const
+    {
+        return retainedSince;
+    }
+}
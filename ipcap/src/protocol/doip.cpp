@@ -1,6 +1,7 @@
 ﻿// ipcap.cpp: 定义应用程序的入口点。
 //
 
+#include <algorithm>
 #include "protocol/doip.h"
 #include "packet.h"
 #include <WinSock2.h>
@@ -37,7 +38,7 @@ namespace figkey {
         uint8_t inverseVersion;
         DoIPPayloadType payloadType;
         uint32_t payloadLength;
-        std::vector<uint8_t> data;
+        const uint8_t* data{ nullptr };     // 指向原始数据中的 DOIP 消息，不拷贝
 
         bool isValid() const { return DoIPHeaderNackCode::None == nack; }
 
@@ -156,9 +157,9 @@ namespace figkey {
         }
 
         // 解析 DOIP 数据包
-        static DoIPPacket parse(const std::vector<uint8_t>& packet, bool isTCP = true) {
+        static DoIPPacket parse(const uint8_t* packet, size_t length, bool isTCP = true) {
             DoIPPacket doipPacket;
-            if (packet.size() < DoIPHeaderLength) {
+            if (length < DoIPHeaderLength) {
                 return doipPacket;
             }
 
@@ -177,13 +178,13 @@ namespace figkey {
                 return doipPacket;
             }
 
-            if (packet.size() < DoIPHeaderLength + doipPacket.payloadLength) {
+            if (length < DoIPHeaderLength + static_cast<uint64_t>(doipPacket.payloadLength)) {
                 doipPacket.nack = DoIPHeaderNackCode::InvalidPayloadLength;
                 return doipPacket;
             }
 
             doipPacket.nack = DoIPHeaderNackCode::None;
-            doipPacket.data.assign(packet.begin(), packet.begin() + DoIPHeaderLength + doipPacket.payloadLength);
+            doipPacket.data = packet;
             return doipPacket;
         }
     };
@@ -196,24 +197,125 @@ namespace figkey {
     {
 	}
 
-    bool DoIPPacketParse::parse(uint8_t& protocol, const std::vector<uint8_t>& packet)
+    bool DoIPPacketParse::parse(uint8_t& protocol, const uint8_t* packet, size_t length)
     {
 		bool isTCP{ true };
 		// TCP 或 UDP 头解析
         if (protocol == PROTOCOL_TYPE_UDP)
 			isTCP = false;
 
-		auto doipPacket = DoIPPacket::parse(packet, isTCP);
+		auto doipPacket = DoIPPacket::parse(packet, length, isTCP);
 		// TODO: 处理解析后的 DOIP 数据包
 		if (!doipPacket.isValid())
 			return false;
 
-        std::vector<uint8_t> payload(doipPacket.data.begin()+ DoIPHeaderLength, doipPacket.data.end());
-        if (UDSPacketParse::Instance().parse(doipPacket.payloadType, payload))
+        if (UDSPacketParse::Instance().parse(doipPacket.payloadType, doipPacket.data + DoIPHeaderLength, doipPacket.payloadLength))
              protocol = PROTOCOL_TYPE_UDS;
         else
              protocol = PROTOCOL_TYPE_DOIP;
 
 		return true;
 	}
+
+    // 报头的版本和载荷类型有效时返回 true，载荷可以尚未收到
+    static bool checkStreamHeader(const uint8_t* header, uint32_t& payloadLength)
+    {
+        auto doipPacket = DoIPPacket::parse(header, DoIPHeaderLength, true);
+        if (!doipPacket.isValid() && (DoIPHeaderNackCode::InvalidPayloadLength != doipPacket.nack))
+            return false;
+
+        payloadLength = doipPacket.payloadLength;
+        return true;
+    }
+
+    // 优先级 UDS > DOIP > TCP
+    static void mergeStreamProtocol(uint8_t& result, uint8_t protocol)
+    {
+        if ((PROTOCOL_TYPE_UDS == protocol) || (PROTOCOL_TYPE_TCP == result))
+            result = protocol;
+    }
+
+    static uint8_t parseStreamMessage(const uint8_t* data, size_t length)
+    {
+        uint8_t protocol{ PROTOCOL_TYPE_TCP };
+        if (!DoIPPacketParse::Instance().parse(protocol, data, length))
+            return PROTOCOL_TYPE_DOIP;
+        return protocol;
+    }
+
+    uint8_t DoIPStreamFramer::feed(const uint8_t* data, size_t length)
+    {
+        uint8_t result{ PROTOCOL_TYPE_TCP };
+        while (length > 0) {
+            if (skipLength > 0) {
+                size_t count = static_cast<size_t>(std::min<uint64_t>(skipLength, length));
+                skipLength -= count;
+                data += count;
+                length -= count;
+                mergeStreamProtocol(result, PROTOCOL_TYPE_DOIP);
+                continue;
+            }
+
+            uint32_t payloadLength{ 0 };
+            // 没有跨分段的消息且整条消息都在本段内时直接解析，不拷贝
+            if (message.empty() && (length >= DoIPHeaderLength)) {
+                if (!checkStreamHeader(data, payloadLength))
+                    return result;
+
+                uint64_t total = DoIPHeaderLength + static_cast<uint64_t>(payloadLength);
+                if (length >= total) {
+                    mergeStreamProtocol(result, parseStreamMessage(data, static_cast<size_t>(total)));
+                    data += total;
+                    length -= static_cast<size_t>(total);
+                    continue;
+                }
+            }
+
+            if (message.size() < DoIPHeaderLength) {
+                size_t count = std::min<size_t>(DoIPHeaderLength - message.size(), length);
+                message.insert(message.end(), data, data + count);
+                data += count;
+                length -= count;
+                if (message.size() < DoIPHeaderLength)
+                    break;
+
+                // 报头错误说明不在消息边界上，丢弃到分段结束
+                if (!checkStreamHeader(message.data(), payloadLength)) {
+                    message.clear();
+                    return result;
+                }
+
+                if (DoIPHeaderLength + static_cast<uint64_t>(payloadLength) > DOIP_STREAM_MESSAGE_MAX) {
+                    skipLength = payloadLength;
+                    message.clear();
+                    mergeStreamProtocol(result, PROTOCOL_TYPE_DOIP);
+                    continue;
+                }
+
+                messageLength = DoIPHeaderLength + payloadLength;
+                message.reserve(messageLength);
+            }
+
+            size_t count = std::min<size_t>(messageLength - message.size(), length);
+            message.insert(message.end(), data, data + count);
+            data += count;
+            length -= count;
+            mergeStreamProtocol(result, PROTOCOL_TYPE_DOIP);
+
+            if (message.size() == messageLength) {
+                mergeStreamProtocol(result, parseStreamMessage(message.data(), messageLength));
+                message.clear();
+            }
+        }
+
+        return result;
+    }
+
+    void DoIPStreamFramer::reset()
+    {
+        message.clear();
+        message.shrink_to_fit();
+        messageLength = 0;
+        skipLength = 0;
+    }
 }
@@ -0,0 +1,244 @@
+﻿// fragment.cpp: IPv4 分片重组
+//
+
+#include <WinSock2.h>
+#include <algorithm>
+#include <cstring>
+#include "protocol/fragment.h"
+#include "checksum.h"
+#include "stats.h"
+
+namespace figkey {
+
+    static const uint64_t FragmentTimeout{ static_cast<uint64_t>(FRAGMENT_TIMEOUT) * 1000000000ULL };
+    static const uint64_t FragmentSweepInterval{ 1000000000ULL };
+    static const uint16_t FragmentMoreFlag{ 0x2000 };
+    static const uint16_t FragmentOffsetMask{ 0x1FFF };
+
+    FragmentReassembler::FragmentReassembler()
+    {
+    }
+
+    FragmentReassembler::~FragmentReassembler()
+    {
+    }
+
+    void FragmentReassembler::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        datagrams.clear();
+        memoryUsed = 0;
+        lastSweep = 0;
+    }
+
+    FragmentReassembler::DatagramMap::iterator FragmentReassembler::discard(DatagramMap::iterator it)
+    {
+        CaptureStatistics::Instance().count(STATISTICS_FRAGMENT_DROPPED, it->second.fragments);
+        memoryUsed -= it->second.payload.size() + it->second.heldBytes;
+        return datagrams.erase(it);
+    }
+
+    void FragmentReassembler::sweep(uint64_t now)
+    {
+        lastSweep = now;
+        for (auto it = datagrams.begin(); it != datagrams.end();) {
+            if (it->second.firstTimestamp + FragmentTimeout < now)
+                it = discard(it);
+            else
+                ++it;
+        }
+    }
+
+    bool FragmentReassembler::discardOldest(DatagramMap::iterator current)
+    {
+        auto oldest = datagrams.end();
+        for (auto entry = datagrams.begin(); entry != datagrams.end(); ++entry) {
+            if ((entry != current) && ((oldest == datagrams.end()) || (entry->second.firstTimestamp < oldest->second.firstTimestamp)))
+                oldest = entry;
+        }
+        if (oldest == datagrams.end())
+            return false;
+
+        discard(oldest);
+        return true;
+    }
+
+    void FragmentReassembler::insert(FragmentDatagram& datagram, const uint8_t* data, uint32_t offset, uint32_t end)
+    {
+        auto& ranges = datagram.ranges;
+        auto it = ranges.begin();
+        uint32_t position = offset;
+        while (position < end) {
+            // 跳过终点不超过当前位置的区间
+            while ((it != ranges.end()) && (it->second <= position))
+                ++it;
+
+            uint32_t gapEnd = end;
+            if (it != ranges.end()) {
+                if (it->first <= position) {
+                    position = it->second;
+                    continue;
+                }
+                gapEnd = (std::min)(end, it->first);
+            }
+
+            memcpy(datagram.payload.data() + position, data + (position - offset), gapEnd - position);
+            datagram.received += gapEnd - position;
+            position = gapEnd;
+        }
+
+        // 合并与 [offset, end) 相交或相邻的区间
+        auto first = ranges.begin();
+        while ((first != ranges.end()) && (first->second < offset))
+            ++first;
+        auto last = first;
+        while ((last != ranges.end()) && (last->first <= end)) {
+            offset = (std::min)(offset, last->first);
+            end = (std::max)(end, last->second);
+            ++last;
+        }
+        first = ranges.erase(first, last);
+        ranges.insert(first, std::make_pair(offset, end));
+    }
+
+    bool FragmentReassembler::process(const uint8_t* packet, uint32_t caplen, uint32_t len, uint64_t timestamp, uint8_t interfaceId,
+                                      bool isHold, FragmentResult& result)
+    {
+        // 不加锁先判断是否为 IPv4 分片，绝大多数数据包在这里返回
+        uint32_t size = caplen;
+        if (size < ETHERNET_IPV4_HEADER_MIN)
+            return false;
+        const ethernet_header* eth = reinterpret_cast<const ethernet_header*>(packet);
+        const ip_header* iph = reinterpret_cast<const ip_header*>(packet + sizeof(ethernet_header));
+        if (0x0800 != ntohs(eth->type))
+            return false;
+        uint16_t flagsOffset = ntohs(iph->iph_offset);
+        if (0 == (flagsOffset & (FragmentMoreFlag | FragmentOffsetMask)))
+            return false;
+
+        // 被截断的分片无法重组，按原来的方式解析
+        uint32_t headerLength = (iph->ihl_and_version & 0x0F) * 4;
+        uint32_t totalLength = ntohs(iph->iph_len);
+        if ((headerLength < sizeof(ip_header)) || (totalLength <= headerLength)
+            || (sizeof(ethernet_header) + totalLength > size))
+            return false;
+
+        bool isMore = (0 != (flagsOffset & FragmentMoreFlag));
+        uint32_t offset = static_cast<uint32_t>(flagsOffset & FragmentOffsetMask) * 8;
+        uint32_t length = totalLength - headerLength;
+        uint32_t end = offset + length;
+        const uint8_t* data = packet + sizeof(ethernet_header) + headerLength;
+
+        FragmentKey key;
+        memcpy(&key.srcIP, &iph->iph_sourceip, sizeof(key.srcIP));
+        memcpy(&key.destIP, &iph->iph_destip, sizeof(key.destIP));
+        key.id = iph->iph_ident;
+        key.protocol = iph->iph_protocol;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (timestamp > lastSweep + FragmentSweepInterval)
+            sweep(timestamp);
+
+        auto it = datagrams.find(key);
+        if (it == datagrams.end()) {
+            // 表满时丢弃最早的数据报
+            if (datagrams.size() >= FRAGMENT_DATAGRAM_MAX)
+                discardOldest(datagrams.end());
+            it = datagrams.emplace(key, FragmentDatagram()).first;
+            it->second.firstTimestamp = timestamp;
+        }
+
+        FragmentDatagram& entry = it->second;
+        entry.fragments++;
+
+        // 非最后分片的长度必须是 8 的倍数，最后分片确定的总长度不能变化，
+        // 按重建时使用的第一个分片的头部长度计算，重组后不能超过 IP 包的最大长度
+        size_t rebuiltHeaderLength = (0 == offset) ? headerLength
+                                     : (entry.header.empty() ? headerLength : entry.header.size() - sizeof(ethernet_header));
+        bool isValid = !(isMore && (length % 8))
+                       && (rebuiltHeaderLength + (std::max)(static_cast<size_t>(end), entry.payload.size()) <= 0xFFFF)
+                       && (isMore || (0 == entry.totalLength) || (end == entry.totalLength))
+                       && ((0 == entry.totalLength) || (end <= entry.totalLength))
+                       && (isMore || (entry.payload.size() <= end));
+        if (isValid && (end > entry.payload.size())) {
+            // 缓存满时丢弃最早的其他数据报，新到的分片优先
+            size_t growth = end - entry.payload.size();
+            while ((memoryUsed + growth > FRAGMENT_MEMORY_MAX) && discardOldest(it)) {
+            }
+            isValid = (memoryUsed + growth <= FRAGMENT_MEMORY_MAX);
+            if (isValid) {
+                memoryUsed += growth;
+                entry.payload.resize(end);
+            }
+        }
+        if (!isValid) {
+            discard(it);
+            return true;
+        }
+
+        if (!isMore)
+            entry.totalLength = end;
+        if (0 == offset) {
+            entry.header.assign(packet, data);
+            // 端口在传输层头的前 4 个字节，其他协议没有端口
+            if (!entry.hasPorts && ((IPPROTO_TCP == key.protocol) || (IPPROTO_UDP == key.protocol)) && (length >= 4)) {
+                entry.srcPort = ntohs(*reinterpret_cast<const uint16_t*>(data));
+                entry.destPort = ntohs(*reinterpret_cast<const uint16_t*>(data + 2));
+            }
+            entry.hasPorts = true;
+        }
+        insert(entry, data, offset, end);
+
+        if (entry.hasPorts) {
+            result.hasPorts = true;
+            result.srcPort = entry.srcPort;
+            result.destPort = entry.destPort;
+            if (!entry.held.empty()) {
+                result.released.swap(entry.held);
+                memoryUsed -= entry.heldBytes;
+                entry.heldBytes = 0;
+            }
+        }
+        else if (isHold) {
+            // 端口未知时无法判断是否符合过滤条件，拷贝原始帧等待第一个分片
+            while ((memoryUsed + size > FRAGMENT_MEMORY_MAX) && discardOldest(it)) {
+            }
+            if (memoryUsed + size > FRAGMENT_MEMORY_MAX) {
+                discard(it);
+                return true;
+            }
+
+            FragmentFrame frame;
+            frame.timestamp = timestamp;
+            frame.len = len;
+            frame.interfaceId = interfaceId;
+            frame.data.assign(packet, packet + size);
+            entry.held.emplace_back(std::move(frame));
+            entry.heldBytes += size;
+            memoryUsed += size;
+            result.isHeld = true;
+        }
+
+        // 收齐时一定已收到第一个分片，暂存的分片已全部交回
+        if ((0 == entry.totalLength) || (entry.received < entry.totalLength) || entry.header.empty())
+            return true;
+
+        auto& datagram = result.datagram;
+        // 以第一个分片的头部重建不分片的 IP 包
+        datagram.reserve(entry.header.size() + entry.totalLength);
+        datagram.assign(entry.header.begin(), entry.header.end());
+        datagram.insert(datagram.end(), entry.payload.begin(), entry.payload.end());
+
+        ip_header* header = reinterpret_cast<ip_header*>(datagram.data() + sizeof(ethernet_header));
+        size_t ipHeaderLength = entry.header.size() - sizeof(ethernet_header);
+        header->iph_len = htons(static_cast<uint16_t>(ipHeaderLength + entry.totalLength));
+        header->iph_offset = 0;
+        header->iph_chksum = 0;
+        header->iph_chksum = static_cast<uint16_t>(~checksumFold(checksumAdd(reinterpret_cast<const uint8_t*>(header), ipHeaderLength)));
+
+        memoryUsed -= entry.payload.size();
+        datagrams.erase(it);
+        return true;
+    }
+
+}  // namespace figkey
@@ -3,9 +3,16 @@
 
 #include "protocol/ip.h"
 #include "protocol/doip.h"
+#include "protocol/tcp.h"
+#include "protocol/fragment.h"
+#include "flow.h"
+#include "dispatch.h"
+#include "arena.h"
 #include "common/thread_pool.hpp"
 #include "packet.h"
 #include "config.h"
+#include "stats.h"
+#include "pcapng.h"
 
 namespace figkey {
 
@@ -22,109 +29,159 @@ namespace figkey {
         packetCallBack = callback;
     }
 
-    bool IPPacketParse::checkFilterInfo(const PacketInfo& packet, const FilterInfo& filter) {
-        if (!filter.ip.empty()) {
-            if (filter.ip != packet.srcIP && filter.ip != packet.destIP) return false;
+    bool IPPacketParse::checkPacket(const struct pcap_pkthdr* pkthdr, const u_char* packet, PacketInfo&& info,
+                                    const u_char* parsed, uint32_t parsedLength) {
+        const PacketFilter& filter = CaptureConfig::Instance().getPacketFilter();
+        auto& stats = CaptureStatistics::Instance();
+
+        // 头部字段已按二进制解析，不符合用户过滤条件的包在协议识别和拷贝之前丢弃；
+        // 更换 BPF 之前捕获的数据包按时间戳在用户态比较全部条件，分片按所属数据报的端口比较
+        info.timestamp = parsePacketTimestamp(pkthdr->ts);
+        bool isFragment = (nullptr == parsed) || (parsed != packet);
+        if (!filter.matchHeader(info, isFragment)) {
+            stats.count(STATISTICS_FILTERED);
+            return false;
         }
-        else {
-            if (!filter.srcIP.empty() && filter.srcIP != packet.srcIP) return false;
-            if (!filter.destIP.empty() && filter.destIP != packet.destIP) return false;
+
+        // 连接键使用识别 DoIP 之前的传输层协议，同一连接的 TCP 和 DoIP 分段属于同一连接
+        bool isReverse{ false };
+        FlowKey key = makeFlowKey(info, isReverse);
+
+        // TCP 按连接重组后识别跨分段的 DoIP 消息，不带负载的 SYN/FIN/RST 也用于维护连接状态
+        if (nullptr == parsed) {
+            // 未收齐的分片没有完整的传输层头，只按 IP 头过滤
         }
-        if (!filter.srcMAC.empty() && filter.srcMAC != packet.srcMAC) return false;
-        if (!filter.destMAC.empty() && filter.destMAC != packet.destMAC) return false;
-        if (0 != filter.port) {
-            if (filter.port != packet.srcPort && filter.port != packet.destPort) return false;
+        else if (PROTOCOL_TYPE_TCP == info.protocolType)
+            info.protocolType = TcpReassembler::Instance().process(parsed, info, key, isReverse);
+        else if (info.payloadLength > 0)
+            DoIPPacketParse::Instance().parse(info.protocolType, parsed + info.payloadOffset, info.payloadLength);
+        if (!filter.matchProtocol(info.protocolType)){
+            stats.count(STATISTICS_FILTERED);
+            return false;
         }
-        else {
-            if (filter.srcPort != 0 && filter.srcPort != packet.srcPort) return false;
-            if (filter.destPort != 0 && filter.destPort != packet.destPort) return false;
+
+        // 连接表同时检测 TCP 异常，新设置的错误码在这里计数；分片组成的数据报按一个包统计
+        if (nullptr != parsed) {
+            uint8_t err = info.err;
+            uint32_t length = (parsed == packet) ? pkthdr->len : parsedLength;
+            info.flowId = FlowTable::Instance().update(key, isReverse, parsed, info, length);
+            if (err != info.err)
+                stats.countError(info.err);
         }
 
-        // 当滤波器的 minLen 不为零时做最小长度过滤
-        if (filter.minLen != 0) {
-            if (packet.payloadLength < filter.minLen) return false;
+        // 重组的数据报只用于识别，保存的是最后一个分片的原始帧，负载为该分片携带的部分
+        if ((nullptr != parsed) && (parsed != packet)) {
+            PacketInfo fragment = parseIpFragment(packet, pkthdr->caplen);
+            info.transportOffset = fragment.transportOffset;
+            info.payloadOffset = fragment.payloadOffset;
+            info.payloadLength = fragment.payloadLength;
         }
-        // 当滤波器的 maxLen 不为零时做最大长度过滤
-        if (filter.maxLen != 0) {
-            if (packet.payloadLength > filter.maxLen) return false;
+
+        PcapngWriter& writer = PcapngWriter::Instance();
+        if (writer.isOpen())
+            writer.write(info.interfaceId, info.timestamp, packet, pkthdr->caplen, pkthdr->len, info.err);
+
+        // 只保存原始数据，字符串在界面显示或导出时生成
+        info.dataLength = pkthdr->caplen;
+        PacketDispatcher& dispatcher = PacketDispatcher::Instance();
+        if (dispatcher.isEnabled()) {
+            dispatcher.push(std::move(info), packet);
+        }
+        else if (packetCallBack) {
+            // 线程池中的任务无序执行，写入后立即释放，读取时由 arena 校验数据是否已被覆盖
+            PacketArena& arena = PacketArena::Instance();
+            if (arena.append(info.interfaceId, packet, info.dataLength, info.dataOffset))
+                arena.release(info.interfaceId, info.dataOffset + info.dataLength);
+            else
+                info.dataLength = 0;
+
+            opensource::ctrlfrmb::ThreadPool& pool = opensource::ctrlfrmb::ThreadPool::Instance();
+            pool.submit(packetCallBack, info);
+            stats.count(STATISTICS_ENQUEUED);
         }
 
         return true;
     }
 
-    bool IPPacketParse::checkFilterProtocol(uint8_t protocl, const FilterInfo& filter) {
-        if (PROTOCOL_TYPE_DEFAULT == filter.protocolType)
-            return true;
+    bool IPPacketParse::parse(const struct pcap_pkthdr* pkthdr, const u_char* packet, uint8_t interfaceId)
+    {
+        auto& stats = CaptureStatistics::Instance();
+        if (pkthdr->caplen < ETHERNET_IP_UDP_HEADER_MIN) {
+            stats.count(STATISTICS_SHORT_FRAME);
+            return false;
+        }
 
-        if (protocl == filter.protocolType)
+        // 有端口过滤时，第一个分片之前到达的分片由重组类暂存，端口确定后再按端口过滤
+        FragmentResult fragment;
+        bool isHold = CaptureConfig::Instance().getPacketFilter().hasPortFilter();
+        if (!FragmentReassembler::Instance().process(packet, pkthdr->caplen, pkthdr->len, parsePacketTimestamp(pkthdr->ts),
+                                                     interfaceId, isHold, fragment))
+            return parseFrame(pkthdr, packet, interfaceId, nullptr, false);
+
+        stats.count(STATISTICS_FRAGMENTED);
+        for (const auto& frame : fragment.released) {
+            struct pcap_pkthdr header {};
+            header.ts.tv_sec = static_cast<long>(frame.timestamp / 1000000000ULL);
+            header.ts.tv_usec = static_cast<long>(frame.timestamp % 1000000000ULL / 1000ULL);
+            header.caplen = static_cast<uint32_t>(frame.data.size());
+            header.len = frame.len;
+            parseFrame(&header, frame.data.data(), frame.interfaceId, &fragment, true);
+        }
+        if (fragment.isHeld)
             return true;
 
-        if ((PROTOCOL_TYPE_DOIP == filter.protocolType) && (protocl >= filter.protocolType))
-            return true;
-        return false;
+        return parseFrame(pkthdr, packet, interfaceId, &fragment, false);
     }
 
-    bool IPPacketParse::checkPacket(const struct pcap_pkthdr* pkthdr, PacketInfo&& info, std::vector<uint8_t>&& payload) {
-
-        if (!checkFilterInfo(info, CaptureConfig::Instance().getConfigInfo().filter)) {
-            //std::cout << "filter " << info.srcIP << " -> "<< info.destIP << std::endl;
-            return false;
+    bool IPPacketParse::parseFrame(const struct pcap_pkthdr* pkthdr, const u_char* packet, uint8_t interfaceId,
+                                   const FragmentResult* fragment, bool isReleased)
+    {
+        auto& stats = CaptureStatistics::Instance();
+
+        // IPv4 分片都按原始帧保存和导出；收齐的最后一个分片按重组的数据报识别协议，其余分片只解析到 IP 头
+        const std::vector<uint8_t>* datagram = ((nullptr != fragment) && !isReleased && !fragment->datagram.empty())
+                                               ? &fragment->datagram : nullptr;
+        const u_char* parsed = datagram ? datagram->data() : packet;
+        uint32_t parsedLength = datagram ? static_cast<uint32_t>(datagram->size()) : pkthdr->caplen;
+        bool isPartial = (nullptr != fragment) && (nullptr == datagram);
+
+        // 一个以太网帧只承载一个 IP 包，帧尾的填充字节不再当作下一个包解析
+        PacketInfo info = isPartial ? parseIpFragment(packet, pkthdr->caplen) : parseIpPacket(parsed, parsedLength);
+        // 非第一个分片没有传输层头，使用第一个分片中的端口
+        if (isPartial && fragment->hasPorts) {
+            info.srcPort = fragment->srcPort;
+            info.destPort = fragment->destPort;
         }
-
-        if (!payload.empty())
-            DoIPPacketParse::Instance().parse(info.protocolType, payload);
-        if (!checkFilterProtocol(info.protocolType, CaptureConfig::Instance().getConfigInfo().filter)){
-            //std::cout << "filter by protocol " << info.srcIP << " -> "<< info.destIP <<", "<<static_cast<int>(info.payloadLength)<< std::endl;
-            //if (!payload.empty())
-            //    std::cout << parsePayloadToHexString(payload) << std::endl;
+        if (0 == info.payloadOffset) {
+            std::cerr << "Fatal error: " << getPacketErrorName(info.err) << std::endl;
+            stats.count(STATISTICS_PARSE_FAILED);
+            stats.countError(info.err);
             return false;
         }
 
-        info.timestamp = parsePacketTimestamp(pkthdr->ts);
-        info.data = parsePayloadToHexString(payload);
-
-        if (packetCallBack) {
-            opensource::ctrlfrmb::ThreadPool& pool = opensource::ctrlfrmb::ThreadPool::Instance();
-            pool.submit(packetCallBack, info);
+        if (static_cast<uint32_t>(info.payloadOffset) + info.payloadLength > parsedLength) {
+            std::cerr << "Fatal error: IP package is incomplete!!! capture length: " << parsedLength << std::endl;
+            stats.count(STATISTICS_PARSE_FAILED);
+            stats.countError(PACKET_IP_TOTAL_LENGTH_ERROR);
+            return false;
         }
 
-        return true;
-    }
+        info.interfaceId = interfaceId;
 
-    bool IPPacketParse::parse(const struct pcap_pkthdr* pkthdr, const u_char* packet)
-    {
-        uint32_t offset {0};
-        uint32_t len {pkthdr->caplen};
-
-        while (len >= ETHERNET_IP_UDP_HEADER_MIN)
-        {
-            PacketInfo info = parseIpPacket(packet+offset, len);
-            if (0 == info.index) {
-                std::cerr << "Fatal error: " << info.data << std::endl;
-                return false;
-            }
-
-            offset += static_cast<uint32_t>(info.index);
-            std::vector<uint8_t> payload(packet+offset, packet+(offset+info.payloadLength));
-            offset += info.payloadLength;
-            len -= offset;
-            if (info.protocolType < PROTOCOL_TYPE_TCP) {
-                std::cerr << "Fatal error: " << info.data << std::endl;
-                continue;
-            }
-
-            checkPacket(pkthdr, std::move(info), std::move(payload));
+        // 可选的头部和校验和校验，错误的包照常保存，只在错误码中标记；未收齐的分片只校验 IP 头
+        const CaptureConfigInfo& config = CaptureConfig::Instance().getConfigInfo();
+        if (config.validateHeaders && (PACKET_NO_ERROR == info.err)) {
+            if (isPartial)
+                info.err = checkIpHeader(reinterpret_cast<const ip_header*>(packet + sizeof(ethernet_header)),
+                                         pkthdr->caplen - sizeof(ethernet_header), config.checksumOffload);
+            else
+                info.err = validatePacket(parsed, parsedLength, info, config.checksumOffload);
         }
 
-        if (len != 0) {
-            //cache.clear();
-            //if ((offset+len) != pkthdr->caplen)
-                //cache.assign(packet+offset, packet+(pkthdr->caplen-1));
-            //else
-                //std::cerr << "Fatal error: IP package is incomplete!!! remaining length: "<<len <<" capture length: "<<pkthdr->caplen<<" must length: " <<pkthdr->len << std::endl;
-            return false;
-        }
+        stats.count(STATISTICS_PARSED);
+        if (PACKET_NO_ERROR != info.err)
+            stats.countError(info.err);
 
-        return true;
+        return checkPacket(pkthdr, packet, std::move(info), isPartial ? nullptr : parsed, parsedLength);
     }
 }
@@ -0,0 +1,234 @@
+﻿// tcp.cpp: TCP 流重组
+//
+
+#include <WinSock2.h>
+#include "protocol/tcp.h"
+
+namespace figkey {
+
+    static const uint64_t TcpIdleTimeout{ static_cast<uint64_t>(TCP_REASSEMBLY_IDLE_TIMEOUT) * 1000000000ULL };
+    static const uint64_t TcpSweepInterval{ 1000000000ULL };
+
+    // 序号按 2^32 回绕比较
+    static int32_t compareSeq(uint32_t a, uint32_t b)
+    {
+        return static_cast<int32_t>(a - b);
+    }
+
+    TcpReassembler::TcpReassembler()
+        : totalBytes(0)
+    {
+    }
+
+    TcpReassembler::~TcpReassembler()
+    {
+    }
+
+    void TcpReassembler::clear()
+    {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.flows.clear();
+            shard.lastSweep = 0;
+        }
+        totalBytes = 0;
+    }
+
+    void TcpReassembler::resetStream(TcpStream& stream)
+    {
+        stream.pending.clear();
+        stream.pendingBytes = 0;
+        stream.framer.reset();
+    }
+
+    void TcpReassembler::sweep(Shard& shard, uint64_t now)
+    {
+        shard.lastSweep = now;
+        for (auto it = shard.flows.begin(); it != shard.flows.end();) {
+            if (it->second.lastSeen + TcpIdleTimeout < now)
+                it = eraseFlow(shard, it);
+            else
+                ++it;
+        }
+    }
+
+    size_t TcpReassembler::getFlowBytes(const TcpFlow& flow)
+    {
+        size_t bytes{ 0 };
+        for (const auto& stream : flow.streams)
+            bytes += stream.pendingBytes + stream.framer.getBufferedBytes();
+        return bytes;
+    }
+
+    std::unordered_map<FlowKey, TcpReassembler::TcpFlow, FlowKeyHash>::iterator TcpReassembler::eraseFlow(
+        Shard& shard, std::unordered_map<FlowKey, TcpFlow, FlowKeyHash>::iterator it)
+    {
+        totalBytes.fetch_sub(it->second.bytes);
+        return shard.flows.erase(it);
+    }
+
+    void TcpReassembler::updateBytes(Shard& shard, TcpFlow& flow)
+    {
+        size_t bytes = getFlowBytes(flow);
+        if (bytes >= flow.bytes)
+            totalBytes.fetch_add(bytes - flow.bytes);
+        else
+            totalBytes.fetch_sub(flow.bytes - bytes);
+        flow.bytes = bytes;
+
+        // 只在持有锁的分片中淘汰，不锁其他分片；其他分片的缓存在其下一个分段到达时同样受此限制
+        while (totalBytes.load() > TCP_REASSEMBLY_MEMORY_MAX) {
+            auto oldest = shard.flows.end();
+            for (auto it = shard.flows.begin(); it != shard.flows.end(); ++it) {
+                if ((&it->second == &flow) || (0 == it->second.bytes))
+                    continue;
+                if ((oldest == shard.flows.end()) || (it->second.lastSeen < oldest->second.lastSeen))
+                    oldest = it;
+            }
+
+            if (oldest != shard.flows.end()) {
+                eraseFlow(shard, oldest);
+                continue;
+            }
+
+            // 没有其他可以释放的连接，本连接放弃缺口，从下一个分段重新同步
+            for (auto& stream : flow.streams) {
+                resetStream(stream);
+                stream.isSynced = false;
+            }
+            totalBytes.fetch_sub(flow.bytes);
+            flow.bytes = 0;
+            break;
+        }
+    }
+
+    void TcpReassembler::drainPending(TcpStream& stream)
+    {
+        bool isFound{ true };
+        while (isFound && !stream.pending.empty()) {
+            isFound = false;
+            for (auto it = stream.pending.begin(); it != stream.pending.end(); ++it) {
+                int32_t offset = compareSeq(it->first, stream.nextSeq);
+                if (offset > 0)
+                    continue;
+
+                // 起点不晚于期望序号，超出已交付部分的数据继续分帧
+                uint32_t length = static_cast<uint32_t>(it->second.size());
+                uint32_t skip = static_cast<uint32_t>(-offset);
+                if (skip < length) {
+                    stream.framer.feed(it->second.data() + skip, length - skip);
+                    stream.nextSeq += length - skip;
+                }
+
+                stream.pendingBytes -= length;
+                stream.pending.erase(it);
+                isFound = true;
+                break;
+            }
+        }
+    }
+
+    uint8_t TcpReassembler::deliver(TcpStream& stream, uint32_t seq, const uint8_t* data, uint32_t length)
+    {
+        // 抓包开始时连接已建立，从第一个看到的分段开始
+        if (!stream.isSynced) {
+            stream.isSynced = true;
+            stream.nextSeq = seq;
+        }
+
+        int32_t offset = compareSeq(seq, stream.nextSeq);
+        if (offset < 0) {
+            // 重传：已交付的部分不再分帧
+            uint32_t skip = static_cast<uint32_t>(-offset);
+            if (skip >= length)
+                return stream.protocol;
+            data += skip;
+            length -= skip;
+        }
+        else if (offset > 0) {
+            if (stream.pendingBytes + length <= TCP_REASSEMBLY_PENDING_MAX) {
+                // 乱序：等待缺失的数据
+                auto& segment = stream.pending[seq];
+                if (segment.size() < length) {
+                    stream.pendingBytes += length - segment.size();
+                    segment.assign(data, data + length);
+                }
+                return stream.protocol;
+            }
+
+            // 缺失的数据超过缓存上限，放弃缺口从本分段重新同步
+            resetStream(stream);
+            stream.nextSeq = seq;
+        }
+
+        stream.protocol = stream.framer.feed(data, length);
+        stream.nextSeq += length;
+        if (!stream.pending.empty())
+            drainPending(stream);
+
+        return stream.protocol;
+    }
+
+    uint8_t TcpReassembler::process(const uint8_t* packet, const PacketInfo& info, const FlowKey& key, bool isReverse)
+    {
+        const tcp_header* tcph = reinterpret_cast<const tcp_header*>(packet + info.transportOffset);
+        uint32_t seq = ntohl(tcph->th_seq);
+        uint8_t flags = tcph->th_flags;
+
+        Shard& shard = shards[FlowKeyHash()(key) % TCP_REASSEMBLY_SHARDS];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (info.timestamp > shard.lastSweep + TcpSweepInterval)
+            sweep(shard, info.timestamp);
+
+        auto it = shard.flows.find(key);
+        if (it == shard.flows.end()) {
+            // 连接已关闭后的分段不再建立重组状态
+            if ((0 == info.payloadLength) && (flags & (TCP_FLAG_FIN | TCP_FLAG_RST)))
+                return PROTOCOL_TYPE_TCP;
+            // 连接数达到上限时不重组，按单个分段识别，完整包含在分段中的 DoIP 消息仍能识别
+            if (shard.flows.size() >= TCP_REASSEMBLY_FLOW_MAX / TCP_REASSEMBLY_SHARDS) {
+                uint8_t protocol{ PROTOCOL_TYPE_TCP };
+                if (info.payloadLength > 0)
+                    DoIPPacketParse::Instance().parse(protocol, packet + info.payloadOffset, info.payloadLength);
+                return protocol;
+            }
+            it = shard.flows.emplace(key, TcpFlow()).first;
+        }
+
+        TcpFlow& flow = it->second;
+        TcpStream& stream = flow.streams[isReverse ? 1 : 0];
+        flow.lastSeen = info.timestamp;
+
+        uint8_t protocol{ PROTOCOL_TYPE_TCP };
+        if (flags & TCP_FLAG_SYN) {
+            // 新连接，SYN 占用一个序号
+            resetStream(stream);
+            stream.isSynced = true;
+            stream.isFinished = false;
+            stream.nextSeq = seq + 1;
+            stream.protocol = PROTOCOL_TYPE_TCP;
+            if (info.payloadLength > 0)
+                protocol = deliver(stream, seq + 1, packet + info.payloadOffset, info.payloadLength);
+        }
+        else if (info.payloadLength > 0) {
+            protocol = deliver(stream, seq, packet + info.payloadOffset, info.payloadLength);
+        }
+
+        if (flags & TCP_FLAG_RST) {
+            eraseFlow(shard, it);
+            return protocol;
+        }
+        if (flags & TCP_FLAG_FIN) {
+            stream.isFinished = true;
+            if (flow.streams[0].isFinished && flow.streams[1].isFinished) {
+                eraseFlow(shard, it);
+                return protocol;
+            }
+        }
+
+        updateBytes(shard, flow);
+        return protocol;
+    }
+
+}  // namespace figkey
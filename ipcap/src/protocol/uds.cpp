@@ -18,12 +18,12 @@ namespace figkey {
         // 初始化服务 SID 表，包含图片中的所有有效 SID
         static const std::unordered_set<uint8_t> validSids;
         // 检查是否为 UDS 数据
-        static bool isUdsData(DoIPPayloadType payloadType, const std::vector<uint8_t>& data) {
+        static bool isUdsData(DoIPPayloadType payloadType, const uint8_t* data, size_t length) {
             // 这里可以添加更详细的 UDS 数据检查逻辑
             switch (payloadType) {
             case DoIPPayloadType::DiagnosticMessage:
                 // 这里进行 UDS 数据格式的具体校验
-                if (data.empty() || (data.size() <= DoIPUDSHeaderLength)) {
+                if (!data || (length <= DoIPUDSHeaderLength)) {
                     return false;
                 }
                 return true;
@@ -37,9 +37,9 @@ namespace figkey {
     private:
 
         // 检查数据是否为 UDS 数据
-        static bool checkUdsDataFormat(const std::vector<uint8_t>& data) {
-            std::cout<<"uds: "<< parsePayloadToHexString(data)<<std::endl;
-            if (data.empty() || (data.size() <= DoIPUDSHeaderLength)) {
+        static bool checkUdsDataFormat(const uint8_t* data, size_t length) {
+            std::cout<<"uds: "<< parsePayloadToHexString(data, length)<<std::endl;
+            if (!data || (length <= DoIPUDSHeaderLength)) {
                 return false;
             }
             uint8_t sid = data[DoIPUDSHeaderLength];  // 第一个字节是 SID
@@ -80,9 +80,9 @@ namespace figkey {
     {
 	}
 
-    bool UDSPacketParse::parse(DoIPPayloadType type, const std::vector<uint8_t>& packet)
+    bool UDSPacketParse::parse(DoIPPayloadType type, const uint8_t* packet, size_t length)
     {
-		if (!UDSChecker::isUdsData(type, packet))
+		if (!UDSChecker::isUdsData(type, packet, length))
 			return false;
 
 		return true;
@@ -0,0 +1,129 @@
+﻿// stats.cpp: 抓包统计
+//
+
+#include <fstream>
+#include <sstream>
+#include "stats.h"
+
+namespace figkey {
+
+    CaptureStatistics::CaptureStatistics()
+    {
+        reset();
+    }
+
+    CaptureStatistics::~CaptureStatistics()
+    {
+    }
+
+    void CaptureStatistics::count(STATISTICS_COUNTER counter, uint64_t value)
+    {
+        if (counter < STATISTICS_COUNTER_MAX)
+            counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void CaptureStatistics::countError(uint8_t err)
+    {
+        if (err < STATISTICS_ERROR_CODE_MAX)
+            errors[err].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void CaptureStatistics::setPcapStatistics(uint32_t received, uint32_t dropped, uint32_t ifDropped)
+    {
+        pcapReceived.store(received, std::memory_order_relaxed);
+        pcapDropped.store(dropped, std::memory_order_relaxed);
+        pcapIfDropped.store(ifDropped, std::memory_order_relaxed);
+    }
+
+    void CaptureStatistics::reset()
+    {
+        pcapReceived = 0;
+        pcapDropped = 0;
+        pcapIfDropped = 0;
+        for (auto& counter : counters)
+            counter = 0;
+        for (auto& error : errors)
+            error = 0;
+    }
+
+    CaptureStatisticsInfo CaptureStatistics::getStatistics() const
+    {
+        CaptureStatisticsInfo info;
+        info.pcapReceived = pcapReceived.load(std::memory_order_relaxed);
+        info.pcapDropped = pcapDropped.load(std::memory_order_relaxed);
+        info.pcapIfDropped = pcapIfDropped.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < STATISTICS_COUNTER_MAX; ++i)
+            info.counter[i] = counters[i].load(std::memory_order_relaxed);
+        for (size_t i = 0; i < STATISTICS_ERROR_CODE_MAX; ++i)
+            info.parseError[i] = errors[i].load(std::memory_order_relaxed);
+        return info;
+    }
+
+    const char* CaptureStatistics::getCounterName(uint8_t counter)
+    {
+        switch (counter) {
+        case STATISTICS_CAPTURED: return "captured";
+        case STATISTICS_PAUSED: return "paused";
+        case STATISTICS_SNAP_DROPPED: return "snapDropped";
+        case STATISTICS_SHORT_FRAME: return "shortFrame";
+        case STATISTICS_FRAGMENTED: return "fragmented";
+        case STATISTICS_FRAGMENT_DROPPED: return "fragmentDropped";
+        case STATISTICS_PARSED: return "parsed";
+        case STATISTICS_PARSE_FAILED: return "parseFailed";
+        case STATISTICS_FILTERED: return "filtered";
+        case STATISTICS_ENQUEUED: return "enqueued";
+        case STATISTICS_RING_DROPPED: return "ringDropped";
+        case STATISTICS_EXPORT_DROPPED: return "exportDropped";
+        case STATISTICS_STORED: return "stored";
+        case STATISTICS_STORE_FAILED: return "storeFailed";
+        case STATISTICS_DISPLAYED: return "displayed";
+        case STATISTICS_DISPLAY_DROPPED: return "displayDropped";
+        default: break;
+        }
+
+        return "unknown";
+    }
+
+    std::string CaptureStatistics::dump() const
+    {
+        auto info = getStatistics();
+
+        std::ostringstream out;
+        out << "{\"pcap\":{\"received\":" << info.pcapReceived
+            << ",\"dropped\":" << info.pcapDropped
+            << ",\"ifDropped\":" << info.pcapIfDropped << "}";
+
+        out << ",\"pipeline\":{";
+        for (size_t i = 0; i < STATISTICS_COUNTER_MAX; ++i) {
+            if (i > 0)
+                out << ",";
+            out << "\"" << getCounterName(static_cast<uint8_t>(i)) << "\":" << info.counter[i];
+        }
+        out << "}";
+
+        // 只输出出现过的错误码，键为 PACKET_ERROR 的数值
+        out << ",\"errors\":{";
+        bool first{ true };
+        for (size_t i = 0; i < STATISTICS_ERROR_CODE_MAX; ++i) {
+            if (0 == info.parseError[i])
+                continue;
+            if (!first)
+                out << ",";
+            out << "\"" << i << "\":" << info.parseError[i];
+            first = false;
+        }
+        out << "}}";
+
+        return out.str();
+    }
+
+    bool CaptureStatistics::dumpFile(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+
+        file << dump() << std::endl;
+        return file.good();
+    }
+}
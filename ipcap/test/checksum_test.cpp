@@ -0,0 +1,97 @@
+﻿// checksum_test.cpp: 反码校验和
+//
+
+#include <WinSock2.h>
+#include <cstring>
+#include <vector>
+#include "checksum.h"
+#include "test.h"
+
+using namespace figkey;
+
+// 按网络字节序逐字累加的参考实现
+static uint16_t referenceSum(const uint8_t* data, size_t length, uint32_t sum = 0)
+{
+    for (size_t i = 0; i < length; i += 2) {
+        uint32_t word = static_cast<uint32_t>(data[i]) << 8;
+        if (i + 1 < length)
+            word |= data[i + 1];
+        sum += word;
+    }
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<uint16_t>(sum);
+}
+
+TEST_CASE(checksumRfc1071)
+{
+    // RFC 1071 4.1 节的例子，反码和为 0xddf2
+    const uint8_t data[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+    CHECK(htons(0xddf2) == checksumFold(checksumAdd(data, sizeof(data))));
+
+    // 末尾奇数字节按高字节补零，0xddf2 + 0xab00 进位回卷为 0x88f3
+    const uint8_t odd[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7, 0xab };
+    CHECK(htons(0x88f3) == checksumFold(checksumAdd(odd, sizeof(odd))));
+}
+
+TEST_CASE(checksumIpHeader)
+{
+    uint8_t header[] = { 0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+                         0xb8, 0x61, 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7 };
+    // 带校验和的头部反码和为全 1
+    CHECK(0xFFFF == checksumFold(checksumAdd(header, sizeof(header))));
+
+    header[10] = 0;
+    header[11] = 0;
+    uint16_t checksum = static_cast<uint16_t>(~checksumFold(checksumAdd(header, sizeof(header))));
+    CHECK(0xb8 == reinterpret_cast<const uint8_t*>(&checksum)[0]);
+    CHECK(0x61 == reinterpret_cast<const uint8_t*>(&checksum)[1]);
+}
+
+TEST_CASE(checksumLongBuffer)
+{
+    // 覆盖按块累加和末尾不足一块的部分，以及各种长度和起始地址
+    std::vector<uint8_t> data(70000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<uint8_t>(0xFF - (i * 13) % 7);
+
+    const size_t lengths[] = { 0, 1, 2, 3, 31, 32, 33, 63, 64, 65, 1499, 1500, 65535, 69999 };
+    for (size_t length : lengths) {
+        for (size_t start = 0; start < 2; ++start) {
+            uint16_t expected = referenceSum(data.data() + start, length);
+            CHECK(htons(expected) == checksumFold(checksumAdd(data.data() + start, length)));
+        }
+    }
+
+    // 分段累加，只有最后一段的长度为奇数
+    uint64_t sum = checksumAdd(data.data(), 1000);
+    sum = checksumAdd(data.data() + 1000, 34, sum);
+    sum = checksumAdd(data.data() + 1034, 4565, sum);
+    CHECK(htons(referenceSum(data.data(), 5599)) == checksumFold(sum));
+}
+
+TEST_CASE(checksumPseudo)
+{
+    PacketInfo info;
+    info.ipVersion = 4;
+    const uint8_t srcIP[] = { 192, 168, 0, 1 };
+    const uint8_t destIP[] = { 192, 168, 0, 199 };
+    memcpy(info.srcIP, srcIP, sizeof(srcIP));
+    memcpy(info.destIP, destIP, sizeof(destIP));
+
+    // IPv4 伪首部：源地址、目的地址、0、协议、长度
+    const uint8_t pseudo[] = { 192, 168, 0, 1, 192, 168, 0, 199, 0, 17, 0x00, 0x5f };
+    CHECK(htons(referenceSum(pseudo, sizeof(pseudo))) == checksumFold(checksumPseudoHeader(info, 17, 0x5f)));
+
+    // IPv6 伪首部：源地址、目的地址、32 位长度、3 字节 0、下一个头
+    info.ipVersion = 6;
+    for (int i = 0; i < PACKET_IP_ADDRESS_LENGTH; ++i) {
+        info.srcIP[i] = static_cast<uint8_t>(0xfe + i);
+        info.destIP[i] = static_cast<uint8_t>(0x20 * i + 1);
+    }
+    std::vector<uint8_t> pseudo6(info.srcIP, info.srcIP + PACKET_IP_ADDRESS_LENGTH);
+    pseudo6.insert(pseudo6.end(), info.destIP, info.destIP + PACKET_IP_ADDRESS_LENGTH);
+    const uint8_t tail[] = { 0x00, 0x01, 0x23, 0x45, 0, 0, 0, 6 };
+    pseudo6.insert(pseudo6.end(), tail, tail + sizeof(tail));
+    CHECK(htons(referenceSum(pseudo6.data(), pseudo6.size())) == checksumFold(checksumPseudoHeader(info, 6, 0x12345)));
+}
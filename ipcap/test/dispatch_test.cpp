@@ -0,0 +1,113 @@
+﻿// dispatch_test.cpp: 批量投递和多网卡按时间戳合并
+//
+
+#include <mutex>
+#include <vector>
+#include "arena.h"
+#include "dispatch.h"
+#include "packet.h"
+#include "test.h"
+
+using namespace figkey;
+
+struct DispatchResult {
+    std::mutex mutex;
+    std::vector<PacketInfo> packets;
+    std::vector<std::vector<uint8_t>> payloads;
+    bool isPayloadValid{ true };
+};
+
+static void startDispatcher(DispatchResult& result, size_t sources)
+{
+    PacketArena::Instance().clear(sources);
+    PacketDispatcher& dispatcher = PacketDispatcher::Instance();
+    // 回调期间 arena 中的数据仍然有效，返回后才释放
+    dispatcher.setCallback([&result](std::vector<PacketInfo> batch) {
+        std::lock_guard<std::mutex> lock(result.mutex);
+        for (auto& info : batch) {
+            std::vector<uint8_t> data;
+            result.isPayloadValid = PacketArena::Instance().read(info.interfaceId, info.dataOffset, info.dataLength, data)
+                                    && result.isPayloadValid;
+            result.payloads.push_back(data);
+            result.packets.push_back(info);
+        }
+    });
+    dispatcher.start(sources, true);
+}
+
+static void pushPacket(uint8_t interfaceId, uint64_t timestamp)
+{
+    uint8_t frame[64];
+    for (size_t i = 0; i < sizeof(frame); ++i)
+        frame[i] = static_cast<uint8_t>(timestamp + i);
+
+    PacketInfo info;
+    info.index = timestamp;
+    info.timestamp = timestamp;
+    info.interfaceId = interfaceId;
+    info.dataLength = sizeof(frame);
+    PacketDispatcher::Instance().push(std::move(info), frame);
+}
+
+TEST_CASE(dispatchSingle)
+{
+    DispatchResult result;
+    startDispatcher(result, 1);
+    for (uint64_t i = 1; i <= 1000; ++i)
+        pushPacket(0, i);
+    PacketDispatcher::Instance().stop();
+    PacketDispatcher::Instance().setCallback(nullptr);
+
+    CHECK(0 == PacketDispatcher::Instance().getDropped());
+    REQUIRE(1000 == result.packets.size());
+    CHECK(result.isPayloadValid);
+    bool isOrdered{ true };
+    for (size_t i = 0; i < result.packets.size(); ++i) {
+        isOrdered = isOrdered && (i + 1 == result.packets[i].timestamp);
+        isOrdered = isOrdered && (static_cast<uint8_t>(i + 1) == result.payloads[i][0]);
+    }
+    CHECK(isOrdered);
+}
+
+TEST_CASE(dispatchMerge)
+{
+    DispatchResult result;
+    startDispatcher(result, 3);
+
+    // 每个网卡内时间戳递增，网卡之间交错，合并后整体按时间戳排列
+    const uint64_t count{ 3000 };
+    for (uint64_t i = 1; i <= count; ++i)
+        pushPacket(static_cast<uint8_t>((i * 7 / 5) % 3), i);
+    PacketDispatcher::Instance().stop();
+    PacketDispatcher::Instance().setCallback(nullptr);
+
+    CHECK(0 == PacketDispatcher::Instance().getDropped());
+    REQUIRE(count == result.packets.size());
+    CHECK(result.isPayloadValid);
+    bool isOrdered{ true };
+    size_t perInterface[3]{};
+    for (size_t i = 0; i < result.packets.size(); ++i) {
+        const PacketInfo& info = result.packets[i];
+        isOrdered = isOrdered && (i + 1 == info.timestamp);
+        isOrdered = isOrdered && (static_cast<uint8_t>(info.timestamp) == result.payloads[i][0]);
+        perInterface[info.interfaceId]++;
+    }
+    CHECK(isOrdered);
+    CHECK(perInterface[0] > 0);
+    CHECK(perInterface[1] > 0);
+    CHECK(perInterface[2] > 0);
+}
+
+TEST_CASE(dispatchInvalidInterface)
+{
+    DispatchResult result;
+    startDispatcher(result, 1);
+    pushPacket(1, 1);
+    pushPacket(0, 2);
+    PacketDispatcher::Instance().stop();
+    PacketDispatcher::Instance().setCallback(nullptr);
+
+    CHECK(1 == PacketDispatcher::Instance().getDropped());
+    REQUIRE(1 == result.packets.size());
+    CHECK(2 == result.packets[0].timestamp);
+}
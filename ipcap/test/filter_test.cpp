@@ -0,0 +1,147 @@
+﻿// filter_test.cpp: BPF 表达式生成和用户态过滤
+//
+
+#include "filter.h"
+#include "packet.h"
+#include "test.h"
+
+using namespace figkey;
+
+static const std::string FragmentCondition{ " or (ip[6:2] & 0x1fff != 0))" };
+
+TEST_CASE(captureFilterEmpty)
+{
+    CHECK("(udp or tcp)" == buildCaptureFilter(FilterInfo(), "udp or tcp"));
+}
+
+TEST_CASE(captureFilterHostPort)
+{
+    FilterInfo filter;
+    filter.ip = "192.168.1.10";
+    filter.port = 13400;
+    // 端口条件放行不带端口的后续分片
+    CHECK("(tcp) and host 192.168.1.10 and ((port 13400)" + FragmentCondition == buildCaptureFilter(filter, "tcp"));
+
+    // 设置了 ip 和 port 时忽略源、目的条件
+    filter.srcIP = "10.0.0.1";
+    filter.srcPort = 1;
+    CHECK("(tcp) and host 192.168.1.10 and ((port 13400)" + FragmentCondition == buildCaptureFilter(filter, "tcp"));
+}
+
+TEST_CASE(captureFilterSourceDestination)
+{
+    FilterInfo filter;
+    filter.srcIP = "10.0.0.1";
+    filter.destIP = "10.0.0.2";
+    filter.srcMAC = "00-1A-2B-3C-4D-5E";
+    filter.destMAC = "66:77:88:99:aa:bb";
+    filter.srcPort = 50000;
+    filter.destPort = 13400;
+    CHECK("(udp or tcp) and src host 10.0.0.1 and dst host 10.0.0.2"
+          " and ether src 00:1a:2b:3c:4d:5e and ether dst 66:77:88:99:aa:bb"
+          " and ((src port 50000 and dst port 13400)" + FragmentCondition == buildCaptureFilter(filter, "udp or tcp"));
+
+    filter.srcPort = 0;
+    CHECK("(udp or tcp) and src host 10.0.0.1 and dst host 10.0.0.2"
+          " and ether src 00:1a:2b:3c:4d:5e and ether dst 66:77:88:99:aa:bb"
+          " and ((dst port 13400)" + FragmentCondition == buildCaptureFilter(filter, "udp or tcp"));
+}
+
+TEST_CASE(captureFilterInvalid)
+{
+    // 无法解析的地址返回空字符串，由调用方退回到用户态过滤
+    FilterInfo filter;
+    filter.ip = "192.168.1.300";
+    CHECK(buildCaptureFilter(filter, "tcp").empty());
+
+    filter = FilterInfo();
+    filter.destMAC = "00:11:22:33:44";
+    CHECK(buildCaptureFilter(filter, "tcp").empty());
+
+    // 负载长度和协议类型不下推
+    filter = FilterInfo();
+    filter.minLen = 10;
+    filter.protocolType = PROTOCOL_TYPE_DOIP;
+    CHECK("(tcp)" == buildCaptureFilter(filter, "tcp"));
+}
+
+static PacketInfo makeInfo(const char* srcIP, const char* destIP, uint16_t srcPort, uint16_t destPort)
+{
+    PacketInfo info;
+    parseIpAddress(srcIP, info.srcIP, info.ipVersion);
+    parseIpAddress(destIP, info.destIP, info.ipVersion);
+    info.srcPort = srcPort;
+    info.destPort = destPort;
+    info.payloadLength = 100;
+    return info;
+}
+
+TEST_CASE(packetFilterHeader)
+{
+    FilterInfo filter;
+    filter.ip = "192.168.1.10";
+    filter.port = 13400;
+    PacketFilter packetFilter(filter);
+    CHECK(packetFilter.hasPortFilter());
+
+    CHECK(packetFilter.matchHeader(makeInfo("192.168.1.10", "192.168.1.20", 50000, 13400)));
+    CHECK(packetFilter.matchHeader(makeInfo("192.168.1.20", "192.168.1.10", 13400, 50000)));
+    CHECK(!packetFilter.matchHeader(makeInfo("192.168.1.20", "192.168.1.30", 50000, 13400)));
+    CHECK(!packetFilter.matchHeader(makeInfo("192.168.1.10", "192.168.1.20", 50000, 50001)));
+
+    // 负载长度范围
+    filter = FilterInfo();
+    filter.minLen = 10;
+    filter.maxLen = 100;
+    PacketFilter lengthFilter(filter);
+    CHECK(!lengthFilter.hasPortFilter());
+    auto info = makeInfo("10.0.0.1", "10.0.0.2", 1, 2);
+    CHECK(lengthFilter.matchHeader(info));
+    info.payloadLength = 9;
+    CHECK(!lengthFilter.matchHeader(info));
+    info.payloadLength = 101;
+    CHECK(!lengthFilter.matchHeader(info));
+}
+
+TEST_CASE(packetFilterKernel)
+{
+    FilterInfo filter;
+    filter.srcIP = "10.0.0.1";
+    filter.destPort = 13400;
+    filter.minLen = 1;
+    PacketFilter packetFilter(filter);
+    packetFilter.setKernelFiltered(true, 1000);
+    CHECK(packetFilter.isKernelFiltered());
+
+    // BPF 安装之前捕获的包仍比较全部条件
+    auto info = makeInfo("10.0.0.9", "10.0.0.2", 50000, 80);
+    info.timestamp = 999;
+    CHECK(!packetFilter.matchHeader(info));
+
+    // 之后的包地址和端口已由驱动过滤，只比较负载长度
+    info.timestamp = 1000;
+    CHECK(packetFilter.matchHeader(info));
+    info.payloadLength = 0;
+    CHECK(!packetFilter.matchHeader(info));
+
+    // BPF 放行全部后续分片，分片的端口总在用户态比较
+    info.payloadLength = 100;
+    CHECK(!packetFilter.matchHeader(info, true));
+    info.destPort = 13400;
+    CHECK(packetFilter.matchHeader(info, true));
+}
+
+TEST_CASE(packetFilterProtocol)
+{
+    FilterInfo filter;
+    CHECK(PacketFilter(filter).matchProtocol(PROTOCOL_TYPE_UDP));
+
+    filter.protocolType = PROTOCOL_TYPE_DOIP;
+    PacketFilter doipFilter(filter);
+    CHECK(doipFilter.matchProtocol(PROTOCOL_TYPE_DOIP));
+    CHECK(doipFilter.matchProtocol(PROTOCOL_TYPE_UDS));
+    CHECK(!doipFilter.matchProtocol(PROTOCOL_TYPE_TCP));
+
+    filter.protocolType = PROTOCOL_TYPE_TCP;
+    CHECK(!PacketFilter(filter).matchProtocol(PROTOCOL_TYPE_DOIP));
+}
@@ -0,0 +1,129 @@
+﻿// flow_test.cpp: 连接表的查找和后移删除
+//
+
+#include <algorithm>
+#include <vector>
+#include "flow.h"
+#include "test.h"
+
+using namespace figkey;
+
+static const uint64_t Second{ 1000000000ULL };
+
+static PacketInfo makeUdpInfo(uint32_t index, uint64_t timestamp)
+{
+    PacketInfo info;
+    info.timestamp = timestamp;
+    info.ipVersion = 4;
+    info.protocolType = PROTOCOL_TYPE_UDP;
+    info.srcIP[0] = 10;
+    info.srcIP[2] = static_cast<uint8_t>(index >> 8);
+    info.srcIP[3] = static_cast<uint8_t>(index);
+    info.destIP[0] = 10;
+    info.destIP[3] = 200;
+    info.srcPort = static_cast<uint16_t>(40000 + index);
+    info.destPort = 13400;
+    return info;
+}
+
+static uint32_t updateFlow(uint32_t index, uint64_t timestamp)
+{
+    PacketInfo info = makeUdpInfo(index, timestamp);
+    bool isReverse{ false };
+    FlowKey key = makeFlowKey(info, isReverse);
+    return FlowTable::Instance().update(key, isReverse, nullptr, info, 100);
+}
+
+TEST_CASE(flowKeyDirection)
+{
+    PacketInfo info = makeUdpInfo(1, 0);
+    bool isReverse{ true };
+    FlowKey key = makeFlowKey(info, isReverse);
+    CHECK(!isReverse);
+
+    // 反方向的包得到同一个键
+    std::swap(info.srcPort, info.destPort);
+    uint8_t ip[PACKET_IP_ADDRESS_LENGTH];
+    std::copy(info.srcIP, info.srcIP + PACKET_IP_ADDRESS_LENGTH, ip);
+    std::copy(info.destIP, info.destIP + PACKET_IP_ADDRESS_LENGTH, info.srcIP);
+    std::copy(ip, ip + PACKET_IP_ADDRESS_LENGTH, info.destIP);
+    bool isReverse2{ false };
+    CHECK(key == makeFlowKey(info, isReverse2));
+    CHECK(isReverse2);
+    CHECK(FlowKeyHash()(key) == FlowKeyHash()(makeFlowKey(info, isReverse2)));
+}
+
+TEST_CASE(flowTableUpdate)
+{
+    FlowTable& table = FlowTable::Instance();
+    table.clear();
+
+    uint32_t id = updateFlow(1, Second);
+    CHECK(1 == id);
+    CHECK(id == updateFlow(1, 2 * Second));
+    CHECK(2 == updateFlow(2, 2 * Second));
+
+    auto flows = table.getFlows();
+    REQUIRE(2 == flows.size());
+    CHECK(1 == flows[0].id);
+    CHECK(2 == flows[0].packets[0]);
+    CHECK(200 == flows[0].bytes[0]);
+    CHECK(Second == flows[0].firstTimestamp);
+    CHECK(2 * Second == flows[0].lastTimestamp);
+}
+
+TEST_CASE(flowTableBackwardShift)
+{
+    FlowTable& table = FlowTable::Instance();
+    table.clear();
+
+    // 交替插入两组连接，负载较高时探测链上两组相邻，
+    // 之后只让奇数组空闲超时，删除时偶数组需要后移填补空位
+    const uint32_t count{ 9000 };
+    const uint64_t start{ Second };
+    std::vector<uint32_t> ids(count);
+    for (uint32_t i = 0; i < count; ++i)
+        ids[i] = updateFlow(i, start);
+    REQUIRE(0 == table.getUntracked());
+    for (uint32_t i = 0; i < count; ++i)
+        REQUIRE(i + 1 == ids[i]);
+
+    const uint64_t refreshed = start + 60 * Second;
+    for (uint32_t i = 0; i < count; i += 2)
+        CHECK(ids[i] == updateFlow(i, refreshed));
+
+    // 每个分片的第一个包触发清理，删除奇数组后偶数组仍能找到原来的连接
+    const uint64_t expired = start + (FLOW_TABLE_IDLE_TIMEOUT + 5) * Second;
+    bool isFound{ true };
+    for (uint32_t i = 0; i < count; i += 2)
+        isFound = isFound && (ids[i] == updateFlow(i, expired));
+    CHECK(isFound);
+
+    auto flows = table.getFlows();
+    size_t active = std::count_if(flows.begin(), flows.end(), [](const FlowInfo& info) { return 3 == info.packets[0] + info.packets[1]; });
+    CHECK(count / 2 == active);
+
+    // 奇数组已删除，再次出现时是新的连接
+    CHECK(count + 1 == updateFlow(1, expired));
+    CHECK(ids[0] == updateFlow(0, expired));
+}
+
+TEST_CASE(flowTableFull)
+{
+    FlowTable& table = FlowTable::Instance();
+    table.clear();
+
+    // 分片满时不跟踪并计数，已有的连接不受影响
+    uint32_t untracked{ 0 };
+    for (uint32_t i = 0; i < FLOW_TABLE_SHARDS * FLOW_TABLE_SHARD_SLOTS; ++i) {
+        if (0 == updateFlow(i, Second))
+            ++untracked;
+    }
+    CHECK(untracked > 0);
+    CHECK(untracked == table.getUntracked());
+    CHECK(1 == updateFlow(0, Second));
+
+    table.clear();
+    CHECK(0 == table.getUntracked());
+    CHECK(1 == updateFlow(0, Second));
+}
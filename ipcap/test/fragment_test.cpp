@@ -0,0 +1,174 @@
+﻿// fragment_test.cpp: IPv4 分片重组的乱序、重叠、暂存和超时
+//
+
+#include <WinSock2.h>
+#include <cstring>
+#include <vector>
+#include "protocol/fragment.h"
+#include "checksum.h"
+#include "stats.h"
+#include "test.h"
+
+using namespace figkey;
+
+static const uint64_t Second{ 1000000000ULL };
+static const size_t FrameHeaderLength{ sizeof(ethernet_header) + sizeof(ip_header) };
+
+// 数据报的 IP 负载，前 4 个字节为 UDP 源端口 50000 和目的端口 13400
+static std::vector<uint8_t> makeDatagram(uint32_t length, uint8_t seed)
+{
+    std::vector<uint8_t> payload(length);
+    for (uint32_t i = 0; i < length; ++i)
+        payload[i] = static_cast<uint8_t>(seed + i * 3);
+    const uint8_t ports[] = { 0xc3, 0x50, 0x34, 0x58 };
+    memcpy(payload.data(), ports, sizeof(ports));
+    return payload;
+}
+
+// 以 payload 中 [offset, offset + length) 构造一个分片的以太网帧
+static std::vector<uint8_t> makeFragment(const std::vector<uint8_t>& payload, uint16_t id, uint32_t offset, uint32_t length, bool isMore)
+{
+    std::vector<uint8_t> frame(FrameHeaderLength + length);
+    ethernet_header* eth = reinterpret_cast<ethernet_header*>(frame.data());
+    eth->type = htons(0x0800);
+
+    ip_header* iph = reinterpret_cast<ip_header*>(frame.data() + sizeof(ethernet_header));
+    iph->ihl_and_version = 0x45;
+    iph->iph_len = htons(static_cast<uint16_t>(sizeof(ip_header) + length));
+    iph->iph_ident = htons(id);
+    iph->iph_offset = htons(static_cast<uint16_t>((isMore ? 0x2000 : 0) | (offset / 8)));
+    iph->iph_ttl = 64;
+    iph->iph_protocol = 17;
+    iph->iph_sourceip = htonl(0x0a000001);
+    iph->iph_destip = htonl(0x0a000002);
+    memcpy(frame.data() + FrameHeaderLength, payload.data() + offset, length);
+    return frame;
+}
+
+static bool processFragment(const std::vector<uint8_t>& frame, uint64_t timestamp, FragmentResult& result, bool isHold = false)
+{
+    result = FragmentResult();
+    return FragmentReassembler::Instance().process(frame.data(), static_cast<uint32_t>(frame.size()), static_cast<uint32_t>(frame.size()),
+                                                   timestamp, 0, isHold, result);
+}
+
+TEST_CASE(fragmentNotFragment)
+{
+    FragmentReassembler::Instance().clear();
+    auto payload = makeDatagram(100, 1);
+    auto frame = makeFragment(payload, 1, 0, 100, false);
+
+    FragmentResult result;
+    CHECK(!processFragment(frame, Second, result));
+
+    // 截断的分片不重组
+    frame = makeFragment(payload, 1, 0, 96, true);
+    frame.resize(frame.size() - 1);
+    CHECK(!processFragment(frame, Second, result));
+}
+
+TEST_CASE(fragmentOutOfOrder)
+{
+    FragmentReassembler::Instance().clear();
+    auto payload = makeDatagram(3000, 7);
+
+    FragmentResult result;
+    CHECK(processFragment(makeFragment(payload, 2, 1480, 1480, true), Second, result));
+    CHECK(!result.hasPorts);
+    CHECK(result.datagram.empty());
+    CHECK(processFragment(makeFragment(payload, 2, 2960, 40, false), Second, result));
+    CHECK(result.datagram.empty());
+
+    // 第一个分片最后到达，带回端口并完成重组
+    CHECK(processFragment(makeFragment(payload, 2, 0, 1480, true), Second, result));
+    CHECK(result.hasPorts);
+    CHECK(50000 == result.srcPort);
+    CHECK(13400 == result.destPort);
+    REQUIRE(FrameHeaderLength + payload.size() == result.datagram.size());
+    CHECK(0 == memcmp(result.datagram.data() + FrameHeaderLength, payload.data(), payload.size()));
+
+    // 重建的 IP 头不再分片，长度和校验和已更新
+    const ip_header* iph = reinterpret_cast<const ip_header*>(result.datagram.data() + sizeof(ethernet_header));
+    CHECK(sizeof(ip_header) + payload.size() == ntohs(iph->iph_len));
+    CHECK(0 == iph->iph_offset);
+    CHECK(0xFFFF == checksumFold(checksumAdd(reinterpret_cast<const uint8_t*>(iph), sizeof(ip_header))));
+}
+
+TEST_CASE(fragmentOverlap)
+{
+    FragmentReassembler::Instance().clear();
+
+    // 重叠部分保留先到的数据
+    auto first = makeDatagram(48, 0x10);
+    auto second = makeDatagram(48, 0x80);
+    FragmentResult result;
+    CHECK(processFragment(makeFragment(second, 3, 16, 32, false), Second, result));
+    CHECK(processFragment(makeFragment(first, 3, 8, 16, true), Second, result));
+    CHECK(result.datagram.empty());
+    CHECK(processFragment(makeFragment(first, 3, 0, 24, true), Second, result));
+    REQUIRE(FrameHeaderLength + 48 == result.datagram.size());
+
+    const uint8_t* data = result.datagram.data() + FrameHeaderLength;
+    CHECK(0 == memcmp(data, first.data(), 16));
+    CHECK(0 == memcmp(data + 16, second.data() + 16, 32));
+
+    // 与最后分片确定的总长度不一致时丢弃整个数据报
+    uint64_t dropped = CaptureStatistics::Instance().getStatistics().counter[STATISTICS_FRAGMENT_DROPPED];
+    auto payload = makeDatagram(64, 0x20);
+    CHECK(processFragment(makeFragment(payload, 4, 32, 32, false), Second, result));
+    CHECK(processFragment(makeFragment(payload, 4, 8, 48, false), Second, result));
+    CHECK(dropped + 2 == CaptureStatistics::Instance().getStatistics().counter[STATISTICS_FRAGMENT_DROPPED]);
+    CHECK(processFragment(makeFragment(payload, 4, 0, 32, true), Second, result));
+    CHECK(result.datagram.empty());
+}
+
+TEST_CASE(fragmentTimeout)
+{
+    FragmentReassembler::Instance().clear();
+    auto payload = makeDatagram(64, 0x30);
+    uint64_t dropped = CaptureStatistics::Instance().getStatistics().counter[STATISTICS_FRAGMENT_DROPPED];
+
+    FragmentResult result;
+    CHECK(processFragment(makeFragment(payload, 5, 32, 32, false), Second, result));
+
+    // 未超时前补齐可以完成重组
+    CHECK(processFragment(makeFragment(payload, 6, 32, 32, false), Second, result));
+    CHECK(processFragment(makeFragment(payload, 6, 0, 32, true), FRAGMENT_TIMEOUT * Second, result));
+    CHECK(FrameHeaderLength + 64 == result.datagram.size());
+
+    // 超过 FRAGMENT_TIMEOUT 后到达的分片触发清理，原来的数据报不再完成
+    CHECK(processFragment(makeFragment(payload, 5, 0, 32, true), (FRAGMENT_TIMEOUT + 2) * Second, result));
+    CHECK(result.datagram.empty());
+    CHECK(dropped + 1 == CaptureStatistics::Instance().getStatistics().counter[STATISTICS_FRAGMENT_DROPPED]);
+}
+
+TEST_CASE(fragmentHold)
+{
+    FragmentReassembler::Instance().clear();
+    auto payload = makeDatagram(96, 0x40);
+
+    // 端口未知的分片暂存，第一个分片到达后按到达顺序交回
+    FragmentResult result;
+    auto last = makeFragment(payload, 7, 64, 32, false);
+    CHECK(processFragment(last, Second + 1, result, true));
+    CHECK(result.isHeld);
+    CHECK(processFragment(makeFragment(payload, 7, 32, 32, true), Second + 2, result, true));
+    CHECK(result.isHeld);
+
+    CHECK(processFragment(makeFragment(payload, 7, 0, 32, true), Second + 3, result, true));
+    CHECK(!result.isHeld);
+    CHECK(result.hasPorts);
+    CHECK(13400 == result.destPort);
+    REQUIRE(2 == result.released.size());
+    CHECK(Second + 1 == result.released[0].timestamp);
+    CHECK(last == result.released[0].data);
+    CHECK(Second + 2 == result.released[1].timestamp);
+    CHECK(FrameHeaderLength + 96 == result.datagram.size());
+
+    // 第一个分片之后的分片直接带回端口，不再暂存
+    CHECK(processFragment(makeFragment(payload, 8, 0, 32, true), Second, result, true));
+    CHECK(processFragment(makeFragment(payload, 8, 32, 32, true), Second, result, true));
+    CHECK(!result.isHeld);
+    CHECK(result.hasPorts);
+    CHECK(result.released.empty());
+}
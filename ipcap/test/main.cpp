@@ -0,0 +1,33 @@
+﻿// main.cpp: ipcap 单元测试入口，参数为用例名时只运行名称包含该字符串的用例
+//
+
+#include <cstring>
+#include "test.h"
+
+int main(int argc, char* argv[])
+{
+    const char* pattern = (argc > 1) ? argv[1] : nullptr;
+
+    int passed{ 0 };
+    int failed{ 0 };
+    for (const auto& testCase : figkey::test::getTestCases()) {
+        if (pattern && !std::strstr(testCase.name, pattern))
+            continue;
+
+        std::printf("[ RUN  ] %s\n", testCase.name);
+        std::fflush(stdout);
+        figkey::test::getFailures() = 0;
+        testCase.func();
+        if (0 == figkey::test::getFailures()) {
+            std::printf("[   OK ] %s\n", testCase.name);
+            ++passed;
+        }
+        else {
+            std::printf("[ FAIL ] %s\n", testCase.name);
+            ++failed;
+        }
+    }
+
+    std::printf("%d passed, %d failed\n", passed, failed);
+    return (0 == failed) ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+﻿// pcapng_test.cpp: pcapng 写入后读回块结构，以及滚动文件的删除和索引
+//
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "pcapng.h"
+#include "packet.h"
+#include "test.h"
+
+using namespace figkey;
+
+struct PcapngBlock {
+    uint32_t type{ 0 };
+    std::vector<uint8_t> body;          // 不含首尾的类型和长度
+};
+
+static std::vector<uint8_t> readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static uint32_t readUint32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// 按块拆分文件，首尾长度不一致或越界时返回 false
+static bool readBlocks(const std::vector<uint8_t>& data, std::vector<PcapngBlock>& blocks)
+{
+    size_t position{ 0 };
+    while (position < data.size()) {
+        if (position + 12 > data.size())
+            return false;
+        uint32_t total = readUint32(data.data() + position + 4);
+        if ((total < 12) || (total % 4) || (position + total > data.size()))
+            return false;
+        if (total != readUint32(data.data() + position + total - 4))
+            return false;
+
+        PcapngBlock block;
+        block.type = readUint32(data.data() + position);
+        block.body.assign(data.begin() + position + 8, data.begin() + position + total - 4);
+        blocks.push_back(block);
+        position += total;
+    }
+    return true;
+}
+
+static bool isFileExists(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return file.is_open();
+}
+
+TEST_CASE(pcapngWriteRead)
+{
+    const std::string path{ "ipcap_test.pcapng" };
+    std::vector<PcapngInterfaceInfo> interfaces(2);
+    interfaces[0].name = "eth0";
+    interfaces[1].name = "eth1";
+    interfaces[1].snapLength = 256;
+
+    PcapngWriter& writer = PcapngWriter::Instance();
+    REQUIRE(writer.open(path, interfaces));
+    CHECK(writer.isOpen());
+
+    uint8_t frame[61];
+    for (size_t i = 0; i < sizeof(frame); ++i)
+        frame[i] = static_cast<uint8_t>(i);
+    const uint64_t timestamp{ 0x123456789ULL };
+    writer.write(0, timestamp, frame, sizeof(frame), 100, PACKET_NO_ERROR);
+    writer.write(1, timestamp + 1, frame, 60, 60, PACKET_NO_ERROR + 1);
+    // 不存在的网卡不写入
+    writer.write(2, timestamp + 2, frame, 60, 60, PACKET_NO_ERROR);
+    writer.close();
+    CHECK(!writer.isOpen());
+    CHECK(2 == writer.getPackets());
+    CHECK(0 == writer.getDropped());
+
+    std::vector<PcapngBlock> blocks;
+    CHECK(readBlocks(readFile(path), blocks));
+    std::remove(path.c_str());
+    REQUIRE(5 == blocks.size());
+
+    CHECK(0x0A0D0D0A == blocks[0].type);
+    CHECK(0x1A2B3C4D == readUint32(blocks[0].body.data()));
+    CHECK(1 == blocks[1].type);
+    CHECK(1 == blocks[2].type);
+    CHECK(256 == readUint32(blocks[2].body.data() + 4));
+
+    // enhanced packet block：网卡、时间戳高低位、捕获长度、原始长度、按 4 字节补齐的数据
+    const PcapngBlock& first = blocks[3];
+    CHECK(6 == first.type);
+    REQUIRE(20 + 64 == first.body.size());
+    CHECK(0 == readUint32(first.body.data()));
+    CHECK(0x1 == readUint32(first.body.data() + 4));
+    CHECK(0x23456789 == readUint32(first.body.data() + 8));
+    CHECK(sizeof(frame) == readUint32(first.body.data() + 12));
+    CHECK(100 == readUint32(first.body.data() + 16));
+    CHECK(0 == memcmp(first.body.data() + 20, frame, sizeof(frame)));
+    CHECK(0 == first.body[20 + sizeof(frame)]);
+
+    // 有错误的包带注释选项
+    const PcapngBlock& second = blocks[4];
+    CHECK(6 == second.type);
+    CHECK(1 == readUint32(second.body.data()));
+    const char* comment = getPacketErrorName(PACKET_NO_ERROR + 1);
+    REQUIRE(second.body.size() > 20 + 60 + 4 + std::strlen(comment));
+    CHECK(0 == memcmp(second.body.data() + 20 + 60 + 4, comment, std::strlen(comment)));
+}
+
+TEST_CASE(pcapngRolling)
+{
+    const std::string path{ "ipcap_test_rolling.pcapng" };
+
+    // 每个文件 1MB，约 1016 个包，3000 个包写满 3 个文件，只保留最后 2 个
+    PcapngRollingInfo rolling;
+    rolling.files = 2;
+    rolling.fileSize = 1;
+    PcapngWriter& writer = PcapngWriter::Instance();
+    REQUIRE(writer.open(path, std::vector<PcapngInterfaceInfo>(1), rolling, true));
+
+    std::vector<uint8_t> frame(1000, 0x5a);
+    const uint64_t start{ 1000000000ULL };
+    for (uint32_t i = 0; i < 3000; ++i)
+        writer.write(0, start + i, frame.data(), static_cast<uint32_t>(frame.size()), static_cast<uint32_t>(frame.size()), PACKET_NO_ERROR);
+    writer.close();
+    CHECK(3000 == writer.getPackets());
+    CHECK(0 == writer.getDropped());
+    CHECK(writer.getRetainedSince() > start);
+
+    CHECK(!isFileExists("ipcap_test_rolling_00001.pcapng"));
+    CHECK(isFileExists("ipcap_test_rolling_00002.pcapng"));
+    CHECK(isFileExists("ipcap_test_rolling_00003.pcapng"));
+    CHECK(!isFileExists("ipcap_test_rolling_00004.pcapng"));
+
+    // 索引只列出保留的文件
+    std::ifstream index("ipcap_test_rolling_index.csv");
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(index, line);)
+        lines.push_back(line);
+    index.close();
+    REQUIRE(3 == lines.size());
+    CHECK(0 == lines[1].find("ipcap_test_rolling_00002.pcapng,"));
+    CHECK(0 == lines[2].find("ipcap_test_rolling_00003.pcapng,"));
+
+    std::vector<PcapngBlock> blocks;
+    CHECK(readBlocks(readFile("ipcap_test_rolling_00003.pcapng"), blocks));
+    CHECK(!blocks.empty() && (0x0A0D0D0A == blocks[0].type));
+
+    // 再次打开时删除上次的文件，不会与本次的文件混在一起
+    REQUIRE(writer.open(path, std::vector<PcapngInterfaceInfo>(1), rolling, true));
+    writer.close();
+    CHECK(isFileExists("ipcap_test_rolling_00001.pcapng"));
+    CHECK(!isFileExists("ipcap_test_rolling_00002.pcapng"));
+    CHECK(!isFileExists("ipcap_test_rolling_00003.pcapng"));
+
+    std::remove("ipcap_test_rolling_00001.pcapng");
+    std::remove("ipcap_test_rolling_index.csv");
+}
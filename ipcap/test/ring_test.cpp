@@ -0,0 +1,141 @@
+﻿// ring_test.cpp: 环形缓冲区和捕获数据存储区的回绕
+//
+
+#include <thread>
+#include "common/ring_buffer.hpp"
+#include "arena.h"
+#include "test.h"
+
+using namespace figkey;
+using opensource::ctrlfrmb::SpscRingBuffer;
+
+TEST_CASE(ringBufferCapacity)
+{
+    SpscRingBuffer<int> ring(5);
+    CHECK(8 == ring.capacity());
+    CHECK(ring.empty());
+    CHECK(nullptr == ring.front());
+
+    SpscRingBuffer<int> minimum(0);
+    CHECK(2 == minimum.capacity());
+}
+
+TEST_CASE(ringBufferWraparound)
+{
+    SpscRingBuffer<int> ring(4);
+    int next{ 0 };
+    int expected{ 0 };
+
+    // 反复写满再取出一半，读写位置多次越过槽位末尾
+    for (int round = 0; round < 100; ++round) {
+        while (ring.push(int(next)))
+            ++next;
+        CHECK(4 == ring.size());
+
+        REQUIRE(nullptr != ring.front());
+        CHECK(expected == *ring.front());
+        for (int i = 0; i < 2; ++i) {
+            int value{ -1 };
+            REQUIRE(ring.pop(value));
+            CHECK(expected++ == value);
+        }
+    }
+
+    int value{ -1 };
+    while (ring.pop(value))
+        CHECK(expected++ == value);
+    CHECK(ring.empty());
+    CHECK(next == expected);
+}
+
+TEST_CASE(ringBufferThreads)
+{
+    SpscRingBuffer<uint32_t> ring(64);
+    const uint32_t count{ 1000000 };
+
+    std::thread producer([&ring, count]() {
+        for (uint32_t i = 0; i < count; ++i) {
+            while (!ring.push(uint32_t(i)))
+                std::this_thread::yield();
+        }
+    });
+
+    // 单生产者单消费者，取出的顺序与写入相同
+    uint32_t expected{ 0 };
+    bool isOrdered{ true };
+    while (expected < count) {
+        uint32_t value;
+        if (!ring.pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        isOrdered = isOrdered && (expected == value);
+        ++expected;
+    }
+    producer.join();
+
+    CHECK(isOrdered);
+    CHECK(ring.empty());
+}
+
+static std::vector<uint8_t> makeFrame(uint32_t length, uint8_t seed)
+{
+    std::vector<uint8_t> frame(length);
+    for (uint32_t i = 0; i < length; ++i)
+        frame[i] = static_cast<uint8_t>(seed * 31 + i * 7);
+    return frame;
+}
+
+TEST_CASE(arenaWraparound)
+{
+    PacketArena& arena = PacketArena::Instance();
+    arena.clear(2);
+
+    const uint64_t capacity = arena.getCapacity();
+    REQUIRE(capacity >= 1024 * 1024);
+    CHECK(0 == (capacity & (capacity - 1)));
+
+    // 长度不整除容量，写满后释放最早的一块，下一块跨越存储区末尾
+    const uint32_t length = static_cast<uint32_t>(capacity / 4 + 7);
+    std::vector<uint64_t> offsets;
+    for (uint8_t seed = 0; seed < 4; ++seed) {
+        auto frame = makeFrame(length, seed);
+        uint64_t offset{ 0 };
+        if (!arena.append(0, frame.data(), length, offset))
+            break;
+        offsets.push_back(offset);
+    }
+    REQUIRE(3 == offsets.size());
+    CHECK(length == offsets[1]);
+
+    arena.release(0, offsets[0] + length);
+    auto frame = makeFrame(length, 3);
+    uint64_t offset{ 0 };
+    REQUIRE(arena.append(0, frame.data(), length, offset));
+    CHECK(3ULL * length == offset);
+    CHECK((offset % capacity) + length > capacity);
+
+    std::vector<uint8_t> out;
+    CHECK(arena.read(0, offset, length, out));
+    CHECK(out == frame);
+
+    // 被覆盖的第一块不再有效，之后的块仍可读取
+    CHECK(!arena.isValid(0, offsets[0], length));
+    CHECK(!arena.read(0, offsets[0], length, out));
+    CHECK(out.empty());
+    CHECK(arena.read(0, offsets[1], length, out));
+    CHECK(out == makeFrame(length, 1));
+
+    // 未释放的数据不会被覆盖
+    CHECK(!arena.append(0, frame.data(), length, offset));
+
+    // 每个网卡的存储区互不影响
+    CHECK(arena.append(1, frame.data(), length, offset));
+    CHECK(0 == offset);
+    CHECK(arena.read(1, offset, length, out));
+    CHECK(out == frame);
+
+    // 超过存储区的帧和不存在的网卡直接拒绝
+    CHECK(!arena.append(1, frame.data(), static_cast<uint32_t>(capacity + 1), offset));
+    CHECK(!arena.append(2, frame.data(), length, offset));
+}
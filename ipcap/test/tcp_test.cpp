@@ -0,0 +1,178 @@
+﻿// tcp_test.cpp: TCP 流重组和 DoIP 分帧
+//
+
+#include <WinSock2.h>
+#include <cstring>
+#include <vector>
+#include "protocol/doip.h"
+#include "protocol/tcp.h"
+#include "test.h"
+
+using namespace figkey;
+
+// 诊断消息：DoIP 报头、源地址、目标地址和 UDS 请求 22 F1 90
+static std::vector<uint8_t> makeDiagnosticMessage(uint16_t source)
+{
+    return std::vector<uint8_t>{ 0x02, 0xFD, 0x80, 0x01, 0x00, 0x00, 0x00, 0x07,
+                                 static_cast<uint8_t>(source >> 8), static_cast<uint8_t>(source), 0x10, 0x01,
+                                 0x22, 0xF1, 0x90 };
+}
+
+// 存活检查请求，没有 UDS 数据
+static std::vector<uint8_t> makeAliveCheck()
+{
+    return std::vector<uint8_t>{ 0x02, 0xFD, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00 };
+}
+
+TEST_CASE(doipFramerSegments)
+{
+    DoIPStreamFramer framer;
+    auto message = makeDiagnosticMessage(0x0e80);
+
+    // 一个分段包含多条消息
+    std::vector<uint8_t> data = makeAliveCheck();
+    data.insert(data.end(), message.begin(), message.end());
+    CHECK(PROTOCOL_TYPE_UDS == framer.feed(data.data(), data.size()));
+    CHECK(PROTOCOL_TYPE_DOIP == framer.feed(data.data(), 8));
+
+    // 一条消息跨越多个分段，报头本身也被拆开
+    CHECK(PROTOCOL_TYPE_TCP == framer.feed(message.data(), 3));
+    CHECK(PROTOCOL_TYPE_DOIP == framer.feed(message.data() + 3, 9));
+    CHECK(framer.getBufferedBytes() >= message.size());
+    CHECK(PROTOCOL_TYPE_UDS == framer.feed(message.data() + 12, message.size() - 12));
+
+    // 消息末尾和下一条消息的开头在同一个分段
+    data = message;
+    data.insert(data.end(), message.begin(), message.begin() + 5);
+    CHECK(PROTOCOL_TYPE_UDS == framer.feed(data.data(), data.size()));
+    CHECK(PROTOCOL_TYPE_UDS == framer.feed(message.data() + 5, message.size() - 5));
+
+    // 不在消息边界上的数据无法识别，reset 后从下一个分段重新查找报头
+    const uint8_t garbage[] = { 0x47, 0x45, 0x54, 0x20, 0x2f, 0x20, 0x48, 0x54, 0x54, 0x50 };
+    CHECK(PROTOCOL_TYPE_TCP == framer.feed(garbage, sizeof(garbage)));
+    CHECK(PROTOCOL_TYPE_DOIP == framer.feed(message.data(), 10));
+    framer.reset();
+    CHECK(0 == framer.getBufferedBytes());
+    CHECK(PROTOCOL_TYPE_UDS == framer.feed(message.data(), message.size()));
+}
+
+TEST_CASE(doipFramerOversize)
+{
+    // 超过 DOIP_STREAM_MESSAGE_MAX 的消息只跳过，不缓存
+    DoIPStreamFramer framer;
+    const uint32_t length{ DOIP_STREAM_MESSAGE_MAX };
+    std::vector<uint8_t> data{ 0x02, 0xFD, 0x80, 0x01, static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+                               static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+    data.resize(8 + length / 2, 0x22);
+    CHECK(PROTOCOL_TYPE_DOIP == framer.feed(data.data(), data.size()));
+    CHECK(framer.getBufferedBytes() < DOIP_STREAM_MESSAGE_MAX / 2);
+    data.assign(length - length / 2, 0x22);
+    CHECK(PROTOCOL_TYPE_DOIP == framer.feed(data.data(), data.size()));
+
+    auto message = makeDiagnosticMessage(0x0e80);
+    CHECK(PROTOCOL_TYPE_UDS == framer.feed(message.data(), message.size()));
+}
+
+struct TcpSegment {
+    std::vector<uint8_t> packet;
+    PacketInfo info;
+};
+
+// 捕获数据只包含 TCP 头和负载，transportOffset 为 0
+static TcpSegment makeSegment(bool isReverse, uint32_t seq, uint8_t flags, const uint8_t* payload, size_t length, uint64_t timestamp)
+{
+    TcpSegment segment;
+    segment.packet.resize(sizeof(tcp_header) + length);
+    tcp_header* tcph = reinterpret_cast<tcp_header*>(segment.packet.data());
+    tcph->th_seq = htonl(seq);
+    tcph->th_flags = flags;
+    tcph->data_offset_and_reserved = 0x50;
+    if (length > 0)
+        memcpy(segment.packet.data() + sizeof(tcp_header), payload, length);
+
+    PacketInfo& info = segment.info;
+    info.timestamp = timestamp;
+    info.ipVersion = 4;
+    info.protocolType = PROTOCOL_TYPE_TCP;
+    const uint8_t client[] = { 192, 168, 1, 20 };
+    const uint8_t server[] = { 192, 168, 1, 10 };
+    memcpy(info.srcIP, isReverse ? server : client, sizeof(client));
+    memcpy(info.destIP, isReverse ? client : server, sizeof(server));
+    info.srcPort = isReverse ? 13400 : 50000;
+    info.destPort = isReverse ? 50000 : 13400;
+    info.transportOffset = 0;
+    info.payloadOffset = sizeof(tcp_header);
+    info.payloadLength = static_cast<uint16_t>(length);
+    return segment;
+}
+
+static uint8_t processSegment(bool isReverse, uint32_t seq, uint8_t flags, const std::vector<uint8_t>& data,
+                              size_t offset, size_t length, uint64_t timestamp = 1000000000ULL)
+{
+    TcpSegment segment = makeSegment(isReverse, seq, flags, data.data() + offset, length, timestamp);
+    bool isKeyReverse{ false };
+    FlowKey key = makeFlowKey(segment.info, isKeyReverse);
+    return TcpReassembler::Instance().process(segment.packet.data(), segment.info, key, isKeyReverse);
+}
+
+TEST_CASE(tcpReassemblySplit)
+{
+    TcpReassembler::Instance().clear();
+    auto message = makeDiagnosticMessage(0x0e80);
+    const uint32_t isn{ 0xFFFFFFF0 };
+
+    CHECK(PROTOCOL_TYPE_TCP == processSegment(false, isn, TCP_FLAG_SYN, message, 0, 0));
+
+    // 消息跨越两个分段，序号在中间回绕
+    uint32_t seq = isn + 1;
+    CHECK(PROTOCOL_TYPE_DOIP == processSegment(false, seq, TCP_FLAG_ACK, message, 0, 10));
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, seq + 10, TCP_FLAG_ACK, message, 10, message.size() - 10));
+    seq += static_cast<uint32_t>(message.size());
+
+    // 重传的分段沿用原来的协议类型，不再分帧
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, seq - 5, TCP_FLAG_ACK, message, 10, 5));
+
+    // 反方向是独立的字节流
+    auto response = makeDiagnosticMessage(0x1001);
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(true, 5000, TCP_FLAG_ACK, response, 0, response.size()));
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, seq, TCP_FLAG_ACK, message, 0, message.size()));
+}
+
+TEST_CASE(tcpReassemblyOutOfOrder)
+{
+    TcpReassembler::Instance().clear();
+    auto message = makeDiagnosticMessage(0x0e80);
+
+    CHECK(PROTOCOL_TYPE_TCP == processSegment(false, 100, TCP_FLAG_SYN, message, 0, 0));
+
+    // 后半条消息先到，等待缺失的数据
+    uint32_t seq{ 101 };
+    CHECK(PROTOCOL_TYPE_TCP == processSegment(false, seq + 10, TCP_FLAG_ACK, message, 10, message.size() - 10));
+    // 补齐后连同乱序分段一起分帧，下一条消息从正确的边界开始
+    CHECK(PROTOCOL_TYPE_DOIP == processSegment(false, seq, TCP_FLAG_ACK, message, 0, 10));
+    seq += static_cast<uint32_t>(message.size());
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, seq, TCP_FLAG_ACK, message, 0, message.size()));
+    seq += static_cast<uint32_t>(message.size());
+
+    // 与已交付数据部分重叠的乱序分段只交付超出的部分，乱序分段沿用最近的协议类型
+    std::vector<uint8_t> data = message;
+    data.insert(data.end(), message.begin(), message.end());
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, seq + 10, TCP_FLAG_ACK, data, 10, data.size() - 10));
+    CHECK(PROTOCOL_TYPE_DOIP == processSegment(false, seq, TCP_FLAG_ACK, data, 0, 12));
+    seq += static_cast<uint32_t>(data.size());
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, seq, TCP_FLAG_ACK, message, 0, message.size()));
+}
+
+TEST_CASE(tcpReassemblyMidStream)
+{
+    TcpReassembler::Instance().clear();
+    auto message = makeDiagnosticMessage(0x0e80);
+
+    // 抓包开始时连接已建立，从第一个看到的分段开始
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, 77777, TCP_FLAG_ACK, message, 0, message.size()));
+
+    // 连接复位后重新建立，之前的状态不影响新连接
+    CHECK(PROTOCOL_TYPE_TCP == processSegment(false, 77777 + 15, TCP_FLAG_RST, message, 0, 0));
+    CHECK(PROTOCOL_TYPE_DOIP == processSegment(false, 1, TCP_FLAG_ACK, message, 0, 10));
+    CHECK(PROTOCOL_TYPE_UDS == processSegment(false, 11, TCP_FLAG_ACK, message, 10, message.size() - 10));
+}
@@ -0,0 +1,66 @@
+﻿/**
+ * @file    test.h
+ * @ingroup figkey
+ * @brief   Minimal test case registry and check macros for the ipcap unit tests
+ * @author  leiwei
+ * @date    2024.04.16
+ * Copyright (c) figkey 2023-2033
+ */
+
+#pragma once
+
+#ifndef FIGKEY_PCAP_TEST_HPP
+#define FIGKEY_PCAP_TEST_HPP
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace figkey {
+namespace test {
+
+    struct TestCase {
+        const char* name;
+        std::function<void()> func;
+    };
+
+    // 所有测试用例，由 TEST_CASE 在静态初始化时注册
+    inline std::vector<TestCase>& getTestCases() {
+        static std::vector<TestCase> cases;
+        return cases;
+    }
+
+    // 当前用例失败的检查数，由 main 在每个用例开始前清零
+    inline int& getFailures() {
+        static int failures{ 0 };
+        return failures;
+    }
+
+    inline void reportFailure(const char* file, int line, const char* expression) {
+        std::printf("  %s:%d: CHECK(%s) failed\n", file, line, expression);
+        ++getFailures();
+    }
+
+    struct TestRegistrar {
+        TestRegistrar(const char* name, std::function<void()> func) {
+            getTestCases().push_back(TestCase{ name, func });
+        }
+    };
+
+}  // namespace test
+}  // namespace figkey
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static figkey::test::TestRegistrar name##Registrar(#name, name); \
+    static void name()
+
+// 失败后继续执行当前用例
+#define CHECK(expression) \
+    do { if (!(expression)) figkey::test::reportFailure(__FILE__, __LINE__, #expression); } while (0)
+
+// 失败后结束当前用例，用于后续检查依赖的前提条件
+#define REQUIRE(expression) \
+    do { if (!(expression)) { figkey::test::reportFailure(__FILE__, __LINE__, #expression); return; } } while (0)
+
+#endif // !FIGKEY_PCAP_TEST_HPP
@@ -0,0 +1,46 @@
+#-------------------------------------------------
+#
+# ipcap unit tests, no Npcap runtime required
+#
+#-------------------------------------------------
+
+QT       -= core gui
+CONFIG += c++11 console testcase
+CONFIG -= qt app_bundle
+
+TARGET = ipcap_test
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD
+INCLUDEPATH += $$PWD\..\include
+INCLUDEPATH += $$PWD\..\..\include
+INCLUDEPATH += $$PWD\..\..\include\npcap1.13\include
+
+# ipcap.cpp 调用 Npcap 抓包，不编译进测试程序
+SOURCES += main.cpp \
+    checksum_test.cpp \
+    dispatch_test.cpp \
+    filter_test.cpp \
+    flow_test.cpp \
+    fragment_test.cpp \
+    pcapng_test.cpp \
+    ring_test.cpp \
+    tcp_test.cpp \
+    ../src/protocol/doip.cpp \
+    ../src/protocol/fragment.cpp \
+    ../src/protocol/ip.cpp \
+    ../src/protocol/tcp.cpp \
+    ../src/protocol/uds.cpp \
+    ../src/arena.cpp \
+    ../src/checksum.cpp \
+    ../src/config.cpp \
+    ../src/filter.cpp \
+    ../src/dispatch.cpp \
+    ../src/flow.cpp \
+    ../src/packet.cpp \
+    ../src/pcapng.cpp \
+    ../src/stats.cpp
+
+HEADERS += test.h
+
+win32: LIBS += -lws2_32
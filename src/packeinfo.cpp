@@ -1,10 +1,16 @@
 ﻿//PacketInfoModel.cpp
 #include "packeinfo.h"
 #include "config.h"
+#include "packet.h"
 #include <QDebug>
+#include <algorithm>
 
 PacketInfoModel::PacketInfoModel(QObject *parent)
-    : QAbstractTableModel(parent), m_rows(figkey::CaptureConfig::Instance().getConfigInfo().displayRows)
+    : QAbstractTableModel(parent),
+      m_staged(PACKET_MODEL_STAGE_BATCHES),
+      m_blocks(PACKET_MODEL_CACHE_BLOCKS),
+      m_cells(PACKET_MODEL_CACHE_CELLS),
+      m_rows(std::max<int>(1, figkey::CaptureConfig::Instance().getConfigInfo().displayRows))
 {
 }
 
@@ -15,8 +21,9 @@ PacketInfoModel::~PacketInfoModel() {
 int PacketInfoModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    //QMutexLocker locker(&m_mutex);  // 使用 QMutexLocker，它会在析构函数中自动解锁
-    return m_data.size();
+    if (m_isDataBase)
+        return m_dbRows;
+    return m_size;
 }
 
 int PacketInfoModel::columnCount(const QModelIndex &parent) const
@@ -25,45 +32,84 @@ int PacketInfoModel::columnCount(const QModelIndex &parent) const
     return 7;
 }
 
-QString PacketInfoModel::getProtocolName(uint8_t protocolType) const
+const QString& PacketInfoModel::getProtocolName(uint8_t protocolType) const
 {
+    // 协议名只创建一次，每次绘制共享同一个字符串
+    static const QString tcp("TCP");
+    static const QString udp("UDP");
+    static const QString doip("DOIP");
+    static const QString uds("UDS");
+    static const QString unknown("UNKNOWN");
+
     switch (protocolType) {
     case figkey::PROTOCOL_TYPE_TCP:
-        return "TCP";
+        return tcp;
     case figkey::PROTOCOL_TYPE_UDP:
-        return "UDP";
+        return udp;
     case figkey::PROTOCOL_TYPE_DOIP:
-        return "DOIP";
+        return doip;
     case figkey::PROTOCOL_TYPE_UDS:
-        return "UDS";
+        return uds;
     default:
         break;
     }
 
-    return "UNKNOWN";
+    return unknown;
 }
 
-QVariant PacketInfoModel::data(const QModelIndex &index, int role) const
+const PacketCells& PacketInfoModel::getCells(const PacketRecord& record) const
 {
-    QMutexLocker locker(&m_mutex);  // 需要对 m_data 的访问进行加锁
+    const auto& packet = record.info;
+    if (auto* cells = m_cells.object(packet.index))
+        return *cells;
 
+    auto* cells = new PacketCells;
+    cells->timestamp = QString::fromStdString(figkey::formatPacketTimestamp(packet.timestamp));
+    cells->srcIP = QString::fromStdString(figkey::formatIpAddress(packet.srcIP, packet.ipVersion));
+    cells->destIP = QString::fromStdString(figkey::formatIpAddress(packet.destIP, packet.ipVersion));
+    cells->information = QString::fromStdString(formatRecordData(record, m_informationLength));
+    m_cells.insert(packet.index, cells);
+    return *cells;
+}
+
+void PacketInfoModel::setInformationLength(int length)
+{
+    length = std::max(length, 16);
+    if (length == m_informationLength)
+        return;
+
+    m_informationLength = length;
+    m_cells.clear();
+    if (rowCount() > 0)
+        emit dataChanged(index(0, 6), index(rowCount() - 1, 6));
+}
+
+QVariant PacketInfoModel::data(const QModelIndex &index, int role) const
+{
     if (role != Qt::DisplayRole || !index.isValid())
         return QVariant();
 
-    if (index.row() >= m_data.size()) {
-         qDebug()<<"row: "<<index.row()<<" PacketInfoModel out_of_range data size: "<<m_data.size();
+    const PacketRecord* row{ nullptr };
+    if (m_isDataBase) {
+        row = getBlockPacket(index.row());
+    } else if (index.row() < m_size) {
+        row = &at(index.row());
+    }
+
+    if (!row) {
+         qDebug()<<"row: "<<index.row()<<" PacketInfoModel out_of_range data size: "<<rowCount();
          return QVariant();
     }
 
-    const auto& packet = m_data.at(index.row());
+    const auto& packet = row->info;
     switch (index.column()) {
         case 0: return QVariant::fromValue<uint64_t>(packet.index);
-        case 1: return QString::fromStdString(packet.timestamp);
-        case 2: return QString::fromStdString(packet.srcIP);
-        case 3: return QString::fromStdString(packet.destIP);
+        case 1: return getCells(*row).timestamp;
+        case 2: return getCells(*row).srcIP;
+        case 3: return getCells(*row).destIP;
         case 4: return getProtocolName(packet.protocolType);
         case 5: return packet.payloadLength;
-        case 6: return QString::fromStdString(packet.data);
+        case 6: return getCells(*row).information;
         default: break;
     }
 
@@ -87,59 +133,210 @@ QVariant PacketInfoModel::headerData(int section, Qt::Orientation orientation, i
     return QVariant();
 }
 
-void PacketInfoModel::loadPackect(const std::vector<figkey::PacketInfo>& packets) {
+const PacketRecord& PacketInfoModel::at(int row) const
+{
+    return m_data[(m_head + row) % m_rows];
+}
+
+const PacketRecord* PacketInfoModel::getBlockPacket(int row) const
+{
+    if ((row < 0) || (row >= m_dbRows))
+        return nullptr;
+
+    int block = row / PACKET_MODEL_BLOCK_ROWS;
+    int offset = row % PACKET_MODEL_BLOCK_ROWS;
+    auto* packets = m_blocks.object(block);
+
+    // 块中的数据包持有各自的负载，块被移出缓存后重新读取
+    if (packets && (offset < packets->size()))
+        return &packets->at(offset);
+
+    if (!m_fetcher || (block >= static_cast<int>(m_blockAfterIds.size())))
+        return nullptr;
+
+    auto fetched = m_fetcher(m_blockAfterIds[block], PACKET_MODEL_BLOCK_ROWS);
+    packets = new QVector<PacketRecord>(fetched.begin(), fetched.end());
+    m_blocks.insert(block, packets);
+
+    if (offset >= packets->size())
+        return nullptr;
+    return &packets->at(offset);
+}
+
+void PacketInfoModel::clearDataBase()
+{
+    m_isDataBase = false;
+    m_dbRows = 0;
+    m_blockAfterIds.clear();
+    m_fetcher = nullptr;
+    m_blocks.clear();
+    m_cells.clear();
+}
+
+void PacketInfoModel::loadDataBase(const std::vector<qulonglong>& afterIds, int rows, PacketFetcher fetcher)
+{
     clearPacket();
 
-    QMutexLocker locker(&m_mutex);
-    if (!packets.empty()) {
-        // 添加新数据包
-        beginInsertRows(QModelIndex(), 0, packets.size() - 1);
-        for (auto&& packet : packets) {
-            m_data.append(std::move(packet));
-        }
-        endInsertRows();
-    }
+    if (rows <= 0)
+        return;
+
+    beginInsertRows(QModelIndex(), 0, rows - 1);
+    m_isDataBase = true;
+    m_dbRows = rows;
+    m_blockAfterIds = afterIds;
+    m_fetcher = std::move(fetcher);
+    endInsertRows();
 }
 
-void PacketInfoModel::addPacket(const figkey::PacketInfo &packet)
+void PacketInfoModel::loadPackect(const std::vector<PacketRecord>& packets) {
+    clearPacket();
+
+    addPackets(packets);
+}
+
+void PacketInfoModel::addPacket(const PacketRecord& packet)
+{
+    addPackets(std::vector<PacketRecord>(1, packet));
+}
+
+void PacketInfoModel::addPackets(const std::vector<PacketRecord>& packets)
 {
-    QMutexLocker locker(&m_mutex);
 
-    if (m_data.size() >= m_rows)
-    {
-        beginRemoveRows(QModelIndex(), 0, 0);
-        m_data.removeFirst();
+    if (m_isDataBase) {
+        beginResetModel();
+        clearDataBase();
+        endResetModel();
+    }
+
+    if (packets.empty())
+        return;
+
+    // 只有最后 m_rows 个数据包会保留
+    int count = static_cast<int>(std::min<size_t>(packets.size(), m_rows));
+    auto first = packets.end() - count;
+    int overflow = m_size + count - m_rows;
+
+    // 整个表格都被替换时重置模型，否则先移除最早的行再在末尾插入
+    bool isReset = (overflow >= m_size) && (m_size > 0);
+    if (isReset) {
+        beginResetModel();
+        m_head = (m_head + m_size) % m_rows;
+        m_size = 0;
+    } else if (overflow > 0) {
+        beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        m_head = (m_head + overflow) % m_rows;
+        m_size -= overflow;
         endRemoveRows();
     }
 
-    beginInsertRows(QModelIndex(), m_data.size(), m_data.size());
-    m_data.append(packet);
-    endInsertRows();
+    if (!isReset)
+        beginInsertRows(QModelIndex(), m_size, m_size + count - 1);
+
+    // 缓冲区未写满前 m_head 为 0，新位置总在末尾
+    for (auto it = first; it != packets.end(); ++it) {
+        size_t slot = (m_head + m_size) % m_rows;
+        if (slot < m_data.size())
+            m_data[slot] = *it;
+        else
+            m_data.push_back(*it);
+        ++m_size;
+    }
+
+    if (isReset)
+        endResetModel();
+    else
+        endInsertRows();
+}
+
+bool PacketInfoModel::stagePackets(std::vector<PacketRecord>&& packets)
+{
+    if (packets.empty())
+        return true;
+    return m_staged.push(std::move(packets));
+}
+
+size_t PacketInfoModel::commitStaged(size_t& trimmed)
+{
+    std::vector<PacketRecord> packets;
+    std::vector<PacketRecord> batch;
+    size_t count{ 0 };
+    while (m_staged.pop(batch)) {
+        count += batch.size();
+        if (packets.empty()) {
+            packets.swap(batch);
+        } else {
+            packets.insert(packets.end(), batch.begin(), batch.end());
+        }
+
+        // 只有最后 m_rows 个数据包会显示
+        if (packets.size() > static_cast<size_t>(m_rows) * 2)
+            packets.erase(packets.begin(), packets.end() - m_rows);
+    }
+
+    // addPackets 同样只插入最后 m_rows 个
+    size_t displayed = std::min<size_t>(count, m_rows);
+    trimmed = count - displayed;
+    if (count > 0)
+        addPackets(packets);
+    return displayed;
 }
 
 void PacketInfoModel::clearPacket() {
-    QMutexLocker locker(&m_mutex);
+    // 丢弃上一次抓包未显示的数据包
+    std::vector<PacketRecord> batch;
+    while (m_staged.pop(batch)) {
+    }
 
-    // 移除旧的数据
-    if (!m_data.isEmpty()) {
-        beginRemoveRows(QModelIndex(), 0, m_data.size() - 1);
+    // 新的抓包从 1 重新编号，已格式化的单元格失效
+    m_cells.clear();
+
+    if (m_isDataBase) {
+        beginResetModel();
+        clearDataBase();
+        endResetModel();
+    }
+
+    // 移除旧的数据，保留缓冲区的内存
+    if (m_size > 0) {
+        beginRemoveRows(QModelIndex(), 0, m_size - 1);
         m_data.clear();
+        m_head = 0;
+        m_size = 0;
         endRemoveRows();
     }
 }
 
-figkey::PacketInfo PacketInfoModel::getPacketByIndex(int index) {
-    QMutexLocker locker(&m_mutex);
-    if (m_data.isEmpty() || (index < 0))
-        return figkey::PacketInfo();
+PacketRecord PacketInfoModel::getPacketByIndex(int index) {
+    if (m_isDataBase) {
+        if (m_dbRows == 0)
+            return PacketRecord();
+        auto* packet = getBlockPacket(std::max(0, std::min(index, m_dbRows - 1)));
+        return packet ? *packet : PacketRecord();
+    }
+
+    if ((m_size == 0) || (index < 0))
+        return PacketRecord();
 
-    if (index >= m_data.size())
-        return m_data.last();
+    if (index >= m_size)
+        return at(m_size - 1);
 
-    return m_data[index];
+    return at(index);
 }
 
-const QVector<figkey::PacketInfo>& PacketInfoModel::getAllPacket() const {
-    QMutexLocker locker(&m_mutex);
-    return m_data;
+QVector<PacketRecord> PacketInfoModel::getAllPacket() const {
+    QVector<PacketRecord> packets;
+    if (!m_isDataBase) {
+        packets.reserve(m_size);
+        for (int row = 0; row < m_size; ++row)
+            packets.append(at(row));
+        return packets;
+    }
+
+    for (int row = 0; (row < m_dbRows) && (packets.size() < m_rows); ++row) {
+        auto* packet = getBlockPacket(row);
+        if (!packet)
+            break;
+        packets.append(*packet);
+    }
+    return packets;
 }
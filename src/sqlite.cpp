@@ -7,12 +7,122 @@
 #include <QMessageBox>
 #include <QCoreApplication>
 #include <QFileDialog>
+#include <QSqlRecord>
+#include <QTextStream>
+#include <cstring>
+#include <limits>
 
 #include "sqlite.h"
 #include "config.h"
+#include "packet.h"
+#include "stats.h"
 
 #define FKCAP_SQLITE_DATABASE_PATH "/db/figkey.db"
 
+// 旧版本数据库中的时间戳为 "hh:mm:ss.微秒" 文本，按当天日期转换为纳秒
+static uint64_t parseTimestampText(const QString& text) {
+    QTime time = QTime::fromString(text.section('.', 0, 0), "hh:mm:ss");
+    if (!time.isValid())
+        return 0;
+
+    qint64 msecs = QDateTime(QDate::currentDate(), time).toMSecsSinceEpoch();
+    return static_cast<uint64_t>(msecs) * 1000000ULL + text.section('.', 1, 1).toULongLong() * 1000ULL;
+}
+
+// 地址 BLOB 的长度决定 IP 版本：4 字节为 IPv4，16 字节为 IPv6
+static void readIpBlob(const QByteArray& blob, uint8_t* ip, uint8_t& version) {
+    if (blob.size() == 4)
+        version = 4;
+    else if (blob.size() == PACKET_IP_ADDRESS_LENGTH)
+        version = 6;
+    else
+        return;
+    memcpy(ip, blob.constData(), blob.size());
+}
+
+static void readMacBlob(const QByteArray& blob, uint8_t* mac) {
+    if (blob.size() == PACKET_MAC_ADDRESS_LENGTH)
+        memcpy(mac, blob.constData(), PACKET_MAC_ADDRESS_LENGTH);
+}
+
+// 过滤条件中的地址转换为 BLOB 参数，无法解析的地址绑定为 NULL，不匹配任何数据包
+static QVariant formatIpFilter(const std::string& text) {
+    uint8_t ip[PACKET_IP_ADDRESS_LENGTH]{};
+    uint8_t version{ 0 };
+    if (!figkey::parseIpAddress(text, ip, version))
+        return QVariant(QVariant::ByteArray);
+
+    int length = (4 == version) ? 4 : PACKET_IP_ADDRESS_LENGTH;
+    return QByteArray(reinterpret_cast<const char*>(ip), length);
+}
+
+static QVariant formatMacFilter(const std::string& text) {
+    uint8_t mac[PACKET_MAC_ADDRESS_LENGTH]{};
+    if (!figkey::parseMacAddress(text, mac))
+        return QVariant(QVariant::ByteArray);
+
+    return QByteArray(reinterpret_cast<const char*>(mac), PACKET_MAC_ADDRESS_LENGTH);
+}
+
+// 数据库中的一行转换为数据包，负载由记录自己持有，不写入抓包使用的 PacketArena
+static PacketRecord readPacket(const QSqlQuery& query) {
+    PacketRecord record;
+    figkey::PacketInfo& packet = record.info;
+    packet.index = query.value("id").toULongLong();
+    packet.timestamp = query.value("timestamp").toULongLong();
+    packet.err = query.value("error").toUInt();
+    readIpBlob(query.value("srcIP").toByteArray(), packet.srcIP, packet.ipVersion);
+    readIpBlob(query.value("destIP").toByteArray(), packet.destIP, packet.ipVersion);
+    readMacBlob(query.value("srcMAC").toByteArray(), packet.srcMAC);
+    readMacBlob(query.value("destMAC").toByteArray(), packet.destMAC);
+    packet.srcPort = query.value("srcPort").toUInt();
+    packet.destPort = query.value("destPort").toUInt();
+    packet.protocolType = query.value("protocol").toUInt();
+    packet.payloadLength = query.value("length").toUInt();
+    packet.interfaceId = query.value("interface").toUInt();
+
+    record.payload = query.value("data").toByteArray();
+    packet.dataLength = static_cast<uint32_t>(record.payload.size());
+
+    return record;
+}
+
+// 旧版本数据库的一行：地址和负载为文本，只在转换数据库时使用，负载不是有效的十六进制文本时 isPayloadValid 为 false
+static PacketRecord readLegacyPacket(const QSqlQuery& query, bool& isPayloadValid) {
+    PacketRecord record;
+    figkey::PacketInfo& packet = record.info;
+    packet.index = query.value("id").toULongLong();
+
+    bool ok{ false };
+    packet.timestamp = query.value("timestamp").toULongLong(&ok);
+    if (!ok)
+        packet.timestamp = parseTimestampText(query.value("timestamp").toString());
+
+    packet.err = query.value("error").toUInt();
+    figkey::parseIpAddress(query.value("srcIP").toString().toStdString(), packet.srcIP, packet.ipVersion);
+    figkey::parseIpAddress(query.value("destIP").toString().toStdString(), packet.destIP, packet.ipVersion);
+    figkey::parseMacAddress(query.value("srcMAC").toString().toStdString(), packet.srcMAC);
+    figkey::parseMacAddress(query.value("destMAC").toString().toStdString(), packet.destMAC);
+    packet.srcPort = query.value("srcPort").toUInt();
+    packet.destPort = query.value("destPort").toUInt();
+    packet.protocolType = query.value("protocol").toUInt();
+    packet.payloadLength = query.value("length").toUInt();
+    // 更早的版本没有网卡编号
+    if (query.record().indexOf("interface") >= 0)
+        packet.interfaceId = query.value("interface").toUInt();
+
+    // 文本直接解码到绑定的负载中，不经过中间的 std::string 和 vector
+    QByteArray text = query.value("data").toByteArray();
+    size_t size{ 0 };
+    record.payload.resize(text.size() / 2);
+    isPayloadValid = figkey::parseHexStringToPayload(text.constData(), static_cast<size_t>(text.size()),
+                                                     reinterpret_cast<uint8_t*>(record.payload.data()), size);
+    record.payload.resize(isPayloadValid ? static_cast<int>(size) : 0);
+    packet.dataLength = static_cast<uint32_t>(record.payload.size());
+
+    return record;
+}
+
 SqliteCom::SqliteCom(QObject *parent)
     : QObject(parent),
       dbFile(QCoreApplication::applicationDirPath()+FKCAP_SQLITE_DATABASE_PATH),
@@ -30,7 +140,49 @@ SqliteCom::~SqliteCom()
 
 }
 
-void SqliteCom::saveFile() {
+// 滚动模式下 figkey.pcapng 对应的索引为 figkey_index.csv
+static QString getRollingIndexName(const QString& pcapngFileName) {
+    QFileInfo info(pcapngFileName);
+    return info.dir().filePath(info.completeBaseName() + "_index.csv");
+}
+
+// 复制索引中列出的滚动文件，按保存的文件名重新编号，并写入指向新文件的索引
+static bool copyRollingFiles(const QString& indexFileName, const QString& destFileName) {
+    QFile index(indexFileName);
+    if (!index.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    QFileInfo dest(destFileName);
+    QString stem = dest.dir().filePath(dest.completeBaseName());
+    QString suffix = dest.suffix().isEmpty() ? QString(".pcapng") : ("." + dest.suffix());
+
+    QTextStream in(&index);
+    QString output = in.readLine() + "\n";
+    int number{ 0 };
+    while (!in.atEnd()) {
+        QStringList fields = in.readLine().split(',');
+        if (fields.size() < 4)
+            continue;
+
+        // 保存时文件名已确认覆盖，同名的编号文件直接替换
+        QString destPath = stem + QString("_%1").arg(++number, 5, 10, QChar('0')) + suffix;
+        QFile::remove(destPath);
+        if (!QFile::copy(fields[0], destPath))
+            return false;
+
+        fields[0] = destPath;
+        output += fields.join(',') + "\n";
+    }
+    if (0 == number)
+        return false;
+
+    QFile destIndex(stem + "_index.csv");
+    if (!destIndex.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+    return destIndex.write(output.toUtf8()) >= 0;
+}
+
+void SqliteCom::saveFile(const QString& pcapngFileName) {
     if(!dbFile.exists()) {
         QMessageBox::critical(nullptr, "Error",
                               QString("Unable to save, the current system temporary database file is abnormal.")
@@ -38,15 +190,40 @@ void SqliteCom::saveFile() {
         return;
     }
 
+    QString filters("Sqlite DataBase (*.db);;Text files (*.txt)");
+    QFile pcapngFile(pcapngFileName);
+    // 滚动模式下只有编号文件和索引，保存时复制全部已写完的文件
+    QString indexFileName = pcapngFileName.isEmpty() ? QString() : getRollingIndexName(pcapngFileName);
+    bool isRolling = !pcapngFile.exists() && !indexFileName.isEmpty() && QFile::exists(indexFileName);
+    if (!pcapngFileName.isEmpty() && pcapngFile.exists())
+        filters += ";;Pcapng (*.pcapng)";
+    else if (isRolling)
+        filters += ";;Pcapng rolling files (*.pcapng)";
+
     // 保存数据库到用户指定位置
+    QString selectedFilter;
     QString destFileName = QFileDialog::getSaveFileName(
         nullptr,
         "Save Capture File",
         QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation),
-        "Sqlite DataBase (*.db);;Text files (*.txt)");
+        filters, &selectedFilter);
 
     if (!destFileName.isEmpty()) {
-        if (!dbFile.copy(destFileName)) {
+        // WAL 模式下已提交的数据可能还在 -wal 文件中，复制前合并到数据库文件
+        if (db.isOpen() && !query.exec("PRAGMA wal_checkpoint(FULL)"))
+            qDebug() << "Error checkpointing database: " << query.lastError();
+
+        if (isRolling && selectedFilter.startsWith("Pcapng")) {
+            if (!copyRollingFiles(indexFileName, destFileName)) {
+                QMessageBox::critical(nullptr, "Error",
+                                      QString("Failed to save the rolling files %1 ")
+                                      .arg(destFileName));
+            }
+            return;
+        }
+
+        QFile& srcFile = selectedFilter.startsWith("Pcapng") ? pcapngFile : dbFile;
+        if (!srcFile.copy(destFileName)) {
             QMessageBox::critical(nullptr, "Error",
                                   QString("Failed to save the file %1 ")
                                   .arg(destFileName));
@@ -82,10 +259,14 @@ void SqliteCom::moveFile() {
 }
 
 void SqliteCom::closeDataBase() {
-    if (db.isOpen()) {
-        db.commit();
+    // 先写入队列中剩余的数据包，再关闭界面线程的连接
+    stopScan();
+    isFileLoaded = false;
+    writer.stop();
+    filterQuery = QSqlQuery();
+    filterString.clear();
+    if (db.isOpen())
         db.close();
-    }
 }
 
 void SqliteCom::closeFile()
@@ -136,14 +317,45 @@ bool SqliteCom::loadFile() {
         return false;
     }
 
+    if (isLegacyTable()) {
+        // 旧格式的文件保持不变，转换到同目录下的副本后打开副本，已经转换过时直接打开
+        db.close();
+        QFileInfo legacyFile(fileName);
+        QString convertedName = legacyFile.absolutePath() + "/" + legacyFile.completeBaseName()
+                                + QString("_v%1.db").arg(FKCAP_SQLITE_SCHEMA_VERSION);
+        if (!QFile::exists(convertedName) && !QFile::copy(fileName, convertedName)) {
+            QMessageBox::critical(nullptr, "Error",
+                                  QString("Error copying old database: %1 to %2").arg(fileName).arg(convertedName));
+            return false;
+        }
+
+        db.setDatabaseName(convertedName);
+        int invalidPayloads{ 0 };
+        if (!db.open() || !convertLegacyTable(invalidPayloads)) {
+            QMessageBox::critical(nullptr, "Error",
+                                  QString("Error converting old database: %1").arg(convertedName));
+            db.close();
+            return false;
+        }
+
+        QString text = QString("Old database %1 is opened as converted copy %2.").arg(fileName).arg(convertedName);
+        if (invalidPayloads > 0)
+            text += QString("\n%1 packets have an invalid payload and are saved without payload.").arg(invalidPayloads);
+        QMessageBox::information(nullptr, "Tips", text);
+    }
+
+    isFileLoaded = true;
     return true;
 }
 
 bool SqliteCom::openFile()
 {
-    if (db.isOpen())
+    if (writer.isRunning())
         return true;
 
+    // 关闭打开查看的文件，抓包总是写入临时数据库
+    closeDataBase();
+
     // 提取数据库文件的目录
     QString dirPath = QFileInfo(dbFile).absolutePath();
 
@@ -162,6 +374,12 @@ bool SqliteCom::openFile()
     if (db.open()) {
         if (!createTableIfNotExists())
             return false;
+        if (!writer.start(dbFile.fileName())) {
+            QMessageBox::critical(nullptr, "Error",
+                                  QString("Error starting database writer: %1").arg(dbFile.fileName()));
+            db.close();
+            return false;
+        }
     } else {
         QMessageBox::critical(nullptr, "Error",
                               QString("Error opening database: %1, Error: %2")
@@ -172,53 +390,21 @@ bool SqliteCom::openFile()
     return true;
 }
 
-bool SqliteCom::storePacket(const figkey::PacketInfo &packet)
+bool SqliteCom::storePacket(const PacketRecord& record)
 {
-    if (!db.isOpen())
-        return false;
-
-    if (1 == packet.index) {
-        db.transaction();
-    }
-
-    query.prepare("INSERT INTO Packets (id, timestamp, error, srcIP, destIP, "
-                  "srcMAC, destMAC, srcPort, destPort, protocol,"
-                  "length, data) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
-    query.addBindValue(QVariant::fromValue(packet.index));
-    query.addBindValue(QString::fromStdString(packet.timestamp));
-    query.addBindValue(QVariant::fromValue(static_cast<int>(packet.err)));
-    query.addBindValue(QString::fromStdString(packet.srcIP));
-    query.addBindValue(QString::fromStdString(packet.destIP));
-    query.addBindValue(QString::fromStdString(packet.srcMAC));
-    query.addBindValue(QString::fromStdString(packet.destMAC));
-    query.addBindValue(QVariant::fromValue(packet.srcPort));
-    query.addBindValue(QVariant::fromValue(packet.destPort));
-    query.addBindValue(QVariant::fromValue(static_cast<int>(packet.protocolType)));
-    query.addBindValue(QVariant::fromValue(packet.payloadLength));
-    query.addBindValue(QString::fromStdString(packet.data));
-
-    if (!query.exec()) {
-        db.rollback();  // 如果数据插入失败，则回滚事务
-        qDebug() << "Error inserting into the table: " << query.lastError();
-        return false;
-    }
-
-    return true;  // 仅插入数据，但不提交事务
+    return writer.storePacket(record);
 }
 
-std::vector<figkey::PacketInfo> SqliteCom::getPacket(int start, int rows) {
-    std::vector<figkey::PacketInfo> results;
+std::vector<PacketRecord> SqliteCom::getPacket(qulonglong afterId, int rows) {
+    std::vector<PacketRecord> results;
 
     if (!db.isOpen())
         return results;
 
-    int offset = start - 1;  // 调整为正确的偏移量
-    if (offset < 0)
-        offset = 0;  // 确保偏移量不为负
-
-    query.prepare("SELECT * FROM Packets LIMIT ? OFFSET ?");
+    // 按主键续读，翻页的耗时与页码无关
+    query.prepare("SELECT * FROM Packets WHERE id > ? ORDER BY id LIMIT ?");
+    query.addBindValue(afterId);
     query.addBindValue(rows);
-    query.addBindValue(offset);
 
     if (!query.exec()) {
         qDebug() << "Failed to execute SQL query: " << query.lastError();
@@ -226,146 +412,301 @@ std::vector<figkey::PacketInfo> SqliteCom::getPacket(int start, int rows) {
     }
 
     while (query.next()) {
-      figkey::PacketInfo packet;
-      packet.index = query.value("id").toUInt();
-      packet.timestamp = query.value("timestamp").toString().toStdString();
-      packet.err = query.value("error").toUInt();
-      packet.srcIP = query.value("srcIP").toString().toStdString();
-      packet.destIP = query.value("destIP").toString().toStdString();
-      packet.srcMAC = query.value("srcMAC").toString().toStdString();
-      packet.destMAC = query.value("destMAC").toString().toStdString();
-      packet.srcPort = query.value("srcPort").toUInt();
-      packet.destPort = query.value("destPort").toUInt();
-      packet.protocolType = query.value("protocol").toUInt();
-      packet.payloadLength = query.value("length").toUInt();
-      packet.data = query.value("data").toString().toStdString();
-      results.push_back(packet);
+      results.push_back(readPacket(query));
     }
 
     return results;
 }
 
-std::vector<figkey::PacketInfo> SqliteCom::getPacketByFilter(int start, int rows) {
-    std::vector<figkey::PacketInfo> results;
-    auto filter = figkey::CaptureConfig::Instance().getConfigInfo().filter;
-
-    if (!db.isOpen())
-        return results;
+// 过滤条件的 WHERE 子句，只拼接占位符，过滤值全部作为参数绑定
+static QString formatFilterClause(const figkey::FilterInfo& filter, QVariantList& values) {
+    QString clause;
 
-    int offset = start - 1;  // 调整为正确的偏移量
-    if (offset < 0)
-        offset = 0;  // 确保偏移量不为负
-
-    QString protocolType = QString::number(filter.protocolType);
-    QString ip = QString::fromStdString(filter.ip);
-    QString srcIP = QString::fromStdString(filter.srcIP);
-    QString destIP = QString::fromStdString(filter.destIP);
-    QString portStr = QString::number(filter.port);
-    QString srcPortStr = QString::number(filter.srcPort);
-    QString destPortStr = QString::number(filter.destPort);
-    QString srcMAC = QString::fromStdString(filter.srcMAC);
-    QString destMAC = QString::fromStdString(filter.destMAC);
-    QString minLen = QString::number(filter.minLen);
-    QString maxLen = QString::number(filter.maxLen);
-    QString rowsStr = QString::number(rows);
-    QString offsetStr = QString::number(offset);
-
-    QString queryString;
-    if(filter.protocolType == figkey::PROTOCOL_TYPE_DEFAULT){
-        queryString += QString("SELECT * FROM Packets WHERE (1 = 1) ");
-    }else if(filter.protocolType == figkey::PROTOCOL_TYPE_DOIP){
-        queryString += QString("SELECT * FROM Packets WHERE (`protocol` >= %1) ").arg(protocolType);
-    }else{
-        queryString += QString("SELECT * FROM Packets WHERE (`protocol` = %1) ").arg(protocolType);
+    if(filter.protocolType == figkey::PROTOCOL_TYPE_DOIP){
+        clause += "AND `protocol` >= ? ";
+        values << static_cast<int>(filter.protocolType);
+    }else if(filter.protocolType != figkey::PROTOCOL_TYPE_DEFAULT){
+        clause += "AND `protocol` = ? ";
+        values << static_cast<int>(filter.protocolType);
     }
 
     if(filter.ip.empty()){
-        queryString += QString("AND ('' = '%1' OR `srcIP` = '%1') AND ('' = '%2' OR `destIP` = '%2') ").arg(srcIP,destIP);
+        if(!filter.srcIP.empty()){
+            clause += "AND `srcIP` = ? ";
+            values << formatIpFilter(filter.srcIP);
+        }
+        if(!filter.destIP.empty()){
+            clause += "AND `destIP` = ? ";
+            values << formatIpFilter(filter.destIP);
+        }
     }else{
-        queryString += QString("AND (`srcIP` = '%1' OR `destIP` = '%1') ").arg(ip);
+        clause += "AND (`srcIP` = ? OR `destIP` = ?) ";
+        values << formatIpFilter(filter.ip) << formatIpFilter(filter.ip);
     }
 
     if(filter.port == 0){
-        queryString += QString("AND (0 = %1 OR `srcPort` = %1) AND (0 = %2 OR `destPort` = %2) ").arg(srcPortStr,destPortStr);
+        if(filter.srcPort != 0){
+            clause += "AND `srcPort` = ? ";
+            values << filter.srcPort;
+        }
+        if(filter.destPort != 0){
+            clause += "AND `destPort` = ? ";
+            values << filter.destPort;
+        }
     }else{
-        queryString += QString("AND (`srcPort` = %1 OR `destPort` = %1) ").arg(portStr);
+        clause += "AND (`srcPort` = ? OR `destPort` = ?) ";
+        values << filter.port << filter.port;
     }
 
     if(!filter.srcMAC.empty()){
-        queryString += QString("AND `srcMAC` = '%1' ").arg(srcMAC);
+        clause += "AND `srcMAC` = ? ";
+        values << formatMacFilter(filter.srcMAC);
     }
 
     if(!filter.destMAC.empty()){
-        queryString += QString("AND `destMAC` = '%1' ").arg(destMAC);
+        clause += "AND `destMAC` = ? ";
+        values << formatMacFilter(filter.destMAC);
     }
 
-    if(filter.minLen != 0 && filter.maxLen != 0){
-        queryString += QString("AND (length >= %1 AND length <= %2) ").arg(minLen, maxLen);
-    }else if(filter.minLen != 0){
-        queryString += QString("AND length >= %1 ").arg(minLen);
-    }else if(filter.maxLen != 0){
-        queryString += QString("AND length <= %1 ").arg(maxLen);
+    if(filter.minLen != 0){
+        clause += "AND `length` >= ? ";
+        values << filter.minLen;
+    }
+    if(filter.maxLen != 0){
+        clause += "AND `length` <= ? ";
+        values << filter.maxLen;
     }
 
-    queryString += QString("LIMIT %1 OFFSET %2").arg(rowsStr).arg(offsetStr);
+    return clause;
+}
 
-    query.prepare(queryString);
-    if (!query.exec()) {
-         qDebug() << "Error: " << query.lastError();
+bool SqliteCom::isFilterEmpty(const figkey::FilterInfo& filter) {
+    QVariantList values;
+    return formatFilterClause(filter, values).isEmpty();
+}
+
+std::vector<PacketRecord> SqliteCom::getPacketByFilter(const figkey::FilterInfo& filter, qulonglong afterId, int rows) {
+    std::vector<PacketRecord> results;
+
+    if (!db.isOpen())
+        return results;
+
+    QVariantList values;
+    values << afterId;
+    QString queryString("SELECT * FROM Packets WHERE id > ? ");
+    queryString += formatFilterClause(filter, values);
+    queryString += "ORDER BY id LIMIT ?";
+    values << rows;
+
+    // 过滤条件不变时复用已编译的语句
+    if (queryString != filterString) {
+        filterQuery = QSqlQuery(db);
+        if (!filterQuery.prepare(queryString)) {
+            qDebug() << "Failed to prepare SQL query: " << filterQuery.lastError();
+            filterString.clear();
+            return results;
+        }
+        filterString = queryString;
     }
 
-    qDebug() << queryString;
+    for (int i = 0; i < values.size(); ++i)
+        filterQuery.bindValue(i, values[i]);
 
-    query.prepare(queryString);
-    if (!query.exec()) {
-        qDebug() << "Failed to execute SQL query: " << query.lastError();
+    if (!filterQuery.exec()) {
+        qDebug() << "Failed to execute SQL query: " << filterQuery.lastError();
         return results;
     }
 
-    while (query.next()) {
-        figkey::PacketInfo packet;
-        packet.index = query.value("id").toUInt();
-        // 我们获取字符串值的方式用了一种稍微简短一些的写法
-        packet.timestamp = query.value("timestamp").toString().toUtf8().constData();
-        packet.err = query.value("error").toUInt();
-        packet.srcIP = query.value("srcIP").toString().toUtf8().constData();
-        packet.destIP = query.value("destIP").toString().toUtf8().constData();
-        packet.srcMAC = query.value("srcMAC").toString().toUtf8().constData();
-        packet.destMAC = query.value("destMAC").toString().toUtf8().constData();
-        packet.srcPort = query.value("srcPort").toUInt();
-        packet.destPort = query.value("destPort").toUInt();
-        packet.protocolType = query.value("protocol").toUInt();
-        packet.payloadLength = query.value("length").toUInt();
-        packet.data = query.value("data").toString().toUtf8().constData();
-        results.push_back(packet);
+    while (filterQuery.next()) {
+        results.push_back(readPacket(filterQuery));
     }
+    filterQuery.finish();
 
     return results;
 }
 
-void SqliteCom::writeFile() {
-    if (!db.isOpen())
+void SqliteCom::stopScan() {
+    if (!scanThread.joinable())
         return;
 
-    // 提交事务
-    if (db.commit()) {
-        db.transaction();  // 开始下一个新的事务
+    isScanCancelled = true;
+    scanThread.join();
+}
+
+void SqliteCom::scanPacketBlocks(const figkey::FilterInfo& filter, int blockRows) {
+    stopScan();
+    {
+        std::lock_guard<std::mutex> lock(scanMutex);
+        isScanReady = false;
+        scanRows = 0;
+        scanAfterIds.clear();
     }
-    else
-         qDebug() << "Error commit: " << db.lastError();
+
+    if (!db.isOpen() || (blockRows <= 0))
+        return;
+
+    isScanCancelled = false;
+    scanThread = std::thread(&SqliteCom::runScan, this, db.databaseName(), filter, blockRows);
+}
+
+bool SqliteCom::takePacketBlocks(int& rows, std::vector<qulonglong>& afterIds, figkey::FilterInfo& filter) {
+    std::lock_guard<std::mutex> lock(scanMutex);
+    if (!isScanReady)
+        return false;
+
+    rows = scanRows;
+    afterIds.swap(scanAfterIds);
+    filter = scanFilter;
+    isScanReady = false;
+    return true;
+}
+
+void SqliteCom::runScan(QString fileName, figkey::FilterInfo filter, int blockRows) {
+    int rows{ 0 };
+    std::vector<qulonglong> afterIds;
+    bool isSuccess{ false };
+    {
+        QSqlDatabase scanDb = QSqlDatabase::addDatabase("QSQLITE", FKCAP_SQLITE_SCAN_CONNECT_NAME);
+        scanDb.setDatabaseName(fileName);
+        if (scanDb.open()) {
+            // 打开文件和抓包结束时不建索引，第一次按某个条件过滤时再建该条件用到的索引
+            SqliteWriter::createIndexes(scanDb, filter);
+
+            // 只扫描主键，每 blockRows 行记录一次前一行的 id 作为块的续读位置
+            QVariantList values;
+            QString queryString("SELECT id FROM Packets WHERE (1 = 1) ");
+            queryString += formatFilterClause(filter, values);
+            queryString += "ORDER BY id";
+
+            QSqlQuery scan(scanDb);
+            scan.setForwardOnly(true);
+            scan.prepare(queryString);
+            for (int i = 0; i < values.size(); ++i)
+                scan.bindValue(i, values[i]);
+
+            isSuccess = scan.exec();
+            if (!isSuccess)
+                qDebug() << "Failed to execute SQL query: " << scan.lastError();
+
+            qulonglong lastId{ 0 };
+            while (isSuccess && !isScanCancelled && scan.next()) {
+                if (rows % blockRows == 0)
+                    afterIds.push_back(lastId);
+                lastId = scan.value(0).toULongLong();
+                if (++rows == std::numeric_limits<int>::max())
+                    break;
+            }
+            scan.finish();
+        }
+        else {
+            qDebug() << "Error opening database: " << fileName << scanDb.lastError();
+        }
+        scanDb.close();
+    }
+    QSqlDatabase::removeDatabase(FKCAP_SQLITE_SCAN_CONNECT_NAME);
+
+    if (!isSuccess || isScanCancelled)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(scanMutex);
+        isScanReady = true;
+        scanRows = rows;
+        scanAfterIds.swap(afterIds);
+        scanFilter = filter;
+    }
+    emit packetBlocksReady();
+}
+
+void SqliteCom::writeFile() {
+    writer.flush();
+}
+
+void SqliteCom::removePacketBefore(uint64_t timestamp) {
+    writer.removePacketBefore(timestamp);
 }
 
 bool SqliteCom::createTableIfNotExists()
 {
+    // 地址和负载保存为 BLOB，时间戳为纳秒整数
     if (!query.exec("CREATE TABLE IF NOT EXISTS Packets "
-                    "(id INTEGER PRIMARY KEY, timestamp TEXT, error INTEGER, "
-                    "srcIP TEXT, destIP TEXT, srcMAC TEXT, destMAC TEXT, "
+                    "(id INTEGER PRIMARY KEY, timestamp INTEGER, error INTEGER, "
+                    "srcIP BLOB, destIP BLOB, srcMAC BLOB, destMAC BLOB, "
                     "srcPort INTEGER, destPort INTEGER, protocol INTEGER, "
-                    "length INTEGER, data TEXT, remark TEXT DEFAULT '')")) {
+                    "length INTEGER, data BLOB, remark TEXT DEFAULT '', "
+                    "interface INTEGER DEFAULT 0)")) {
         qDebug() << "Error creating table: " << query.lastError();
         return false;
     }
 
+    // 滚动保存按时间戳删除旧数据包，这个索引在抓包时就需要维护，不随过滤索引延后创建
+    if (!query.exec("CREATE INDEX IF NOT EXISTS PacketsTimestamp ON Packets (timestamp)")) {
+        qDebug() << "Error creating index: " << query.lastError();
+        return false;
+    }
+
+    if (!query.exec(QString("PRAGMA user_version = %1").arg(FKCAP_SQLITE_SCHEMA_VERSION))) {
+        qDebug() << "Error setting schema version: " << query.lastError();
+        return false;
+    }
+
     return true;
 }
 
+bool SqliteCom::isLegacyTable()
+{
+    if (!query.exec("PRAGMA user_version") || !query.next())
+        return false;
+    if (query.value(0).toInt() >= FKCAP_SQLITE_SCHEMA_VERSION)
+        return false;
+
+    // 不含数据包表的数据库无需转换
+    if (!query.exec("SELECT name FROM sqlite_master WHERE type = 'table' AND name = 'Packets'"))
+        return false;
+    return query.next();
+}
+
+bool SqliteCom::convertLegacyTable(int& invalidPayloads)
+{
+    invalidPayloads = 0;
+    // 已经转换过的副本直接使用
+    if (!isLegacyTable())
+        return true;
+
+    // 文本格式的旧表改名后逐行转换到新表，整个转换在一个事务中完成
+    if (!db.transaction())
+        return false;
+
+    QSqlQuery insert(db);
+    bool isSuccess = query.exec("ALTER TABLE Packets RENAME TO PacketsLegacy")
+                     && createTableIfNotExists()
+                     && SqliteWriter::prepareInsert(db, insert, 1);
+
+    QSqlQuery legacy(db);
+    legacy.setForwardOnly(true);
+    if (isSuccess)
+        isSuccess = legacy.exec("SELECT * FROM PacketsLegacy ORDER BY id");
+
+    bool isPayloadValid{ true };
+    while (isSuccess && legacy.next()) {
+        auto record = readLegacyPacket(legacy, isPayloadValid);
+        if (!isPayloadValid)
+            ++invalidPayloads;
+        SqliteWriter::bindPacket(insert, 0, record.info, record.payload);
+        isSuccess = insert.exec();
+    }
+    legacy.finish();
+
+    if (isSuccess)
+        isSuccess = query.exec("DROP TABLE PacketsLegacy") && db.commit();
+
+    if (!isSuccess) {
+        qDebug() << "Error converting old database: " << query.lastError() << insert.lastError() << legacy.lastError();
+        db.rollback();
+        return false;
+    }
+
+    qDebug() << "Converted old database to schema version " << FKCAP_SQLITE_SCHEMA_VERSION
+             << ", invalid payloads: " << invalidPayloads;
+    return true;
+}
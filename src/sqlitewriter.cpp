@@ -0,0 +1,303 @@
+﻿#include <QDebug>
+#include <QtSql/QSqlError>
+#include <chrono>
+#include <algorithm>
+
+#include "sqlitewriter.h"
+#include "config.h"
+#include "packet.h"
+#include "arena.h"
+#include "stats.h"
+
+SqliteWriter::~SqliteWriter()
+{
+    stop();
+}
+
+bool SqliteWriter::start(const QString& fileName)
+{
+    stop();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        queueBytes = 0;
+        isStopping = false;
+        isFlushRequested = false;
+    }
+    removeBefore = 0;
+    removedBefore = 0;
+
+    // QSqlDatabase 连接只能在创建它的线程中使用，因此由写入线程自己打开
+    std::promise<bool> opened;
+    auto result = opened.get_future();
+    thread = std::thread(&SqliteWriter::run, this, fileName, std::move(opened));
+    if (!result.get()) {
+        thread.join();
+        return false;
+    }
+
+    return true;
+}
+
+void SqliteWriter::stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    condition.notify_one();
+    thread.join();
+}
+
+bool SqliteWriter::storePacket(const PacketRecord& record)
+{
+    const auto& cfg = figkey::CaptureConfig::Instance().getConfigInfo();
+    // 按实际占用的内存限制队列，大包和小包混合时数据包数不能反映内存大小
+    uint64_t bytes = sizeof(PacketRecord) + static_cast<uint64_t>(record.payload.size());
+    bool isNotify{ false };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!isRunningFlag || isStopping || (queueBytes + bytes > FKCAP_SQLITE_QUEUE_BYTES)) {
+            figkey::CaptureStatistics::Instance().count(figkey::STATISTICS_STORE_FAILED);
+            return false;
+        }
+
+        queue.push_back(record);
+        queueBytes += bytes;
+        isNotify = (queue.size() == cfg.sqlBatchSize);
+    }
+
+    if (isNotify)
+        condition.notify_one();
+    return true;
+}
+
+void SqliteWriter::flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.empty())
+            return;
+        isFlushRequested = true;
+    }
+    condition.notify_one();
+}
+
+void SqliteWriter::removePacketBefore(uint64_t timestamp)
+{
+    // 只记录最新的保留位置，删除在写入线程的下一轮中执行
+    uint64_t current = removeBefore.load();
+    while ((timestamp > current) && !removeBefore.compare_exchange_weak(current, timestamp)) {
+    }
+}
+
+bool SqliteWriter::openDataBase(QSqlDatabase& db, const QString& fileName)
+{
+    db.setDatabaseName(fileName);
+    if (!db.open()) {
+        qDebug() << "Error opening database: " << fileName << db.lastError();
+        return false;
+    }
+
+    // WAL 模式下界面的查询不阻塞写入；NORMAL 只在检查点同步磁盘，掉电最多丢失最近的事务
+    QSqlQuery pragma(db);
+    if (!pragma.exec("PRAGMA journal_mode=WAL"))
+        qDebug() << "Error setting journal mode: " << pragma.lastError();
+    if (!pragma.exec("PRAGMA synchronous=NORMAL"))
+        qDebug() << "Error setting synchronous mode: " << pragma.lastError();
+
+    return true;
+}
+
+bool SqliteWriter::prepareInsert(QSqlDatabase& db, QSqlQuery& insert, int rows)
+{
+    QString sql("INSERT INTO Packets (id, timestamp, error, srcIP, destIP, "
+                "srcMAC, destMAC, srcPort, destPort, protocol,"
+                "length, data, interface) VALUES ");
+    for (int i = 0; i < rows; ++i) {
+        if (i > 0)
+            sql += ",";
+        sql += "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    }
+
+    insert = QSqlQuery(db);
+    if (!insert.prepare(sql)) {
+        qDebug() << "Error preparing insert: " << insert.lastError();
+        return false;
+    }
+    return true;
+}
+
+// IPv4 地址保存 4 字节，IPv6 保存 16 字节，读取时按长度区分版本
+static QByteArray formatIpBlob(const uint8_t* ip, uint8_t version) {
+    if (4 == version)
+        return QByteArray(reinterpret_cast<const char*>(ip), 4);
+    if (6 == version)
+        return QByteArray(reinterpret_cast<const char*>(ip), PACKET_IP_ADDRESS_LENGTH);
+    return QByteArray("");
+}
+
+bool SqliteWriter::readPayload(const figkey::PacketInfo& packet, QByteArray& payload) {
+    if ((packet.payloadLength == 0) || (packet.payloadOffset + packet.payloadLength > packet.dataLength)) {
+        payload = QByteArray("");
+        return true;
+    }
+
+    payload = QByteArray(static_cast<int>(packet.payloadLength), Qt::Uninitialized);
+    if (!figkey::PacketArena::Instance().read(packet.interfaceId, packet.dataOffset + packet.payloadOffset, packet.payloadLength,
+                                              reinterpret_cast<uint8_t*>(payload.data()))) {
+        payload = QByteArray("");
+        return false;
+    }
+    return true;
+}
+
+int SqliteWriter::bindPacket(QSqlQuery& insert, int pos, const figkey::PacketInfo& packet, const QByteArray& payload) {
+    insert.bindValue(pos++, QVariant::fromValue(packet.index));
+    insert.bindValue(pos++, QVariant::fromValue(static_cast<qulonglong>(packet.timestamp)));
+    insert.bindValue(pos++, QVariant::fromValue(static_cast<int>(packet.err)));
+    insert.bindValue(pos++, formatIpBlob(packet.srcIP, packet.ipVersion));
+    insert.bindValue(pos++, formatIpBlob(packet.destIP, packet.ipVersion));
+    insert.bindValue(pos++, QByteArray(reinterpret_cast<const char*>(packet.srcMAC), PACKET_MAC_ADDRESS_LENGTH));
+    insert.bindValue(pos++, QByteArray(reinterpret_cast<const char*>(packet.destMAC), PACKET_MAC_ADDRESS_LENGTH));
+    insert.bindValue(pos++, QVariant::fromValue(packet.srcPort));
+    insert.bindValue(pos++, QVariant::fromValue(packet.destPort));
+    insert.bindValue(pos++, QVariant::fromValue(static_cast<int>(packet.protocolType)));
+    insert.bindValue(pos++, QVariant::fromValue(packet.payloadLength));
+    insert.bindValue(pos++, payload);
+    insert.bindValue(pos++, QVariant::fromValue(static_cast<int>(packet.interfaceId)));
+    return pos;
+}
+
+void SqliteWriter::run(QString fileName, std::promise<bool> opened)
+{
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", FKCAP_SQLITE_WRITER_CONNECT_NAME);
+        // 语句只编译一次，之后每批只重新绑定参数
+        bool isOpened = openDataBase(db, fileName)
+                        && prepareInsert(db, batchInsert, FKCAP_SQLITE_INSERT_ROWS)
+                        && prepareInsert(db, rowInsert, 1);
+        isRunningFlag = isOpened;
+        opened.set_value(isOpened);
+
+        const auto& cfg = figkey::CaptureConfig::Instance().getConfigInfo();
+        std::vector<PacketRecord> packets;
+        bool isLast = !isOpened;
+        while (!isLast) {
+            {
+                // 队列达到 SqlBatchSize 或等待超过 TimeSqlTransaction 时写入
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait_for(lock, std::chrono::milliseconds(cfg.timeSqlTransaction), [&] {
+                    return isStopping || isFlushRequested || (queue.size() >= cfg.sqlBatchSize);
+                });
+                packets.swap(queue);
+                queueBytes = 0;
+                isFlushRequested = false;
+                isLast = isStopping;
+            }
+
+            writePackets(db, packets);
+            packets.clear();
+            removePackets(db);
+        }
+
+        isRunningFlag = false;
+
+        // 预编译语句属于当前连接，关闭前释放
+        batchInsert = QSqlQuery();
+        rowInsert = QSqlQuery();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(FKCAP_SQLITE_WRITER_CONNECT_NAME);
+}
+
+bool SqliteWriter::createIndexes(QSqlDatabase& db, const figkey::FilterInfo& filter)
+{
+    // 索引隐含按 id 排序，等值过滤后可直接按主键续读；只建过滤条件用到的列，不过滤时不建索引
+    std::vector<const char*> indexes;
+    if (filter.protocolType != figkey::PROTOCOL_TYPE_DEFAULT)
+        indexes.push_back("CREATE INDEX IF NOT EXISTS PacketsProtocol ON Packets (protocol)");
+    if (!filter.ip.empty() || !filter.srcIP.empty())
+        indexes.push_back("CREATE INDEX IF NOT EXISTS PacketsSrcIP ON Packets (srcIP)");
+    if (!filter.ip.empty() || !filter.destIP.empty())
+        indexes.push_back("CREATE INDEX IF NOT EXISTS PacketsDestIP ON Packets (destIP)");
+    if ((filter.port != 0) || (filter.srcPort != 0))
+        indexes.push_back("CREATE INDEX IF NOT EXISTS PacketsSrcPort ON Packets (srcPort)");
+    if ((filter.port != 0) || (filter.destPort != 0))
+        indexes.push_back("CREATE INDEX IF NOT EXISTS PacketsDestPort ON Packets (destPort)");
+    if ((filter.minLen != 0) || (filter.maxLen != 0))
+        indexes.push_back("CREATE INDEX IF NOT EXISTS PacketsLength ON Packets (length)");
+
+    QSqlQuery create(db);
+    for (auto sql : indexes) {
+        if (!create.exec(sql)) {
+            qDebug() << "Error creating index: " << create.lastError();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SqliteWriter::writePackets(QSqlDatabase& db, const std::vector<PacketRecord>& packets)
+{
+    auto& stats = figkey::CaptureStatistics::Instance();
+    const size_t batchSize = figkey::CaptureConfig::Instance().getConfigInfo().sqlBatchSize;
+
+    for (size_t begin = 0; begin < packets.size(); begin += batchSize) {
+        size_t count = std::min(batchSize, packets.size() - begin);
+        size_t i = begin;
+        size_t end = begin + count;
+
+        bool isSuccess = db.transaction();
+        while (isSuccess && (end - i >= FKCAP_SQLITE_INSERT_ROWS)) {
+            int pos = 0;
+            for (size_t rowEnd = i + FKCAP_SQLITE_INSERT_ROWS; i < rowEnd; ++i)
+                pos = bindPacket(batchInsert, pos, packets[i].info, packets[i].payload);
+            isSuccess = batchInsert.exec();
+            if (!isSuccess)
+                qDebug() << "Error inserting into the table: " << batchInsert.lastError();
+        }
+        while (isSuccess && (i < end)) {
+            bindPacket(rowInsert, 0, packets[i].info, packets[i].payload);
+            ++i;
+            isSuccess = rowInsert.exec();
+            if (!isSuccess)
+                qDebug() << "Error inserting into the table: " << rowInsert.lastError();
+        }
+
+        if (isSuccess)
+            isSuccess = db.commit();
+
+        if (!isSuccess) {
+            db.rollback();  // 如果数据插入失败，则回滚整个批次
+            qDebug() << "Error storing packets: " << db.lastError();
+            stats.count(figkey::STATISTICS_STORE_FAILED, count);
+            continue;
+        }
+
+        stats.count(figkey::STATISTICS_STORED, count);
+    }
+}
+
+void SqliteWriter::removePackets(QSqlDatabase& db)
+{
+    uint64_t timestamp = removeBefore.load();
+    if (timestamp <= removedBefore)
+        return;
+
+    // 删除的空间由 SQLite 复用，文件大小不再持续增长
+    QSqlQuery remove(db);
+    remove.prepare("DELETE FROM Packets WHERE timestamp < ?");
+    remove.addBindValue(QVariant::fromValue(static_cast<qulonglong>(timestamp)));
+    if (!remove.exec()) {
+        qDebug() << "Error removing old packets: " << remove.lastError();
+        return;
+    }
+
+    removedBefore = timestamp;
+}
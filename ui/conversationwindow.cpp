@@ -0,0 +1,144 @@
+﻿#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QFileDialog>
+#include <QMessageBox>
+
+#include "conversationwindow.h"
+#include "flow.h"
+#include "packet.h"
+
+#define CONVERSATION_REFRESH_INTERVAL 1000  //ms
+
+enum CONVERSATION_COLUMN {
+    CONVERSATION_COLUMN_ID,
+    CONVERSATION_COLUMN_PROTOCOL,
+    CONVERSATION_COLUMN_ADDRESS_A,
+    CONVERSATION_COLUMN_PORT_A,
+    CONVERSATION_COLUMN_ADDRESS_B,
+    CONVERSATION_COLUMN_PORT_B,
+    CONVERSATION_COLUMN_PACKETS_AB,
+    CONVERSATION_COLUMN_BYTES_AB,
+    CONVERSATION_COLUMN_PACKETS_BA,
+    CONVERSATION_COLUMN_BYTES_BA,
+    CONVERSATION_COLUMN_START,
+    CONVERSATION_COLUMN_DURATION,
+    CONVERSATION_COLUMN_HANDSHAKE_RTT,
+    CONVERSATION_COLUMN_RTT,
+    CONVERSATION_COLUMN_STATE,
+    CONVERSATION_COLUMN_MAX
+};
+
+// 数值列按数值排序
+static QTableWidgetItem* createItem(const QVariant& value)
+{
+    QTableWidgetItem* item = new QTableWidgetItem();
+    item->setData(Qt::DisplayRole, value);
+    item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+    return item;
+}
+
+ConversationWindow::ConversationWindow(QWidget* parent)
+    : QDialog(parent)
+    , tableFlows(new QTableWidget(0, CONVERSATION_COLUMN_MAX, this))
+    , labelSummary(new QLabel(this))
+    , buttonRefresh(new QPushButton("Refresh", this))
+    , buttonExport(new QPushButton("Export", this))
+    , timer(new QTimer(this))
+{
+    initWindow();
+    connect(buttonRefresh, &QPushButton::clicked, this, &ConversationWindow::refresh);
+    connect(buttonExport, &QPushButton::clicked, this, &ConversationWindow::onExportButtonClicked);
+    connect(timer, &QTimer::timeout, this, &ConversationWindow::refresh);
+}
+
+ConversationWindow::~ConversationWindow()= default;
+
+void ConversationWindow::initWindow()
+{
+    setWindowTitle("Conversations");
+    resize(1200, 500);
+
+    QStringList headers;
+    headers << "Id" << "Protocol" << "Address A" << "Port A" << "Address B" << "Port B"
+            << "Packets A->B" << "Bytes A->B" << "Packets B->A" << "Bytes B->A"
+            << "Start" << "Duration(s)" << "Handshake RTT(ms)" << "RTT(ms)" << "State";
+    tableFlows->setHorizontalHeaderLabels(headers);
+    tableFlows->verticalHeader()->setVisible(false);
+    tableFlows->setSelectionBehavior(QAbstractItemView::SelectRows);
+    tableFlows->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    tableFlows->sortByColumn(CONVERSATION_COLUMN_ID, Qt::AscendingOrder);
+
+    QHBoxLayout* buttonLayout = new QHBoxLayout();
+    buttonLayout->addWidget(labelSummary);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(buttonRefresh);
+    buttonLayout->addWidget(buttonExport);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    mainLayout->addWidget(tableFlows);
+    mainLayout->addLayout(buttonLayout);
+    setLayout(mainLayout);
+}
+
+void ConversationWindow::showEvent(QShowEvent* event)
+{
+    refresh();
+    timer->start(CONVERSATION_REFRESH_INTERVAL);
+    QDialog::showEvent(event);
+}
+
+void ConversationWindow::hideEvent(QHideEvent* event)
+{
+    timer->stop();
+    QDialog::hideEvent(event);
+}
+
+void ConversationWindow::refresh()
+{
+    auto& table = figkey::FlowTable::Instance();
+    std::vector<figkey::FlowInfo> flows = table.getFlows();
+
+    // 填充期间关闭排序，避免每设置一个单元格就重新排序
+    tableFlows->setSortingEnabled(false);
+    tableFlows->setRowCount(static_cast<int>(flows.size()));
+    for (int row = 0; row < static_cast<int>(flows.size()); ++row) {
+        const auto& flow = flows[row];
+        const auto& key = flow.key;
+        QVariant values[CONVERSATION_COLUMN_MAX];
+        values[CONVERSATION_COLUMN_ID] = flow.id;
+        values[CONVERSATION_COLUMN_PROTOCOL] = (figkey::PROTOCOL_TYPE_TCP == key.protocol) ? "TCP" : "UDP";
+        values[CONVERSATION_COLUMN_ADDRESS_A] = QString::fromStdString(figkey::formatIpAddress(key.ipA, key.ipVersion));
+        values[CONVERSATION_COLUMN_PORT_A] = key.portA;
+        values[CONVERSATION_COLUMN_ADDRESS_B] = QString::fromStdString(figkey::formatIpAddress(key.ipB, key.ipVersion));
+        values[CONVERSATION_COLUMN_PORT_B] = key.portB;
+        values[CONVERSATION_COLUMN_PACKETS_AB] = static_cast<qulonglong>(flow.packets[0]);
+        values[CONVERSATION_COLUMN_BYTES_AB] = static_cast<qulonglong>(flow.bytes[0]);
+        values[CONVERSATION_COLUMN_PACKETS_BA] = static_cast<qulonglong>(flow.packets[1]);
+        values[CONVERSATION_COLUMN_BYTES_BA] = static_cast<qulonglong>(flow.bytes[1]);
+        values[CONVERSATION_COLUMN_START] = QString::fromStdString(figkey::formatPacketTimestamp(flow.firstTimestamp));
+        values[CONVERSATION_COLUMN_DURATION] = (flow.lastTimestamp - flow.firstTimestamp) / 1e9;
+        values[CONVERSATION_COLUMN_HANDSHAKE_RTT] = flow.handshakeRtt / 1e6;
+        values[CONVERSATION_COLUMN_RTT] = flow.smoothedRtt / 1e6;
+        values[CONVERSATION_COLUMN_STATE] = figkey::FlowTable::getStateName(flow.state);
+
+        for (int column = 0; column < CONVERSATION_COLUMN_MAX; ++column)
+            tableFlows->setItem(row, column, createItem(values[column]));
+    }
+    tableFlows->setSortingEnabled(true);
+
+    QString summary = QString("Conversations: %1").arg(flows.size());
+    if (table.getUntracked() > 0)
+        summary += QString("  Untracked packets: %1").arg(table.getUntracked());
+    labelSummary->setText(summary);
+}
+
+void ConversationWindow::onExportButtonClicked()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, "Export Conversations", "", "CSV Files (*.csv)");
+    if (fileName.isEmpty())
+        return;
+
+    if (!figkey::FlowTable::Instance().dumpFile(fileName.toStdString()))
+        QMessageBox::warning(this, "Warning", "Failed to export conversations to " + fileName);
+}
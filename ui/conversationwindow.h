@@ -0,0 +1,42 @@
+﻿#ifndef CONVERSATIONWINDOW_H
+#define CONVERSATIONWINDOW_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QTimer>
+#include <QShowEvent>
+#include <QHideEvent>
+
+// 连接统计窗口，显示 FlowTable 的快照，窗口可见时定时刷新
+class ConversationWindow : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ConversationWindow(QWidget* parent = nullptr);
+    ~ConversationWindow();
+
+public slots:
+    void refresh();
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private slots:
+    void onExportButtonClicked();
+
+private:
+    void initWindow();
+
+private:
+    QTableWidget* tableFlows;
+    QLabel* labelSummary;
+    QPushButton* buttonRefresh;
+    QPushButton* buttonExport;
+    QTimer* timer;
+};
+
+#endif // CONVERSATIONWINDOW_H
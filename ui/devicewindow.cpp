@@ -100,8 +100,25 @@ void DeviceWindow::on_pushButton_clicked()
         // 没有选中项目，弹出警告框
         QMessageBox::warning(this, "Warning", "No item was selected.");
     }
-    else if (this->ui->treeView->currentIndex().isValid()) {
-        const QModelIndex &index = this->ui->treeView->currentIndex();
-        on_treeView_doubleClicked(index);
+    else {
+        // 按住 Ctrl 选择多个网卡时同时抓包，网卡编号按选择顺序分配
+        using namespace figkey;
+        std::vector<NetworkInfo> networks;
+        QList<QModelIndex> selected;
+        for (const auto& index : selectedIndices) {
+            QModelIndex item = index.parent().isValid() ? index.parent() : index;
+            if (selected.contains(item))
+                continue;
+            selected.append(item);
+            networks.emplace_back(item.data(Qt::UserRole+1).value<NetworkInfo>());
+        }
+
+        if (networks.size() > CAPTURE_INTERFACE_MAX) {
+            QMessageBox::warning(this, "Warning", QString("At most %1 network cards can be captured at the same time.").arg(CAPTURE_INTERFACE_MAX));
+            return;
+        }
+
+        CaptureConfig::Instance().setNetworks(networks);
+        exitWindow();
     }
 }
@@ -2,12 +2,16 @@
 #include <QMessageBox>
 #include <QTimer>
 #include <QScrollBar>
+#include <QHeaderView>
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
 #include <QInputDialog>
 #include <QFileDialog>
 #include <QClipboard>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <algorithm>
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
@@ -15,11 +19,22 @@
 #include "ipcap.h"
 #include "config.h"
 #include "protocol/ip.h"
+#include "dispatch.h"
+#include "packet.h"
+#include "stats.h"
+#include "pcapng.h"
 #include "senderwindow.h"
 #include "vehicleidentifywindow.h"
 #include "devicewindow.h"
 #include "doipsettingwindow.h"
 
+#define FKCAP_STATISTICS_PATH "/db/statistics.json"
+#define FKCAP_PCAPNG_PATH "/db/figkey.pcapng"
+// 界面刷新间隔最多放慢到 TimeUpdateUI 的倍数
+#define FKCAP_UI_INTERVAL_MAX_SCALE 8
+// 超过该速率（包/秒）时界面按繁忙处理，放慢刷新
+#define FKCAP_UI_BUSY_RATE 20000
+
 MainWindow::MainWindow(bool isStart, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
@@ -35,7 +50,7 @@ MainWindow::~MainWindow()
 
     QSqlDatabase::removeDatabase(FKCAP_SQLITE_CONNECT_NAME);
 
-    figkey::IPPacketParse::Instance().setCallback(nullptr);
+    figkey::PacketDispatcher::Instance().setCallback(nullptr);
 
     if (timerUpdateUI)
         delete timerUpdateUI;  // 在析构函数中删除定时器
@@ -69,6 +84,15 @@ void MainWindow::initTableView() {
      });
 
     connect(this->ui->tableView, &QTableView::doubleClicked, this, &MainWindow::onTableViewDoubleClicked);
+
+    // Information 列只转换列宽能显示的负载，留出余量避免字符宽度不同时提前截断
+    connect(this->ui->tableView->horizontalHeader(), &QHeaderView::sectionResized,
+            this, [&](int logicalIndex, int, int newSize) {
+                if (logicalIndex != 6)
+                    return;
+                int charWidth = std::max(1, this->ui->tableView->fontMetrics().averageCharWidth());
+                pim->setInformationLength(newSize / charWidth * 3 / 2 + 16);
+            });
 }
 
 void MainWindow::initTreeView() {
@@ -76,7 +100,7 @@ void MainWindow::initTreeView() {
 
     // 对PacketInfo中的每一个字段，新建一行，标签在第一列，初始值在第二列
     QStringList headerList;
-    headerList << "timestamp:" << "error code:" << "source ip:" << "destination ip:" << "source mac:"
+    headerList << "timestamp:" << "interface:" << "error code:" << "source ip:" << "destination ip:" << "source mac:"
                << "destination mac:" << "source port:" << "destination port:" << "protocol type:"
                << "payload length:" << "data:";
 
@@ -108,8 +132,15 @@ void MainWindow::initWindow(bool isStart)
     using namespace figkey;
     const auto& cfg = CaptureConfig::Instance().getConfigInfo();
 
-    // 使用std::bind设置回调函数
-    IPPacketParse::Instance().setCallback(std::bind(&MainWindow::processPacket, this, std::placeholders::_1));
+    // 使用std::bind设置批量回调函数，抓包线程按批次投递
+    PacketDispatcher::Instance().setCallback(std::bind(&MainWindow::processPacketBatch, this, std::placeholders::_1));
+
+    CaptureConfig::Instance().setPcapngFile((QCoreApplication::applicationDirPath() + FKCAP_PCAPNG_PATH).toStdString());
+
+    connect(&db, &SqliteCom::packetBlocksReady, this, &MainWindow::onPacketBlocksReady);
+
+    labelStatistics = new QLabel(this);
+    ui->statusBar->addPermanentWidget(labelStatistics);
 
     timerUpdateUI = new QTimer(this);
     connect(timerUpdateUI, &QTimer::timeout, this, &MainWindow::updateUI);
@@ -145,19 +176,26 @@ void MainWindow::closeEvent(QCloseEvent *event) {
     }
 }
 
-void MainWindow::updateTreeView(const figkey::PacketInfo& packet) {
+void MainWindow::updateTreeView(const PacketRecord& record) {
+    const auto& packet = record.info;
+    const auto& networks = figkey::CaptureConfig::Instance().getConfigInfo().networks;
+    QString interfaceName = QString::number(packet.interfaceId);
+    if (packet.interfaceId < networks.size())
+        interfaceName += " " + QString::fromStdString(networks[packet.interfaceId].description);
+
     QStringList valueList;
-    valueList << QString::fromStdString(packet.timestamp)
+    valueList << QString::fromStdString(figkey::formatPacketTimestamp(packet.timestamp))
+              << interfaceName
               << QString::number(packet.err)
-              << QString::fromStdString(packet.srcIP)
-              << QString::fromStdString(packet.destIP)
-              << QString::fromStdString(packet.srcMAC)
-              << QString::fromStdString(packet.destMAC)
+              << QString::fromStdString(figkey::formatIpAddress(packet.srcIP, packet.ipVersion))
+              << QString::fromStdString(figkey::formatIpAddress(packet.destIP, packet.ipVersion))
+              << QString::fromStdString(figkey::formatMacAddress(packet.srcMAC))
+              << QString::fromStdString(figkey::formatMacAddress(packet.destMAC))
               << QString::number(packet.srcPort)
               << QString::number(packet.destPort)
               << QString::number(packet.protocolType)
               << QString::number(packet.payloadLength)
-              << QString::fromStdString(packet.data);
+              << QString::fromStdString(formatRecordData(record));
 
     for(int i = 0; i < valueList.size(); i++) {
         QStandardItem *item = new QStandardItem(valueList[i]);
@@ -172,10 +210,27 @@ void MainWindow::updateTreeView(const figkey::PacketInfo& packet) {
 }
 
 void MainWindow::updateUI() {
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    // 上一个周期暂存的数据包一次插入表格
+    size_t trimmed{ 0 };
+    size_t rows = pim->commitStaged(trimmed);
+    figkey::CaptureStatistics::Instance().count(figkey::STATISTICS_DISPLAYED, rows);
+    figkey::CaptureStatistics::Instance().count(figkey::STATISTICS_DISPLAY_DROPPED, trimmed);
+
     {
         QMutexLocker locker(&mutexPacket);
-        if (packetCounter > 0)
+        if (packetCounter > 0) {
+            db.removePacketBefore(figkey::PcapngWriter::Instance().getRetainedSince());
             db.writeFile();
+        }
+    }
+
+    // 离线文件读取完成后按停止处理，投递剩余数据并提交数据库
+    if (figkey::NpcapCom::Instance().isFinished()) {
+        on_actionStop_triggered();
+        ui->statusBar->showMessage("Capture file import finished");
     }
 
     if (figkey::NpcapCom::Instance().getIsRunning()) {
@@ -183,7 +238,53 @@ void MainWindow::updateUI() {
 
         if (!userHasScrolled || scrollBarAtBottom)
             ui->tableView->scrollToBottom();
+
+        updateStatistics();
     }
+
+    // 按到达的数据包数判断繁忙，包括超过表格行数没有插入的
+    adjustUpdateInterval(elapsed.elapsed(), rows + trimmed);
+}
+
+void MainWindow::adjustUpdateInterval(qint64 cost, size_t rows) {
+    const int base = figkey::CaptureConfig::Instance().getConfigInfo().timeUpdateUI;
+    int interval = timerUpdateUI->interval();
+    uint64_t rate = static_cast<uint64_t>(rows) * 1000 / std::max(interval, 1);
+
+    // 刷新占用超过一半周期或流量很大时放慢刷新，空闲后逐步恢复
+    if ((cost * 2 > interval) || (rate > FKCAP_UI_BUSY_RATE))
+        interval = std::min(interval * 2, base * FKCAP_UI_INTERVAL_MAX_SCALE);
+    else if ((cost * 8 < interval) && (rate < FKCAP_UI_BUSY_RATE / 2))
+        interval = std::max(interval / 2, base);
+
+    if (interval != timerUpdateUI->interval())
+        timerUpdateUI->setInterval(interval);
+}
+
+void MainWindow::updateStatistics() {
+    using namespace figkey;
+    auto& stats = CaptureStatistics::Instance();
+    NpcapCom::Instance().sampleStatistics();
+
+    // 按处理阶段显示丢包位置：驱动、抓包回调、解析、过滤、缓冲区、数据库
+    auto info = stats.getStatistics();
+    uint64_t parseDropped = info.counter[STATISTICS_SHORT_FRAME] + info.counter[STATISTICS_PARSE_FAILED];
+    labelStatistics->setText(QString("Recv: %1  Drop: %2/%3  Captured: %4  Snap: %5  Parsed: %6  ParseErr: %7  "
+                                     "Filtered: %8  Queued: %9  RingDrop: %10  Stored: %11  Displayed: %12  DisplayDrop: %13  UI: %14 ms")
+                             .arg(info.pcapReceived)
+                             .arg(info.pcapDropped)
+                             .arg(info.pcapIfDropped)
+                             .arg(info.counter[STATISTICS_CAPTURED])
+                             .arg(info.counter[STATISTICS_SNAP_DROPPED])
+                             .arg(info.counter[STATISTICS_PARSED])
+                             .arg(parseDropped)
+                             .arg(info.counter[STATISTICS_FILTERED])
+                             .arg(info.counter[STATISTICS_ENQUEUED])
+                             .arg(info.counter[STATISTICS_RING_DROPPED])
+                             .arg(info.counter[STATISTICS_STORED])
+                             .arg(info.counter[STATISTICS_DISPLAYED])
+                             .arg(info.counter[STATISTICS_DISPLAY_DROPPED])
+                             .arg(timerUpdateUI->interval()));
 }
 
 void MainWindow::onTableViewDoubleClicked(const QModelIndex& index) {
@@ -194,22 +295,32 @@ void MainWindow::onTableViewDoubleClicked(const QModelIndex& index) {
         else if (server.isVisible() && !client.isVisible())
             server.addRow(info);
         QClipboard *clipboard = QApplication::clipboard();
-        clipboard->setText(info.data.c_str());
+        clipboard->setText(QString::fromStdString(formatRecordPayload(info)));
     }
 }
 
-void MainWindow::processPacket(figkey::PacketInfo packetInfo)
+void MainWindow::processPacketBatch(std::vector<figkey::PacketInfo> packets)
 {
+    // 在抓包回调线程中执行，不直接操作模型，由界面线程每个刷新周期统一插入
     QMutexLocker locker(&mutexPacket);
-    packetInfo.index = ++packetCounter;
-    if (1 == packetInfo.index) {
-        pim->clearPacket();
-        ui->tableView->update();
-        //updateTreeView(packetInfo);
+    std::vector<PacketRecord> records;
+    records.reserve(packets.size());
+    for (auto& packetInfo : packets) {
+        packetInfo.index = ++packetCounter;
+
+        // 回调返回后 arena 中的数据会被释放，负载在这里拷贝一次，数据库和表格共用
+        PacketRecord record{ packetInfo, QByteArray() };
+        if (SqliteWriter::readPayload(packetInfo, record.payload))
+            db.storePacket(record);
+        else
+            figkey::CaptureStatistics::Instance().count(figkey::STATISTICS_STORE_FAILED);
+        records.emplace_back(std::move(record));
     }
 
-    db.storePacket(packetInfo);
-    pim->addPacket(packetInfo);
+    // 界面长时间跟不上时暂存区满，这批数据包已写入数据库，只是不显示
+    size_t count = records.size();
+    if (!pim->stagePackets(std::move(records)))
+        figkey::CaptureStatistics::Instance().count(figkey::STATISTICS_DISPLAY_DROPPED, count);
 }
 
 void MainWindow::on_actionStop_triggered()
@@ -221,6 +332,13 @@ void MainWindow::on_actionStop_triggered()
     ui->actionStop->setEnabled(false);
 
     figkey::NpcapCom::Instance().stopCapture();
+    size_t trimmed{ 0 };
+    figkey::CaptureStatistics::Instance().count(figkey::STATISTICS_DISPLAYED, pim->commitStaged(trimmed));
+    figkey::CaptureStatistics::Instance().count(figkey::STATISTICS_DISPLAY_DROPPED, trimmed);
+    updateStatistics();
+
+    // 机器可读的统计数据在抓包结束时写入一次，界面刷新时不写磁盘
+    figkey::CaptureStatistics::Instance().dumpFile((QCoreApplication::applicationDirPath() + FKCAP_STATISTICS_PATH).toStdString());
 
     {
         QMutexLocker locker(&mutexPacket);
@@ -238,6 +356,7 @@ void MainWindow::on_actionStart_triggered()
     if (db.openFile()) {
         ui->actionSave->setEnabled(true);
     }
+    pim->clearPacket();
 
     if (NpcapCom::Instance().run()) {
         ui->actionPause->setEnabled(true);
@@ -279,24 +398,24 @@ void MainWindow::on_actionPause_triggered()
 
 void MainWindow::on_actionFilter_triggered()
 {
-    pauseCapture();
-
+    // 过滤器以原子方式替换，抓包不需要暂停
     FilterWindow f;
     f.adjustSize();
     f.setFixedSize(f.size());
-    f.exec();
-
-    pauseCapture();
+    if (QDialog::Accepted == f.exec()) {
+        figkey::NpcapCom::Instance().updateFilter();
+        if (db.isLoaded())
+            reloadDataBase();
+    }
 }
 
 void MainWindow::on_actionFilter_Clear_triggered()
 {
-    pauseCapture();
-
     figkey::FilterInfo filter;
     figkey::CaptureConfig::Instance().setFilter(filter);
-
-    pauseCapture();
+    figkey::NpcapCom::Instance().updateFilter();
+    if (db.isLoaded())
+        reloadDataBase();
 }
 
 void MainWindow::on_actionOpen_triggered()
@@ -308,27 +427,86 @@ void MainWindow::on_actionOpen_triggered()
         on_actionStop_triggered();
     }
 
-    if (db.loadFile()) {
-       auto packets = db.getPacketByFilter(1, figkey::CaptureConfig::Instance().getConfigInfo().displayRows);
-       if (packets.empty()) {
-           QMessageBox::warning(nullptr, "Warning",
-                                QString("The current database file is an empty file")
-                                );
-           return;
-       }
-
-       pim->loadPackect(packets);
-       ui->tableView->update();
+    if (db.loadFile())
+        reloadDataBase();
+}
+
+void MainWindow::reloadDataBase()
+{
+    // 大文件的扫描和建索引在后台进行，界面保持响应，完成前表格仍显示上一次加载的结果
+    ui->statusBar->showMessage("Loading packets...");
+    db.scanPacketBlocks(figkey::CaptureConfig::Instance().getConfigInfo().filter, PACKET_MODEL_BLOCK_ROWS);
+}
+
+void MainWindow::onPacketBlocksReady()
+{
+    int rows{ 0 };
+    std::vector<qulonglong> blocks;
+    figkey::FilterInfo filter;
+    if (!db.takePacketBlocks(rows, blocks, filter))
+        return;
+
+    ui->statusBar->showMessage(QString("Loaded %1 packets").arg(rows));
+    if ((rows == 0) && SqliteCom::isFilterEmpty(filter)) {
+        QMessageBox::warning(nullptr, "Warning",
+                             QString("The current database file is an empty file")
+                             );
+        return;
     }
+
+    // 表格只记录各块的位置，滚动到的行按块从数据库读取；读取使用统计块时的过滤条件，
+    // 之后修改过滤条件不会使行号与块错位，新的条件扫描完成后整体替换
+    pim->loadDataBase(blocks, rows, [this, filter](qulonglong afterId, int count) {
+        return db.getPacketByFilter(filter, afterId, count);
+    });
+    ui->tableView->update();
 }
 
 void MainWindow::on_actionSave_triggered()
 {
     ui->actionSave->setEnabled(false);
-    db.saveFile();
+    db.saveFile(QString::fromStdString(figkey::CaptureConfig::Instance().getConfigInfo().pcapngFile));
     ui->actionSave->setEnabled(true);
 }
 
+void MainWindow::on_actionImport_triggered()
+{
+    if (!ui->actionStart->isEnabled()) {
+        // 调用函数停止数据捕获
+        on_actionStop_triggered();
+    }
+
+    QString fileName = QFileDialog::getOpenFileName(this, "Import Capture File",
+                                                    QDir::homePath(),
+                                                    "Capture Files (*.pcap *.pcapng *.cap);;All Files (*)");
+    if (fileName.isEmpty())
+        return;
+
+    // 最快速度用于批量分析，实时回放按原始包间隔投递
+    QStringList modes;
+    modes << "Max speed" << "Real-time replay";
+    bool ok{ false };
+    QString mode = QInputDialog::getItem(this, "Import Capture File", "Read mode:", modes, 0, false, &ok);
+    if (!ok)
+        return;
+
+    if (db.openFile()) {
+        ui->actionSave->setEnabled(true);
+    }
+    pim->clearPacket();
+
+    if (figkey::NpcapCom::Instance().runOffline(fileName.toStdString(), mode == modes[1])) {
+        ui->actionStart->setEnabled(false);
+        ui->actionPause->setEnabled(true);
+        ui->actionStop->setEnabled(true);
+        ui->statusBar->showMessage("Importing " + fileName);
+    }
+    else {
+        QMessageBox::critical(nullptr, "Error",
+                              QString("Failed to read the capture file %1").arg(fileName));
+    }
+}
+
 void MainWindow::updateTreeViewByIndex(const QModelIndex& index) {
     if (!index.isValid())
         return;
@@ -351,7 +529,7 @@ void MainWindow::on_tableView_clicked(const QModelIndex &index)
 void MainWindow::on_actionClient_triggered()
 {
     if (!client.isVisible()) {
-        client.set(pim->getPacketByIndex(currentIndex));
+        client.set(pim->getPacketByIndex(currentIndex).info);
         client.show();
     }
 }
@@ -359,7 +537,7 @@ void MainWindow::on_actionClient_triggered()
 void MainWindow::on_actionServer_triggered()
 {
     if (!server.isVisible()) {
-        server.set(pim->getPacketByIndex(currentIndex));
+        server.set(pim->getPacketByIndex(currentIndex).info);
         server.show();
     }
 }
@@ -432,15 +610,15 @@ void MainWindow::on_actionSave_Server_Test_triggered()
 
 void MainWindow::on_actionSimulation_Client_triggered()
 {
-    QVector<figkey::PacketInfo> packets(pim->getAllPacket());
-    QVector<figkey::PacketInfo>::iterator it = std::remove_if(packets.begin(), packets.end(), [](const figkey::PacketInfo& packet) {
-        return packet.data.empty();
+    QVector<PacketRecord> packets(pim->getAllPacket());
+    QVector<PacketRecord>::iterator it = std::remove_if(packets.begin(), packets.end(), [](const PacketRecord& packet) {
+        return 0 == packet.info.payloadLength;
     });
     packets.erase(it, packets.end());
     if (packets.empty())
         return;
 
-    client.setSimulation(packets[0]);
+    client.setSimulation(packets[0].info);
     for (const auto& packet : packets) {
         if (!client.addRow(packet)) {
             break;
@@ -452,16 +630,16 @@ void MainWindow::on_actionSimulation_Client_triggered()
 
 void MainWindow::on_actionSimulation_Server_triggered()
 {
-    QVector<figkey::PacketInfo> packets(pim->getAllPacket());
+    QVector<PacketRecord> packets(pim->getAllPacket());
     packets.erase(std::remove_if(packets.begin(), packets.end(),
-                                           [](const figkey::PacketInfo& packet){
-                                              return packet.data.empty();
+                                           [](const PacketRecord& packet){
+                                              return 0 == packet.info.payloadLength;
                                           }),
                            packets.end());
     if (packets.empty())
         return;
 
-    server.setSimulation(packets[0]);
+    server.setSimulation(packets[0].info);
     for (const auto& packet : packets) {
         if (!server.addRow(packet)) {
             break;
@@ -509,3 +687,10 @@ void MainWindow::on_actionDoIP_triggered()
     DoIPSettingWindow setting;
     setting.exec();
 }
+
+void MainWindow::on_actionConversations_triggered()
+{
+    conversation.show();
+    conversation.raise();
+    conversation.activateWindow();
+}
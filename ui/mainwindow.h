@@ -4,10 +4,12 @@
 #include <QMainWindow>
 #include <QCloseEvent>
 #include <QStandardItemModel>
+#include <QLabel>
 
 #include "sqlite.h"
 #include "packeinfo.h"
 #include "networkassistwindow.h"
+#include "conversationwindow.h"
 
 namespace Ui {
 class MainWindow;
@@ -21,7 +23,7 @@ public:
     explicit MainWindow(bool isStart = true, QWidget *parent = 0);
     ~MainWindow();
 
-    void processPacket(figkey::PacketInfo packetInfo);
+    void processPacketBatch(std::vector<figkey::PacketInfo> packets);
 
 protected:
     void closeEvent(QCloseEvent *event) override;
@@ -42,6 +44,8 @@ private slots:
 
     void on_actionSave_triggered();
 
+    void on_actionImport_triggered();
+
     void on_tableView_clicked(const QModelIndex &index);
 
     void on_actionClient_triggered();
@@ -72,22 +76,36 @@ private slots:
 
     void on_actionDoIP_triggered();
 
+    void on_actionConversations_triggered();
+
+    // 后台扫描完成后按扫描时的过滤条件加载打开的文件
+    void onPacketBlocksReady();
+
 private:
     void initTableView();
     void initTreeView();
     void initWindow(bool isStart);
     void exitWindow();
-    void updateTreeView(const figkey::PacketInfo& packet);
+    void updateTreeView(const PacketRecord& record);
     void pauseCapture();
     void reumeCapture();
 
     void updateTreeViewByIndex(const QModelIndex& index);
 
+    void updateStatistics();
+
+    // 按当前过滤条件在后台重新统计打开的文件，完成后重新加载表格
+    void reloadDataBase();
+
+    // 按本次刷新的耗时和数据包速率调整刷新间隔，高流量时界面降低刷新频率而不是卡死
+    void adjustUpdateInterval(qint64 cost, size_t rows);
+
 private:
     Ui::MainWindow *ui;
 
     NetworkAssistWindow client;
     NetworkAssistWindow server;
+    ConversationWindow conversation;
 
     QMutex mutexPacket;
     uint64_t packetCounter{ 0 };
@@ -95,6 +113,7 @@ private:
     PacketInfoModel *pim{ nullptr};
     QStandardItemModel *tvm{ nullptr};
     QTimer *timerUpdateUI{ nullptr};  // 将定时器定义为类的成员变量
+    QLabel *labelStatistics{ nullptr};
     bool scrollBarAtBottom{ true };
     bool userHasScrolled{ false };
     int currentIndex{ -1 };
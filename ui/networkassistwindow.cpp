@@ -15,6 +15,7 @@
 #include "networkassistwindow.h"
 #include "ui_networkassistwindow.h"
 #include "config.h"
+#include "packet.h"
 #include "common/tcpcomm.h"
 #include "common/udpcomm.h"
 #include "doip/doipclientconfig.h"
@@ -420,11 +421,11 @@ void NetworkAssistWindow::setClientIP(const figkey::PacketInfo& packet) {
         comboBox->clear();
 
         if (isServer) {
-            if (!isLocalIP(packet.srcIP)) {
-                comboBox->addItem(QString::fromStdString(packet.srcIP));
+            if (!isLocalIP(figkey::formatIpAddress(packet.srcIP, packet.ipVersion))) {
+                comboBox->addItem(QString::fromStdString(figkey::formatIpAddress(packet.srcIP, packet.ipVersion)));
             }
-            if (!isLocalIP(packet.destIP)) {
-                comboBox->addItem(QString::fromStdString(packet.destIP));
+            if (!isLocalIP(figkey::formatIpAddress(packet.destIP, packet.ipVersion))) {
+                comboBox->addItem(QString::fromStdString(figkey::formatIpAddress(packet.destIP, packet.ipVersion)));
             }
         }
         else {
@@ -448,11 +449,11 @@ void NetworkAssistWindow::setServerIP(const figkey::PacketInfo& packet) {
             }
         }
         else {
-            if (!isLocalIP(packet.srcIP)) {
-                comboBox->addItem(QString::fromStdString(packet.srcIP));
+            if (!isLocalIP(figkey::formatIpAddress(packet.srcIP, packet.ipVersion))) {
+                comboBox->addItem(QString::fromStdString(figkey::formatIpAddress(packet.srcIP, packet.ipVersion)));
             }
-            if (!isLocalIP(packet.destIP)) {
-                comboBox->addItem(QString::fromStdString(packet.destIP));
+            if (!isLocalIP(figkey::formatIpAddress(packet.destIP, packet.ipVersion))) {
+                comboBox->addItem(QString::fromStdString(figkey::formatIpAddress(packet.destIP, packet.ipVersion)));
             }
         }
     }
@@ -463,10 +464,10 @@ void NetworkAssistWindow::setServerPort(const figkey::PacketInfo& packet) {
     if (comboBox) {
         comboBox->clear();
         if (isServer) {
-            if (isLocalIP(packet.srcIP)) {
+            if (isLocalIP(figkey::formatIpAddress(packet.srcIP, packet.ipVersion))) {
                 comboBox->addItem(QString::number(packet.srcPort));
             }
-            if (isLocalIP(packet.destIP)) {
+            if (isLocalIP(figkey::formatIpAddress(packet.destIP, packet.ipVersion))) {
                 comboBox->addItem(QString::number(packet.destPort));
             }
         }
@@ -502,9 +503,9 @@ bool NetworkAssistWindow::setSimulation(figkey::PacketInfo packet) {
         setSettingItemValue(SET_CLIENT_IP_LABEL, "", true);
     }
     else {
-        setSettingItemValue(SET_CLIENT_IP_LABEL, packet.srcIP.c_str(), true);
+        setSettingItemValue(SET_CLIENT_IP_LABEL, QString::fromStdString(figkey::formatIpAddress(packet.srcIP, packet.ipVersion)), true);
     }
-    setSettingItemValue(SET_SERVER_IP_LABEL, packet.destIP.c_str(), true);
+    setSettingItemValue(SET_SERVER_IP_LABEL, QString::fromStdString(figkey::formatIpAddress(packet.destIP, packet.ipVersion)), true);
     setSettingItemValue(SET_SERVER_PORT_LABEL, QString::number(packet.destPort), true);
 
     helper->clearTableSend();
@@ -519,8 +520,13 @@ void NetworkAssistWindow::setMessageType(int type) {
     ui->comboBox->setCurrentIndex(type);
 }
 
-bool NetworkAssistWindow::addRow(const figkey::PacketInfo& packet) {
-    if (packet.payloadLength < 1 || packet.data.empty())
+bool NetworkAssistWindow::addRow(const PacketRecord& record) {
+    const auto& packet = record.info;
+    if (packet.payloadLength < 1)
+        return true;
+
+    std::string data = formatRecordPayload(record);
+    if (data.empty())
         return true;
 
     if (!isCurrentProtocol(packet.protocolType))
@@ -536,7 +542,7 @@ bool NetworkAssistWindow::addRow(const figkey::PacketInfo& packet) {
             return false;
 
         if (item->text().isEmpty()) {
-           item->setText(QString::fromStdString(packet.data));
+           item->setText(QString::fromStdString(data));
            break;
         }
 
@@ -548,9 +554,10 @@ bool NetworkAssistWindow::addRow(const figkey::PacketInfo& packet) {
     if ((i >= ui->tableSend->rowCount()))
         return false;
 
+    std::string srcIp = figkey::formatIpAddress(packet.srcIP, packet.ipVersion);
     if (isServer) {
         std::string serverIp = getSettingItemValue(SET_SERVER_IP_LABEL).toStdString();
-        if (packet.srcIP == serverIp) {
+        if (srcIp == serverIp) {
             typeBox->setCurrentIndex(0);
         }
         else {
@@ -559,7 +566,7 @@ bool NetworkAssistWindow::addRow(const figkey::PacketInfo& packet) {
     }
     else {
         std::string clientIp = getSettingItemValue(SET_CLIENT_IP_LABEL).toStdString();
-        if (packet.srcIP == clientIp) {
+        if (srcIp == clientIp) {
             typeBox->setCurrentIndex(0);
         }
         else {
@@ -5,6 +5,7 @@
 #include <QCloseEvent>
 #include <QComboBox>
 #include "def.h"
+#include "packetrecord.h"
 #include "networkhelper.h"
 #include "common/basecomm.h"
 #include "doip/doiphelper.h"
@@ -29,7 +30,7 @@ public:
     bool set(figkey::PacketInfo packet);
     bool setSimulation(figkey::PacketInfo packet);
     void setMessageType(int type);
-    bool addRow(const figkey::PacketInfo& packet);
+    bool addRow(const PacketRecord& record);
 
 protected:
     void closeEvent(QCloseEvent *event) override;